@@ -0,0 +1,225 @@
+/*
+Traversal time over the pointer AST that the parser builds against its flat
+form from part1/flat_ast.h, over synthetic programs from
+bench/minic_generator.h or the given files:
+
+    bench/ast_layout [-n <iterations>] [-s <statements>] [<file> ...]
+
+Without files the inputs are a wide program, every statement at most one
+level deep, and a deep one, nested 500 levels, of 100000 statements each.
+Every pass runs <iterations> times, 10 by default, and the fastest run
+counts. walk visits every node in the order the passes do and reads its
+payload, the same code for both layouts; print is printNode into
+a stream that drops the text. flatten is what building the flat form
+from the tree costs, which only part1/main still pays now that the parser
+builds it directly; semantic is the analyzer over it.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "../part1/arena.h"
+#include "../part1/flat_ast.h"
+#include "../part1/parser.h"
+#include "../part1/semantic.h"
+#include "../part1/source_buffer.h"
+#include "minic_generator.h"
+
+using namespace std;
+
+class NullBuffer : public streambuf {
+   protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename F>
+static double fastest(int iterations, F run) {
+    double best = -1;
+    for (int i = 0; i < iterations; i++) {
+        auto start = chrono::steady_clock::now();
+        run();
+        double ms = msSince(start);
+        if (best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+static long walk(const astNode* node) {
+    if (!node) return 0;
+
+    switch (node->type) {
+        case ast_prog:
+            return 1 + walk(node->prog.func);
+        case ast_func:
+            return node->func.name + walk(node->func.param) + walk(node->func.body);
+        case ast_extern:
+            return node->ext.name;
+        case ast_var:
+            return node->var.name;
+        case ast_cnst:
+            return node->cnst.value;
+        case ast_rexpr:
+            return node->rexpr.op + walk(node->rexpr.lhs) + walk(node->rexpr.rhs);
+        case ast_bexpr:
+            return node->bexpr.op + walk(node->bexpr.lhs) + walk(node->bexpr.rhs);
+        case ast_uexpr:
+            return node->uexpr.op + walk(node->uexpr.expr);
+        case ast_stmt:
+            break;
+    }
+
+    switch (node->stmt.type) {
+        case ast_call:
+            return node->stmt.call.name + walk(node->stmt.call.param);
+        case ast_ret:
+            return 1 + walk(node->stmt.ret.expr);
+        case ast_block: {
+            long sum = 1;
+            for (const astNode* stmt : node->stmt.block.stmt_list) sum += walk(stmt);
+            return sum;
+        }
+        case ast_while:
+            return 1 + walk(node->stmt.whilen.cond) + walk(node->stmt.whilen.body);
+        case ast_if:
+            return 1 + walk(node->stmt.ifn.cond) + walk(node->stmt.ifn.if_body) +
+                   walk(node->stmt.ifn.else_body);
+        case ast_asgn:
+            return 1 + walk(node->stmt.asgn.lhs) + walk(node->stmt.asgn.rhs);
+        case ast_decl:
+            return node->stmt.decl.name;
+    }
+    return 0;
+}
+
+static long walk(const FlatAst& ast, int32_t node) {
+    if (node == FlatAst::NO_NODE) return 0;
+
+    switch (ast.kind(node)) {
+        case flat_prog:
+            return 1 + walk(ast, ast.func());
+        case flat_func:
+            return ast.name(node) + walk(ast, ast.param(node)) + walk(ast, ast.body(node));
+        case flat_extern:
+        case flat_var:
+        case flat_decl:
+            return ast.name(node);
+        case flat_cnst:
+            return ast.value(node);
+        case flat_rexpr:
+        case flat_bexpr:
+            return ast.op(node) + walk(ast, ast.lhs(node)) + walk(ast, ast.rhs(node));
+        case flat_uexpr:
+            return ast.op(node) + walk(ast, ast.expr(node));
+        case flat_call:
+            return ast.name(node) + walk(ast, ast.param(node));
+        case flat_ret:
+            return 1 + walk(ast, ast.expr(node));
+        case flat_block: {
+            long sum = 1;
+            for (int32_t stmt : ast.statements(node)) sum += walk(ast, stmt);
+            return sum;
+        }
+        case flat_while:
+            return 1 + walk(ast, ast.cond(node)) + walk(ast, ast.body(node));
+        case flat_if:
+            return 1 + walk(ast, ast.cond(node)) + walk(ast, ast.body(node)) +
+                   walk(ast, ast.elseBody(node));
+        case flat_asgn:
+            return 1 + walk(ast, ast.lhs(node)) + walk(ast, ast.rhs(node));
+    }
+    return 0;
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-n <iterations>] [-s <statements>] [<file> ...]" << endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    GeneratorOptions options;
+    options.statements = 100000;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.statements = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (iterations < 1 || options.statements < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<pair<string, string>> inputs;
+    if (files.empty()) {
+        options.depth = 1;
+        inputs.push_back({"wide", generateProgram(options)});
+        options.depth = 500;
+        inputs.push_back({"deep", generateProgram(options)});
+    }
+    for (const string& file : files) {
+        SourceBuffer source;
+        if (!source.map(file.c_str())) {
+            cerr << "Cannot open " << file << endl;
+            return 1;
+        }
+        inputs.push_back({file, string(source.data(), source.size())});
+    }
+
+    NullBuffer discard;
+    ostream null(&discard);
+    printf("%-16s %8s %9s %9s %10s %10s %10s %10s %10s %10s\n", "input", "nodes", "tree KB", "flat KB", "flatten ms",
+           "walk tree", "walk flat", "print tree", "print flat", "semantic");
+    int failures = 0;
+    for (const auto& input : inputs) {
+        astNode* root = parseBuffer(input.second.data(), input.second.size());
+        if (!root) {
+            cerr << input.first << ": Parsing failed." << endl;
+            failures++;
+            continue;
+        }
+
+        FlatAst ast;
+        double flattenMs = fastest(iterations, [&] { ast = FlatAst(root); });
+        long treeSum = 0, flatSum = 0;
+        double walkTreeMs = fastest(iterations, [&] { treeSum = walk(root); });
+        double walkFlatMs = fastest(iterations, [&] { flatSum = walk(ast, ast.root()); });
+        if (treeSum != flatSum) {
+            cerr << input.first << ": The layouts differ." << endl;
+            failures++;
+        }
+        double printTreeMs = fastest(iterations, [&] { printNode(root, 0, null); });
+        double printFlatMs = fastest(iterations, [&] { printNode(ast, ast.root(), 0, null); });
+        bool valid = true;
+        double semanticMs = fastest(iterations, [&] { valid = SemanticAnalyzer().analyze(ast); });
+        if (!valid) {
+            cerr << input.first << ": Semantic analysis failed." << endl;
+            failures++;
+        }
+
+        printf("%-16s %8d %9.1f %9.1f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", input.first.c_str(), ast.size(),
+               root->prog.arena->bytesUsed() / 1024.0, ast.bytes() / 1024.0, flattenMs, walkTreeMs, walkFlatMs,
+               printTreeMs, printFlatMs, semanticMs);
+        fflush(stdout);
+        freeNode(root);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+/*
+Compile latency of the -O0 backend against the LLVM path, in process so
+only the compiler is measured:
+
+    bench/compile_latency [-n <iterations>] <file>.c ...
+
+Each file is compiled to assembly in memory the given number of times with
+each Compiler after one warm-up run; the table shows the median and the
+fastest run in microseconds.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../driver.h"
+
+using namespace std;
+
+/* Median and minimum of the per-run times, in microseconds. */
+static pair<double, double> measure(Compiler& compiler, const string& name, const SourceBuffer& source, int iterations) {
+    vector<double> times;
+    SourceBuffer copy;
+    copy.assign(source.data(), source.size());
+    for (int i = 0; i <= iterations; i++) {
+        auto start = chrono::steady_clock::now();
+        CompileResult result = compiler.compile(name, copy, false);
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        if (!result.ok) {
+            cerr << result.log << result.diagnostics;
+            return {-1, -1};
+        }
+        if (i > 0) times.push_back(us);
+    }
+    sort(times.begin(), times.end());
+    return {times[times.size() / 2], times[0]};
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200;
+    vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || iterations < 1) {
+        cerr << "Usage: " << argv[0] << " [-n <iterations>] <file>.c ..." << endl;
+        return 1;
+    }
+
+    Compiler fast(nullptr, "", 0);
+    Compiler llvm(nullptr, "", 1);
+    double fastTotal = 0, llvmTotal = 0;
+
+    printf("%-50s %12s %12s %12s %12s %8s\n", "file", "-O0 median", "-O0 min", "LLVM median", "LLVM min", "speedup");
+    for (const string& file : files) {
+        SourceBuffer source;
+        if (!source.map(file.c_str())) {
+            cerr << "Cannot open " << file << endl;
+            return 1;
+        }
+        auto [fastMedian, fastMin] = measure(fast, file, source, iterations);
+        auto [llvmMedian, llvmMin] = measure(llvm, file, source, iterations);
+        if (fastMedian < 0 || llvmMedian < 0) {
+            cerr << file << ": compilation failed" << endl;
+            return 1;
+        }
+        printf("%-50s %10.1fus %10.1fus %10.1fus %10.1fus %7.1fx\n", file.c_str(),
+               fastMedian, fastMin, llvmMedian, llvmMin, llvmMedian / fastMedian);
+        fastTotal += fastMedian;
+        llvmTotal += llvmMedian;
+    }
+    printf("%-50s %10.1fus %12s %10.1fus %12s %7.1fx\n", "total", fastTotal, "", llvmTotal, "", llvmTotal / fastTotal);
+
+    LLVMShutdown();
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+How compile time grows with program size, per phase, over synthetic
+programs from bench/minic_generator.h:
+
+    bench/compile_scaling [--sweep statements|depth|variables|expr] [--from <n>] [--to <n>] [-n <iterations>]
+                          [-s <statements>] [-d <depth>] [-v <variables>] [-e <expression depth>] [--seed <n>]
+
+The swept parameter doubles from --from to --to while the others keep their
+values. Every size is compiled in process the given number of times and
+the fastest time of each phase is kept. The last columns give the growth
+exponent from the previous size: about 1 for a linear phase, 2 for a
+quadratic one. The summary fits each phase over the whole sweep.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../driver.h"
+#include "../time_report.h"
+#include "minic_generator.h"
+
+using namespace std;
+
+static const struct {
+    const char* name;
+    const char* path;
+} PHASES[] = {
+    {"parse", "compile/parse"},
+    {"semantic", "compile/semantic analysis"},
+    {"IR builder", "compile/IR builder"},
+    {"optimizer", "compile/optimizer"},
+    {"codegen", "compile/assembly generator"},
+    {"total", "compile"},
+};
+static const int NUM_PHASES = sizeof(PHASES) / sizeof(PHASES[0]);
+
+/* The fastest time of every phase over the runs, in milliseconds. */
+static bool measure(Compiler& compiler, const string& program, int iterations, vector<double>& best) {
+    best.assign(NUM_PHASES, -1);
+    SourceBuffer source;
+    source.assign(program.data(), program.size());
+    for (int i = 0; i < iterations; i++) {
+        TimeReport report(false);
+        report.start();
+        CompileResult result = compiler.compile("generated.c", source, false);
+        report.stop();
+        if (!result.ok) {
+            cerr << result.log << result.diagnostics;
+            return false;
+        }
+        for (int p = 0; p < NUM_PHASES; p++) {
+            double ms = report.costOf(PHASES[p].path).wallNs / 1e6;
+            if (best[p] < 0 || ms < best[p]) best[p] = ms;
+        }
+    }
+    return true;
+}
+
+static double exponent(double t0, double t1, double n0, double n1) {
+    if (t0 <= 0 || t1 <= 0) return 0;
+    return log(t1 / t0) / log(n1 / n0);
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [--sweep statements|depth|variables|expr] [--from <n>] [--to <n>] [-n <iterations>]"
+         << " [-s <statements>] [-d <depth>] [-v <variables>] [-e <expression depth>] [--seed <n>]" << endl;
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    options.depth = 4;
+    options.variables = 16;
+    string sweep = "statements";
+    int from = 250, to = 4000, iterations = 3;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweep = argv[++i];
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.statements = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            options.variables = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            options.exprDepth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int* swept = sweep == "statements" ? &options.statements
+                 : sweep == "depth"    ? &options.depth
+                 : sweep == "variables" ? &options.variables
+                 : sweep == "expr"     ? &options.exprDepth
+                                       : nullptr;
+    if (!swept || from < 1 || to < from || iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Compiler compiler;
+    printf("%-10s %9s", sweep.c_str(), "KB");
+    for (const auto& phase : PHASES) printf(" %11s", phase.name);
+    printf("   growth from the previous size, same order\n");
+
+    vector<int> sizes;
+    vector<vector<double>> times;
+    for (int size = from; size <= to; size *= 2) {
+        *swept = size;
+        string program = generateProgram(options);
+        vector<double> best;
+        if (!measure(compiler, program, iterations, best)) {
+            cerr << sweep << " " << size << ": compilation failed" << endl;
+            return 1;
+        }
+
+        printf("%-10d %9.1f", size, program.size() / 1024.0);
+        for (double ms : best) printf(" %9.3fms", ms);
+        if (!times.empty()) {
+            printf("  ");
+            for (int p = 0; p < NUM_PHASES; p++) printf(" %4.2f", exponent(times.back()[p], best[p], sizes.back(), size));
+        }
+        printf("\n");
+        fflush(stdout);
+
+        sizes.push_back(size);
+        times.push_back(best);
+    }
+
+    if (sizes.size() > 1) {
+        printf("\ngrowth exponent from %s %d to %d:\n", sweep.c_str(), sizes.front(), sizes.back());
+        for (int p = 0; p < NUM_PHASES; p++) {
+            double k = exponent(times.front()[p], times.back()[p], sizes.front(), sizes.back());
+            printf("  %-12s %5.2f%s\n", PHASES[p].name, k, k > 1.3 ? "  superlinear" : "");
+        }
+    }
+
+    LLVMShutdown();
+    return 0;
+}
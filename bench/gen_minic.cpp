@@ -0,0 +1,46 @@
+/*
+Writes a synthetic miniC program to stdout:
+
+    bench/gen_minic [-s <statements>] [-d <depth>] [-v <variables>] [-e <expression depth>]
+                    [-t <trip count>] [--seed <n>]
+
+See bench/minic_generator.h for what the programs look like.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "minic_generator.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.statements = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            options.variables = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            options.exprDepth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options.tripCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            cerr << "Usage: " << argv[0] << " [-s <statements>] [-d <depth>] [-v <variables>] [-e <expression depth>]"
+                 << " [-t <trip count>] [--seed <n>]" << endl;
+            return 1;
+        }
+    }
+    if (options.statements < 0 || options.depth < 0 || options.variables < 0 || options.exprDepth < 0) {
+        cerr << "Sizes cannot be negative" << endl;
+        return 1;
+    }
+
+    cout << generateProgram(options);
+    return 0;
+}
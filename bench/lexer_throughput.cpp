@@ -0,0 +1,191 @@
+/*
+Scanner throughput in MB/s, the hand-written scanner in part1/scanner.h
+against the flex one that part1/part1.l generates:
+
+    bench/lexer_throughput [-n <iterations>] [-s <statements>] [<file> ...]
+
+Without files the input is a synthetic program from bench/minic_generator.h
+with the given number of statements, 200000 by default, which is about
+8 MB. Every scanner runs over all the input the given number of times, 5
+by default, and its fastest run counts. The flex scanner works in place,
+its fastest mode, and strdups every identifier as part1.l says; the
+hand-written one, in each of its modes the CPU supports, interns them. All of them must
+return the same tokens, values and line numbers as flex.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../part1/scanner.h"
+#include "../part1/source_buffer.h"
+#include "../part1/y.tab.h"
+#include "minic_generator.h"
+
+using namespace std;
+
+// The flex scanner, generated with -P flex so it links next to the other
+extern int flexlex_init(yyscan_t* scanner);
+extern int flexlex_destroy(yyscan_t scanner);
+extern int flexget_lineno(yyscan_t scanner);
+extern int flexlex(YYSTYPE* value, yyscan_t scanner);
+extern struct yy_buffer_state* flex_scan_buffer(char* base, size_t size, yyscan_t scanner);
+
+/* What a scanner saw, to check the scanners against each other. */
+struct TokenStream {
+    uint64_t tokens = 0;
+    uint64_t hash = 14695981039346656037ull;
+    int lines = 0;
+
+    void add(uint64_t value) { hash = (hash ^ value) * 1099511628211ull; }
+    void add(const char* name) {
+        for (; *name; name++) add((unsigned char)*name);
+    }
+    bool operator==(const TokenStream& other) const {
+        return tokens == other.tokens && hash == other.hash && lines == other.lines;
+    }
+};
+
+static const struct {
+    const char* name;
+    ScanMode mode;
+} MODES[] = {
+    {"scalar", ScanScalar},
+    {"SSE2", ScanSSE2},
+    {"AVX2", ScanAVX2},
+};
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/* Scans the source with flex and returns the time it took; with a stream,
+   also records the tokens, untimed runs being the only ones that do. */
+static double scanFlex(SourceBuffer& source, TokenStream* stream) {
+    yyscan_t scanner;
+    flexlex_init(&scanner);
+    flex_scan_buffer(source.data(), source.size() + 2, scanner);
+    YYSTYPE value;
+    auto start = chrono::steady_clock::now();
+    for (int token; (token = flexlex(&value, scanner)) != 0;) {
+        if (stream) {
+            stream->tokens++;
+            stream->add(token);
+            if (token == IDENTIFIER) stream->add(value.idname);
+            if (token == NUMBER) stream->add(value.ival);
+        }
+        if (token == IDENTIFIER) free(value.idname);
+    }
+    double seconds = secondsSince(start);
+    if (stream) stream->lines = flexget_lineno(scanner);
+    flexlex_destroy(scanner);
+    return seconds;
+}
+
+static double scanHandWritten(const SourceBuffer& source, ScanMode mode, TokenStream* stream) {
+    Scanner scanner(source.data(), source.size(), mode);
+    YYSTYPE value;
+    uint64_t tokens = 0;
+    auto start = chrono::steady_clock::now();
+    for (int token; (token = scanner.next(&value)) != 0;) {
+        tokens++;
+        if (stream) {
+            stream->tokens++;
+            stream->add(token);
+            if (token == IDENTIFIER) stream->add(symbolName(value.symbol));
+            if (token == NUMBER) stream->add(value.ival);
+        }
+    }
+    double seconds = secondsSince(start);
+    if (stream) stream->lines = scanner.line();
+    // Keeps the loop from being optimized away
+    if (tokens == ~0ull) puts("");
+    return seconds;
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-n <iterations>] [-s <statements>] [<file> ...]" << endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 5;
+    GeneratorOptions options;
+    options.statements = 200000;
+    options.depth = 4;
+    options.variables = 16;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.statements = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // All inputs back to back, each of them a whole program
+    string input;
+    if (files.empty()) input = generateProgram(options);
+    for (const string& file : files) {
+        SourceBuffer source;
+        if (!source.map(file.c_str())) {
+            cerr << "Cannot open " << file << endl;
+            return 1;
+        }
+        input.append(source.data(), source.size());
+    }
+    double megabytes = input.size() / 1e6;
+    SourceBuffer source;
+
+    // flex scans in place, so it gets a fresh copy every time
+    source.assign(input.data(), input.size());
+    TokenStream reference;
+    scanFlex(source, &reference);
+    double flexBest = -1;
+    for (int i = 0; i < iterations; i++) {
+        source.assign(input.data(), input.size());
+        double seconds = scanFlex(source, nullptr);
+        if (flexBest < 0 || seconds < flexBest) flexBest = seconds;
+    }
+
+    printf("%.1f MB, %llu tokens, %d lines\n", megabytes, (unsigned long long)reference.tokens, reference.lines);
+    printf("%-8s %10s %10s %8s\n", "scanner", "MB/s", "ns/token", "speedup");
+    printf("%-8s %10.1f %10.2f %7.2fx\n", "flex", megabytes / flexBest, flexBest * 1e9 / reference.tokens, 1.0);
+
+    int failures = 0;
+    source.assign(input.data(), input.size());
+    for (const auto& mode : MODES) {
+        if (!Scanner::supported(mode.mode)) {
+            printf("%-8s %10s\n", mode.name, "-");
+            continue;
+        }
+        TokenStream stream;
+        scanHandWritten(source, mode.mode, &stream);
+        if (!(stream == reference)) {
+            cerr << mode.name << ": the tokens differ from flex's" << endl;
+            failures++;
+            continue;
+        }
+        double best = -1;
+        for (int i = 0; i < iterations; i++) {
+            double seconds = scanHandWritten(source, mode.mode, nullptr);
+            if (best < 0 || seconds < best) best = seconds;
+        }
+        printf("%-8s %10.1f %10.2f %7.2fx\n", mode.name, megabytes / best, best * 1e9 / reference.tokens,
+               flexBest / best);
+    }
+    return failures == 0 ? 0 : 1;
+}
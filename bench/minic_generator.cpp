@@ -0,0 +1,155 @@
+#include "minic_generator.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+/* Budgets are counted in statements; a compound statement costs one plus
+   its body, and its condition counts with it. */
+class ProgramGenerator {
+   public:
+    explicit ProgramGenerator(const GeneratorOptions& options);
+    string generate();
+
+   private:
+    void statements(int budget, int depth);
+    void statement(int& budget, int depth, bool forced);
+    void expression(int depth);
+    void condition();
+    string variable();
+    void indent(int depth);
+    int pick(int n) { return uniform_int_distribution<int>(0, n - 1)(random); }
+
+    const GeneratorOptions& options;
+    mt19937 random;
+    ostringstream out;
+};
+
+ProgramGenerator::ProgramGenerator(const GeneratorOptions& _options) : options(_options), random(_options.seed) {
+}
+
+string ProgramGenerator::generate() {
+    out << "extern void print(int);\n";
+    out << "extern int read();\n\n";
+    out << "int func(int n) {\n";
+    for (int i = 0; i < options.variables; i++) out << "    int v" << i << ";\n";
+    for (int i = 0; i < options.depth; i++) out << "    int i" << i << ";\n";
+    out << "\n";
+    for (int i = 0; i < options.variables; i++) out << "    v" << i << " = n + " << i << ";\n";
+
+    statements(options.statements, 0);
+
+    out << "    return ";
+    for (int i = 0; i < options.variables; i++) out << (i ? " + v" : "v") << i;
+    if (options.variables == 0) out << "n";
+    out << ";\n}\n";
+    return out.str();
+}
+
+/* The first statement of every level nests as long as the depth allows,
+   so the deepest level is always reached. */
+void ProgramGenerator::statements(int budget, int depth) {
+    for (bool first = true; budget > 0; first = false) {
+        statement(budget, depth, first && depth < options.depth);
+    }
+}
+
+void ProgramGenerator::statement(int& budget, int depth, bool forced) {
+    budget--;
+    bool nest = budget > 0 && (forced || (depth < options.depth && pick(4) == 0));
+
+    if (!nest) {
+        indent(depth + 1);
+        if (options.variables == 0 || pick(10) == 0) {
+            out << "print(";
+            expression(options.exprDepth);
+            out << ");\n";
+        } else {
+            out << variable() << " = ";
+            expression(options.exprDepth);
+            out << ";\n";
+        }
+        return;
+    }
+
+    // A forced nest takes half of what is left, and at least what it takes to
+    // go all the way down
+    int body = forced ? max(min(budget, options.depth - depth), max(1, budget / 2)) : 1 + pick(budget);
+    budget -= body;
+
+    if (pick(2) == 0) {
+        string counter = "i" + to_string(depth);
+        indent(depth + 1);
+        out << counter << " = 0;\n";
+        indent(depth + 1);
+        out << "while (" << counter << " < " << options.tripCount << ") {\n";
+        statements(body, depth + 1);
+        indent(depth + 2);
+        out << counter << " = " << counter << " + 1;\n";
+        indent(depth + 1);
+        out << "}\n";
+    } else {
+        indent(depth + 1);
+        out << "if (";
+        condition();
+        out << ") {\n";
+        int thenBody = body > 1 ? 1 + pick(body - 1) : body;
+        if (forced) thenBody = max(thenBody, min(body, options.depth - depth));
+        statements(thenBody, depth + 1);
+        indent(depth + 1);
+        if (body > thenBody) {
+            out << "} else {\n";
+            statements(body - thenBody, depth + 1);
+            indent(depth + 1);
+        }
+        out << "}\n";
+    }
+}
+
+void ProgramGenerator::expression(int depth) {
+    int choice = depth > 0 ? pick(6) : pick(2);
+    if (choice == 0 || options.variables == 0) {
+        out << pick(100);
+    } else if (choice == 1) {
+        out << variable();
+    } else if (choice == 2) {
+        out << "-(";
+        expression(depth - 1);
+        out << ")";
+    } else if (choice == 3) {
+        // Never by zero, and small enough to keep values moving
+        out << "((";
+        expression(depth - 1);
+        out << ") / " << 1 + pick(9) << ")";
+    } else {
+        static const char OPS[] = {'+', '-', '*'};
+        out << "(";
+        expression(depth - 1);
+        out << " " << OPS[pick(3)] << " ";
+        expression(depth - 1);
+        out << ")";
+    }
+}
+
+void ProgramGenerator::condition() {
+    // The scanner has no !=
+    static const char* RELATIONS[] = {"<", ">", "<=", ">=", "=="};
+    expression(1);
+    out << " " << RELATIONS[pick(5)] << " ";
+    expression(1);
+}
+
+string ProgramGenerator::variable() {
+    return "v" + to_string(pick(options.variables));
+}
+
+/* Deep programs stop indenting at some point to keep their size linear. */
+void ProgramGenerator::indent(int depth) {
+    out << string(4 * min(depth, 16), ' ');
+}
+
+string generateProgram(const GeneratorOptions& options) {
+    return ProgramGenerator(options).generate();
+}
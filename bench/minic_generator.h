@@ -0,0 +1,22 @@
+#ifndef MINIC_GENERATOR_H
+#define MINIC_GENERATOR_H
+
+#include <string>
+
+struct GeneratorOptions {
+    int statements = 100;  // statements in the function body, nested ones included
+    int depth = 3;         // deepest nesting of while and if
+    int variables = 8;     // variables besides the loop counters
+    int exprDepth = 3;     // deepest nesting of arithmetic in one expression
+    int tripCount = 3;     // iterations of every while loop
+    unsigned seed = 1;
+};
+
+/* Writes a valid miniC program of the given shape; the same options always
+   give the same program. All variables are declared at the top of the
+   function and set before they are read, every while loop runs tripCount
+   times on a counter of its own, and divisions are by nonzero constants,
+   so the programs also run, return and print deterministically. */
+std::string generateProgram(const GeneratorOptions& options);
+
+#endif  // MINIC_GENERATOR_H
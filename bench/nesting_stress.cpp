@@ -0,0 +1,210 @@
+/*
+Every pass over programs nested far deeper than any real one, on a thread
+with a small stack, so a pass that recurses on the nesting depth crashes
+here rather than on some user's input:
+
+    bench/nesting_stress [-d <depth>] [-v <variables>] [-k <stack KB>]
+
+The programs nest <depth> levels, 100000 by default: while loops whose
+bodies declare a variable of their own, an else-if chain, bare blocks, a
+left-leaning sum, a right-leaning difference, a chain of negations and
+blocks under a function with <variables> names, 1000 by default, each
+declaring a name of its own set from one of the function's.
+Each is parsed, turned into a pointer tree and flattened back, analyzed,
+printed both ways into a stream that drops the text, built into LLVM IR
+without the optimizer, compiled by the -O0 backend and freed, all on a
+thread with a <stack KB> stack, 256 by default. The table shows each phase
+in milliseconds.
+*/
+
+#include <llvm-c/Core.h>
+#include <pthread.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "../part1/flat_ast.h"
+#include "../part1/parser.h"
+#include "../part1/semantic.h"
+#include "../part2/ir_builder.h"
+#include "../part4/fast_codegen.h"
+
+using namespace std;
+
+class NullBuffer : public streambuf {
+   protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+struct StressRun {
+    string name;
+    string source;
+    int32_t nodes = 0;
+    double parseMs = 0, treeMs = 0, semanticMs = 0, printMs = 0, irMs = 0, fastMs = 0, freeMs = 0;
+    string error;
+};
+
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/* Wraps the statement in a function that declares a and returns it. */
+static string program(const string& body) {
+    return "extern void print(int);\nextern int read();\n\nint func(int p) {\n    int a;\n    a = p;\n" + body +
+           "    return a;\n}\n";
+}
+
+static string repeat(const char* text, int count) {
+    string result;
+    result.reserve(strlen(text) * count);
+    for (int i = 0; i < count; i++) result += text;
+    return result;
+}
+
+/* Blocks nested depth levels under a function declaring v0 through
+   v<variables - 1>, so every scope sees that many names. */
+static string manyNames(int depth, int variables) {
+    string text = "extern void print(int);\nextern int read();\n\nint func(int p) {\n";
+    for (int j = 0; j < variables; j++) {
+        text += "    int v" + to_string(j) + ";\n";
+    }
+    for (int j = 0; j < variables; j++) {
+        text += "    v" + to_string(j) + " = p;\n";
+    }
+    for (int i = 0; i < depth; i++) {
+        text += "{ int b; b = v" + to_string(i % variables) + ";\n";
+    }
+    return text + "print(b);\n" + repeat("}\n", depth) + "    return v0;\n}\n";
+}
+
+static vector<StressRun> stressPrograms(int depth, int variables) {
+    vector<StressRun> runs(7);
+    runs[0].name = "while";
+    runs[0].source = program(repeat("while (a < 10) { int a; a = 1;\n", depth) + "a = a + 1;\n" + repeat("}\n", depth));
+    runs[1].name = "else-if";
+    runs[1].source = program(repeat("if (a < 1) a = 1; else\n", depth) + "a = 0;\n");
+    runs[2].name = "block";
+    runs[2].source = program(repeat("{ int a; a = 2;\n", depth) + "print(a);\n" + repeat("}\n", depth));
+    runs[3].name = "sum";
+    runs[3].source = program("a = a" + repeat(" + a", depth) + ";\n");
+    runs[4].name = "difference";
+    runs[4].source = program("a = " + repeat("a - (", depth) + "a" + repeat(")", depth) + ";\n");
+    runs[5].name = "negation";
+    runs[5].source = program("a = " + repeat("- ", depth) + "a;\n");
+    runs[6].name = "many names";
+    runs[6].source = manyNames(depth, variables);
+    return runs;
+}
+
+/* Runs every pass over one program, timing each. */
+static void runPasses(StressRun& run) {
+    auto start = chrono::steady_clock::now();
+    FlatAst ast;
+    bool parsed = parseBuffer(run.source.data(), run.source.size(), ast);
+    run.parseMs = msSince(start);
+    if (!parsed) {
+        run.error = "Parsing failed.";
+        return;
+    }
+    run.nodes = ast.size();
+
+    start = chrono::steady_clock::now();
+    astNode* root = ast.toTree();
+    if (FlatAst(root).size() != ast.size()) run.error = "The tree differs.";
+    run.treeMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    SemanticAnalyzer analyzer;
+    bool valid = analyzer.analyze(ast);
+    run.semanticMs = msSince(start);
+    if (!valid) run.error = analyzer.getError();
+
+    NullBuffer discard;
+    ostream null(&discard);
+    start = chrono::steady_clock::now();
+    printNode(root, 0, null);
+    printNode(ast, ast.root(), 0, null);
+    run.printMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMModuleRef module = IRBuilder(context).buildIR(ast);
+    LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    run.irMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    ostringstream assembly;
+    if (!FastCodeGenerator(assembly).generate(ast) && run.error.empty()) run.error = "Code generation failed.";
+    run.fastMs = msSince(start);
+
+    start = chrono::steady_clock::now();
+    freeNode(root);
+    run.freeMs = msSince(start);
+}
+
+static void* runAll(void* argument) {
+    for (StressRun& run : *static_cast<vector<StressRun>*>(argument)) {
+        runPasses(run);
+    }
+    return nullptr;
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-d <depth>] [-v <variables>] [-k <stack KB>]" << endl;
+}
+
+int main(int argc, char** argv) {
+    int depth = 100000;
+    int variables = 1000;
+    int stackKB = 256;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            variables = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            stackKB = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (depth < 1 || variables < 1 || stackKB < 64) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<StressRun> runs = stressPrograms(depth, variables);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, (size_t)stackKB * 1024);
+    pthread_t thread;
+    if (pthread_create(&thread, &attributes, runAll, &runs) != 0) {
+        cerr << "Cannot start a thread with a " << stackKB << " KB stack" << endl;
+        return 1;
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+
+    printf("%-12s %8s %9s %10s %10s %10s %10s %10s %10s\n", "input", "nodes", "parse ms", "tree ms", "semantic",
+           "print", "IR", "-O0", "free ms");
+    int failures = 0;
+    for (const StressRun& run : runs) {
+        printf("%-12s %8d %9.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %s\n", run.name.c_str(), run.nodes,
+               run.parseMs, run.treeMs, run.semanticMs, run.printMs, run.irMs, run.fastMs, run.freeMs,
+               run.error.c_str());
+        if (!run.error.empty()) failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
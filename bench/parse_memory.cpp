@@ -0,0 +1,156 @@
+/*
+Parse time and heap traffic of building and freeing the AST, in the flat
+form the parser builds, over synthetic programs from bench/minic_generator.h or the given files:
+
+    bench/parse_memory [-n <iterations>] [-d <depth>] [<file> ...]
+
+Without files the inputs are generated programs of 1000, 10000 and 100000
+statements nested up to the given depth, 4 by default. Each input is parsed
+and its AST freed <iterations> times, 10 by default, after one warm-up run
+that interns the names; the fastest parse and the fastest teardown count.
+The heap is counted by wrapping malloc, calloc, realloc and free, so
+allocations outside operator new count too: allocs and alloc KB during the
+parse, frees during the parse and the teardown. AST KB is what the flat
+AST takes.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../part1/parser.h"
+#include "../part1/source_buffer.h"
+#include "minic_generator.h"
+
+using namespace std;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void __libc_free(void* pointer);
+
+static bool counting = false;
+static uint64_t allocations, bytes, frees;
+
+extern "C" void* malloc(size_t size) {
+    if (counting) allocations++, bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) allocations++, bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+    if (counting) allocations++, bytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer) {
+    if (counting && pointer) frees++;
+    __libc_free(pointer);
+}
+
+struct Measurement {
+    double parseMs = -1, freeMs = -1;
+    uint64_t allocations = 0, bytes = 0, frees = 0;
+    size_t astBytes = 0;
+};
+
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static bool measure(const string& source, int iterations, Measurement& m) {
+    for (int i = 0; i <= iterations; i++) {
+        allocations = bytes = frees = 0;
+        counting = i > 0;
+        auto start = chrono::steady_clock::now();
+        FlatAst ast;
+        bool parsed = parseBuffer(source.data(), source.size(), ast);
+        double parseMs = msSince(start);
+        uint64_t parseAllocations = allocations, parseBytes = bytes;
+        if (!parsed) {
+            counting = false;
+            return false;
+        }
+        m.astBytes = ast.bytes();
+        start = chrono::steady_clock::now();
+        ast = FlatAst();
+        double freeMs = msSince(start);
+        counting = false;
+        if (i == 0) continue;
+
+        if (m.parseMs < 0 || parseMs < m.parseMs) m.parseMs = parseMs;
+        if (m.freeMs < 0 || freeMs < m.freeMs) m.freeMs = freeMs;
+        m.allocations = parseAllocations;
+        m.bytes = parseBytes;
+        m.frees = frees;
+    }
+    return true;
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-n <iterations>] [-d <depth>] [<file> ...]" << endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    GeneratorOptions options;
+    options.depth = 4;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options.depth = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<pair<string, string>> inputs;
+    if (files.empty()) {
+        for (int statements : {1000, 10000, 100000}) {
+            options.statements = statements;
+            inputs.push_back({to_string(statements) + " statements", generateProgram(options)});
+        }
+    }
+    for (const string& file : files) {
+        SourceBuffer source;
+        if (!source.map(file.c_str())) {
+            cerr << "Cannot open " << file << endl;
+            return 1;
+        }
+        inputs.push_back({file, string(source.data(), source.size())});
+    }
+
+    printf("%-24s %9s %10s %10s %10s %10s %10s %10s\n", "input", "KB", "parse ms", "allocs", "alloc KB", "AST KB",
+           "free ms", "frees");
+    int failures = 0;
+    for (const auto& input : inputs) {
+        Measurement m;
+        if (!measure(input.second, iterations, m)) {
+            cerr << input.first << ": Parsing failed." << endl;
+            failures++;
+            continue;
+        }
+        printf("%-24s %9.1f %10.2f %10llu %10.1f %10.1f %10.3f %10llu\n", input.first.c_str(),
+               input.second.size() / 1024.0, m.parseMs, (unsigned long long)m.allocations, m.bytes / 1024.0,
+               m.astBytes / 1024.0, m.freeMs, (unsigned long long)m.frees);
+    }
+    return failures == 0 ? 0 : 1;
+}
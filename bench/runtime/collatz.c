@@ -0,0 +1,28 @@
+extern void print(int);
+extern int read();
+
+int func(int n) {
+    int k;
+    int x;
+    int steps;
+    int total;
+
+    total = 0;
+    k = 1;
+    while (k < n) {
+        x = k;
+        steps = 0;
+        while (x > 1) {
+            if (x - (x / 2) * 2 == 0) {
+                x = x / 2;
+            } else {
+                x = 3 * x + 1;
+            }
+            steps = steps + 1;
+        }
+        total = total + steps;
+        k = k + 1;
+    }
+    print(total);
+    return total;
+}
@@ -0,0 +1,22 @@
+extern void print(int);
+extern int read();
+
+int func(int n) {
+    int a;
+    int b;
+    int t;
+    int i;
+
+    a = 0;
+    b = 1;
+    i = 0;
+    while (i < n) {
+        t = a + b;
+        t = t - (t / 1000007) * 1000007;
+        a = b;
+        b = t;
+        i = i + 1;
+    }
+    print(a);
+    return a;
+}
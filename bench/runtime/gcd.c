@@ -0,0 +1,31 @@
+extern void print(int);
+extern int read();
+
+int func(int n) {
+    int i;
+    int j;
+    int a;
+    int b;
+    int t;
+    int s;
+
+    s = 0;
+    i = 1;
+    while (i < n) {
+        j = 1;
+        while (j < n) {
+            a = i;
+            b = j;
+            while (b > 0) {
+                t = a - (a / b) * b;
+                a = b;
+                b = t;
+            }
+            s = s + a;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    print(s);
+    return s;
+}
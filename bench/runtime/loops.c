@@ -0,0 +1,23 @@
+extern void print(int);
+extern int read();
+
+int func(int n) {
+    int i;
+    int j;
+    int s;
+    int t;
+
+    s = 0;
+    i = 0;
+    while (i < n) {
+        j = 0;
+        while (j < n) {
+            t = i * j + s;
+            s = t - (t / 1000003) * 1000003;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    print(s);
+    return s;
+}
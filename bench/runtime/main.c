@@ -0,0 +1,41 @@
+/*
+The runtime the benchmark links every build of a program against: print
+and read as in part2/builder_tests/main.c, and a main that calls func once
+with the argument given on the command line. The program's output goes to
+stdout, followed by what func returned; the time the call took goes to
+stderr as "<nanoseconds> <cycles>", the cycles read from the time stamp
+counter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <x86intrin.h>
+
+int func(int);
+
+int read() {
+    int x;
+    if (scanf("%d", &x) != 1) x = 0;
+    return x;
+}
+
+void print(int x) {
+    printf("%d\n", x);
+}
+
+int main(int argc, char** argv) {
+    int arg = argc > 1 ? atoi(argv[1]) : 5;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long long startCycles = __rdtsc();
+    int result = func(arg);
+    unsigned long long cycles = __rdtsc() - startCycles;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("returned %d\n", result);
+    long long ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    fprintf(stderr, "%lld %llu\n", ns, cycles);
+    return 0;
+}
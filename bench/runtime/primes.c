@@ -0,0 +1,28 @@
+extern void print(int);
+extern int read();
+
+int func(int n) {
+    int x;
+    int d;
+    int prime;
+    int count;
+
+    count = 0;
+    x = 2;
+    while (x < n) {
+        prime = 1;
+        d = 2;
+        while (d <= x / d) {
+            if (x - (x / d) * d == 0) {
+                prime = 0;
+                d = x;
+            } else {
+                d = d + 1;
+            }
+        }
+        count = count + prime;
+        x = x + 1;
+    }
+    print(count);
+    return count;
+}
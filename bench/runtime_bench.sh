@@ -0,0 +1,161 @@
+#!/bin/bash
+# Runtime of the code the compiler generates against clang-15 -O0 and -O2:
+#
+#     bench/runtime_bench.sh [-r <runs>] [--record] [<program> ...]
+#
+# Every program in bench/runtime/args, or the ones named, is built four
+# ways: our -O1 (LLVM IR through AssemblyGenerator), our -O0 (straight from
+# the AST), and clang at -O0 and -O2. Each build is linked for 32-bit x86
+# against bench/runtime/main.c and run <runs> times, 5 by default, with the
+# argument from bench/runtime/args; the fastest run counts. All builds of a
+# program must print the same. The table gives milliseconds and our -O1
+# relative to clang in time and in time stamp counter cycles.
+#
+# Each run is compared with the last results in bench/runtime/history.csv;
+# a build of ours more than 10% slower is reported as a regression and
+# fails the script. --record appends this run to the history, keyed by date
+# and commit. CLANG and MAIN override the compilers used.
+
+set -u
+cd "$(dirname "$0")/.."
+
+CLANG=${CLANG:-clang-15}
+MAIN=${MAIN:-./main}
+RUNS=5
+RECORD=0
+PROGRAMS=()
+HISTORY=bench/runtime/history.csv
+VARIANTS=(O1 O0 clang-O0 clang-O2)
+
+while [ $# -gt 0 ]; do
+    case $1 in
+        -r)
+            RUNS=$2
+            shift 2
+            ;;
+        --record)
+            RECORD=1
+            shift
+            ;;
+        -*)
+            echo "Usage: $0 [-r <runs>] [--record] [<program> ...]" >&2
+            exit 1
+            ;;
+        *)
+            PROGRAMS+=("$1")
+            shift
+            ;;
+    esac
+done
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=($(awk '!/^#/ && NF { print $1 }' bench/runtime/args))
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+$CLANG -m32 -O2 -c bench/runtime/main.c -o "$WORK/runtime.o" || exit 1
+
+# build <program> <variant> leaves the executable at $WORK/<program>-<variant>
+build() {
+    local src=bench/runtime/$1.c exe=$WORK/$1-$2
+    case $2 in
+        O1 | O0)
+            $MAIN -$2 --stdout "$src" >"$exe.s" && $CLANG -m32 -no-pie "$exe.s" "$WORK/runtime.o" -o "$exe"
+            ;;
+        clang-*)
+            $CLANG -m32 -no-pie -w -${2#clang-} "$src" "$WORK/runtime.o" -o "$exe"
+            ;;
+    esac
+}
+
+# measure <exe> <arg> prints the fastest "<ns> <cycles>" over the runs and
+# leaves the program's output in <exe>.out
+measure() {
+    local best="" run i
+    for ((i = 0; i < RUNS; i++)); do
+        run=$("$1" "$2" 2>&1 >"$1.out" </dev/null) || return 1
+        if [ -z "$best" ] || [ "${run% *}" -lt "${best% *}" ]; then
+            best=$run
+        fi
+    done
+    echo "$best"
+}
+
+# ratio <a> <b> prints a / b
+ratio() {
+    awk -v a="$1" -v b="$2" 'BEGIN { if (b > 0) printf "%.2f", a / b; else printf "-" }'
+}
+
+commit=$(git describe --always --dirty 2>/dev/null || echo dev)
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+failed=0
+declare -A NS CYCLES
+records=()
+ratios=()
+
+printf "%-10s %10s %10s %10s %10s %9s %9s %9s\n" program "O1 ms" "O0 ms" "clang-O0" "clang-O2" "/clang-O0" "/clang-O2" "cycles/O2"
+for program in "${PROGRAMS[@]}"; do
+    arg=$(awk -v p="$program" '$1 == p { print $2 }' bench/runtime/args)
+    arg=${arg:-5}
+
+    ok=1
+    for variant in "${VARIANTS[@]}"; do
+        exe=$WORK/$program-$variant
+        if ! build "$program" "$variant"; then
+            echo "$program: $variant does not build" >&2
+            ok=0
+            continue
+        fi
+        if ! result=$(measure "$exe" "$arg"); then
+            echo "$program: $variant failed to run" >&2
+            ok=0
+            continue
+        fi
+        NS[$program,$variant]=${result% *}
+        CYCLES[$program,$variant]=${result#* }
+    done
+
+    # clang -O0 is the reference output
+    reference=$WORK/$program-clang-O0.out
+    for variant in O1 O0 clang-O2; do
+        if [ -f "$reference" ] && [ -f "$WORK/$program-$variant.out" ] && ! cmp -s "$reference" "$WORK/$program-$variant.out"; then
+            echo "$program: $variant prints something else than clang -O0" >&2
+            ok=0
+        fi
+    done
+    if [ $ok == 0 ]; then
+        failed=1
+        continue
+    fi
+
+    printf "%-10s %10.1f %10.1f %10.1f %10.1f %8sx %8sx %8sx\n" "$program" \
+        "$(ratio "${NS[$program,O1]}" 1000000)" "$(ratio "${NS[$program,O0]}" 1000000)" \
+        "$(ratio "${NS[$program,clang-O0]}" 1000000)" "$(ratio "${NS[$program,clang-O2]}" 1000000)" \
+        "$(ratio "${NS[$program,O1]}" "${NS[$program,clang-O0]}")" \
+        "$(ratio "${NS[$program,O1]}" "${NS[$program,clang-O2]}")" \
+        "$(ratio "${CYCLES[$program,O1]}" "${CYCLES[$program,clang-O2]}")"
+
+    for variant in O1 O0; do
+        previous=$(awk -F, -v p="$program" -v v="$variant" '$3 == p && $4 == v { ns = $6 } END { print ns }' "$HISTORY")
+        if [ -n "$previous" ] && awk -v now="${NS[$program,$variant]}" -v then="$previous" 'BEGIN { exit !(now > then * 1.1) }'; then
+            echo "$program: REGRESSION at $variant, $(ratio "${NS[$program,$variant]}" "$previous")x the last recorded time" >&2
+            failed=1
+        fi
+    done
+    ratios+=("$(ratio "${NS[$program,O1]}" "${NS[$program,clang-O0]}") $(ratio "${NS[$program,O1]}" "${NS[$program,clang-O2]}")")
+    for variant in "${VARIANTS[@]}"; do
+        records+=("$date,$commit,$program,$variant,$arg,${NS[$program,$variant]},${CYCLES[$program,$variant]}")
+    done
+done
+
+if [ ${#ratios[@]} -gt 1 ]; then
+    printf "%s\n" "${ratios[@]}" | awk '{ a += log($1); b += log($2); n++ }
+        END { printf "%-54s %8.2fx %8.2fx\n", "geometric mean", exp(a / n), exp(b / n) }'
+fi
+
+if [ $RECORD == 1 ] && [ ${#records[@]} -gt 0 ]; then
+    printf "%s\n" "${records[@]}" >>"$HISTORY"
+    echo "Recorded ${#records[@]} results in $HISTORY"
+fi
+exit $failed
@@ -0,0 +1,271 @@
+/*
+Cost of the semantic analyzer's symbol table on deeply nested programs with
+many variables, against the stack of per-scope tables it replaced:
+
+    bench/scope_lookup [-n <iterations>] [-d <depth>] [-v <variables>]
+
+The programs nest blocks <depth> levels, 2000 by default, each declaring
+<variables> names, 8 by default, and assigning them: in shadowing the
+blocks redeclare the same names and read their own, in outer names they
+read names declared at the top of the function, and in wide the blocks
+follow one another at depth 1. Every program is analyzed; the scope
+entries, declarations and lookups the analyzer makes are also replayed
+against the SymbolTable and against a vector of one unordered_map per
+scope searched from the innermost out. Every run repeats <iterations>
+times, 10 by default, and the fastest counts.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../part1/flat_ast.h"
+#include "../part1/parser.h"
+#include "../part1/semantic.h"
+
+using namespace std;
+
+/* The symbol table as it was: a table per scope, a lookup probing each one
+   from the innermost out. */
+class ScopeStack {
+   public:
+    void new_scope() { scopes.emplace_back(); }
+    void end_scope() { scopes.pop_back(); }
+    void insert(Symbol identifier, int value) { scopes.back()[identifier] = value; }
+    bool exists(Symbol identifier) {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            if (it->find(identifier) != it->end()) return true;
+        }
+        return false;
+    }
+
+   private:
+    vector<unordered_map<Symbol, int>> scopes;
+};
+
+enum ScopeOp { op_enter, op_leave, op_declare, op_lookup };
+
+struct ScopeEvent {
+    ScopeOp op;
+    Symbol name;
+};
+
+struct Trace {
+    vector<ScopeEvent> events;
+    int scopes = 0, declarations = 0, lookups = 0;
+};
+
+/* The symbol table calls SemanticAnalyzer makes on the AST, in order. */
+static Trace traceScopes(const FlatAst& ast) {
+    Trace trace;
+    const int32_t END_SCOPE = -2;
+    vector<int32_t> pending(1, ast.root());
+    auto later = [&pending](int32_t child) {
+        if (child != FlatAst::NO_NODE) pending.push_back(child);
+    };
+    auto laterScope = [&](FlatRange stmts) {
+        trace.events.push_back({op_enter, 0});
+        trace.scopes++;
+        pending.push_back(END_SCOPE);
+        for (int32_t i = stmts.count; i > 0; i--) later(stmts.items[i - 1]);
+    };
+
+    while (!pending.empty()) {
+        int32_t node = pending.back();
+        pending.pop_back();
+        if (node == END_SCOPE) {
+            trace.events.push_back({op_leave, 0});
+            continue;
+        }
+
+        switch (ast.kind(node)) {
+            case flat_prog:
+                later(ast.func());
+                break;
+            case flat_func:
+                laterScope(ast.statements(ast.body(node)));
+                if (ast.param(node) != FlatAst::NO_NODE) {
+                    trace.events.push_back({op_declare, ast.name(ast.param(node))});
+                    trace.declarations++;
+                }
+                break;
+            case flat_block:
+                laterScope(ast.statements(node));
+                break;
+            case flat_decl:
+                trace.events.push_back({op_declare, ast.name(node)});
+                trace.declarations++;
+                break;
+            case flat_var:
+                trace.events.push_back({op_lookup, ast.name(node)});
+                trace.lookups++;
+                break;
+            case flat_call:
+                later(ast.param(node));
+                break;
+            case flat_ret:
+            case flat_uexpr:
+                later(ast.expr(node));
+                break;
+            case flat_while:
+                later(ast.body(node));
+                later(ast.cond(node));
+                break;
+            case flat_asgn:
+            case flat_rexpr:
+            case flat_bexpr:
+                later(ast.rhs(node));
+                later(ast.lhs(node));
+                break;
+            case flat_if:
+                later(ast.elseBody(node));
+                later(ast.body(node));
+                later(ast.cond(node));
+                break;
+            default:
+                break;
+        }
+    }
+    return trace;
+}
+
+/* Replays the trace, returning how many lookups found their name. */
+template <typename Table>
+static int replay(const Trace& trace) {
+    Table table;
+    int found = 0;
+    for (const ScopeEvent& event : trace.events) {
+        switch (event.op) {
+            case op_enter:
+                table.new_scope();
+                break;
+            case op_leave:
+                table.end_scope();
+                break;
+            case op_declare:
+                table.insert(event.name, 0);
+                break;
+            case op_lookup:
+                found += table.exists(event.name);
+                break;
+        }
+    }
+    return found;
+}
+
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename F>
+static double fastest(int iterations, F run) {
+    double best = -1;
+    for (int i = 0; i < iterations; i++) {
+        auto start = chrono::steady_clock::now();
+        run();
+        double ms = msSince(start);
+        if (best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+/* A block declaring the names prefix0 through prefix<variables - 1>, each
+   set from reads of the names from0 through from<variables - 1>. */
+static string block(const string& prefix, const string& from, int variables) {
+    string text = "{\n";
+    for (int j = 0; j < variables; j++) {
+        text += "int " + prefix + to_string(j) + ";\n";
+    }
+    for (int j = 0; j < variables; j++) {
+        text += prefix + to_string(j) + " = " + from + to_string(j) + " + " + from + to_string((j + 1) % variables) +
+                ";\n";
+    }
+    return text;
+}
+
+static string program(const string& body, int variables) {
+    string text = "extern void print(int);\nextern int read();\n\nint func(int p) {\n";
+    for (int j = 0; j < variables; j++) {
+        text += "int g" + to_string(j) + ";\n";
+    }
+    for (int j = 0; j < variables; j++) {
+        text += "g" + to_string(j) + " = p;\n";
+    }
+    return text + body + "return g0;\n}\n";
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-n <iterations>] [-d <depth>] [-v <variables>]" << endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    int depth = 2000;
+    int variables = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            variables = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (iterations < 1 || depth < 1 || variables < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string shadowing, outer, wide;
+    for (int i = 0; i < depth; i++) {
+        shadowing += block("a", "a", variables);
+        outer += block("b" + to_string(i) + "_", "g", variables);
+        wide += block("a", "g", variables) + "}\n";
+    }
+    for (int i = 0; i < depth; i++) {
+        shadowing += "}\n";
+        outer += "}\n";
+    }
+    vector<pair<string, string>> inputs = {
+        {"shadowing", program(shadowing, variables)},
+        {"outer names", program(outer, variables)},
+        {"wide", program(wide, variables)},
+    };
+
+    printf("%-12s %8s %8s %8s %11s %10s %11s\n", "input", "scopes", "decls", "lookups", "semantic ms", "table ms",
+           "per-scope ms");
+    int failures = 0;
+    for (const auto& input : inputs) {
+        FlatAst ast;
+        if (!parseBuffer(input.second.data(), input.second.size(), ast)) {
+            cerr << input.first << ": Parsing failed." << endl;
+            failures++;
+            continue;
+        }
+
+        bool valid = true;
+        double semanticMs = fastest(iterations, [&] { valid = SemanticAnalyzer().analyze(ast); });
+        Trace trace = traceScopes(ast);
+        int flatFound = 0, stackFound = 0;
+        double flatMs = fastest(iterations, [&] { flatFound = replay<SymbolTable>(trace); });
+        double stackMs = fastest(iterations, [&] { stackFound = replay<ScopeStack>(trace); });
+        if (!valid || flatFound != trace.lookups || stackFound != trace.lookups) {
+            cerr << input.first << ": Names not found." << endl;
+            failures++;
+        }
+
+        printf("%-12s %8d %8d %8d %11.2f %10.2f %11.2f\n", input.first.c_str(), trace.scopes, trace.declarations,
+               trace.lookups, semanticMs, flatMs, stackMs);
+        fflush(stdout);
+    }
+    return failures == 0 ? 0 : 1;
+}
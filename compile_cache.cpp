@@ -0,0 +1,222 @@
+#include "compile_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "driver.h"
+
+using namespace std;
+
+// Written into build_id.cpp by the makefile whenever any other object of
+// the binary changes, from git describe and a hash of those objects
+extern const char* const MINIC_BUILD_ID;
+
+// Part of every key, so results from another compiler build are never reused
+static const char* COMPILER_VERSION = "minic-1 ";
+
+static uint64_t fnv1a(const char* data, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* MurmurHash64A: a second, independent 64 bits for the key. */
+static uint64_t murmur64(const char* data, size_t length, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (length * m);
+
+    size_t blocks = length / 8;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k;
+        memcpy(&k, data + i * 8, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = (const unsigned char*)data + blocks * 8;
+    switch (length & 7) {
+        case 7: h ^= uint64_t(tail[6]) << 48;  // fall through
+        case 6: h ^= uint64_t(tail[5]) << 40;  // fall through
+        case 5: h ^= uint64_t(tail[4]) << 32;  // fall through
+        case 4: h ^= uint64_t(tail[3]) << 24;  // fall through
+        case 3: h ^= uint64_t(tail[2]) << 16;  // fall through
+        case 2: h ^= uint64_t(tail[1]) << 8;  // fall through
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+static bool readWholeFile(const string& path, string& contents) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    contents.resize(st.st_size);
+    size_t done = 0;
+    while (done < contents.size()) {
+        ssize_t n = read(fd, &contents[done], contents.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    close(fd);
+    return done == contents.size();
+}
+
+/* Sum of the sizes of all regular files in dir. */
+static uint64_t directorySize(const string& dir) {
+    uint64_t total = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    while (dirent* entry = readdir(d)) {
+        struct stat st;
+        if (stat((dir + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+    return total;
+}
+
+CompileCache::CompileCache(const string& _dir, uint64_t _maxBytes)
+    : dir(_dir), maxBytes(_maxBytes), approxBytes(0), hits(0), misses(0), stores(0), evictions(0) {
+    mkdir(dir.c_str(), 0755);
+    approxBytes = directorySize(dir);
+}
+
+/* 128 bits of hash over version, options and source, plus the source length. */
+string CompileCache::makeKey(const char* data, size_t length, const string& options) {
+    string prefix = string(COMPILER_VERSION) + MINIC_BUILD_ID + '\0' + options + '\0';
+    uint64_t a = fnv1a(data, length, fnv1a(prefix.data(), prefix.size(), 0xcbf29ce484222325ULL));
+    uint64_t b = murmur64(data, length, murmur64(prefix.data(), prefix.size(), 0x9e3779b97f4a7c15ULL));
+
+    char key[64];
+    snprintf(key, sizeof(key), "%016llx%016llx-%zx", (unsigned long long)a, (unsigned long long)b, length);
+    return key;
+}
+
+/* irExtension is ".ll" or ".bc" to get the IR back too, empty for assembly only. */
+bool CompileCache::lookup(const string& key, const string& irExtension, CompileResult& result) {
+    string base = dir + "/" + key;
+    if (!readWholeFile(base + ".s", result.assembly) ||
+        (!irExtension.empty() && (!readWholeFile(base + irExtension, result.ir) ||
+                                  !readWholeFile(base + "_opt" + irExtension, result.optIR)))) {
+        misses++;
+        return false;
+    }
+
+    // The mtime of the .s file is the entry's last use
+    utimensat(AT_FDCWD, (base + ".s").c_str(), nullptr, 0);
+    result.ok = true;
+    hits++;
+    return true;
+}
+
+void CompileCache::store(const string& key, const CompileResult& result, const string& irExtension) {
+    string base = dir + "/" + key;
+
+    // The .s file goes last: once it exists the entry is complete
+    bool written = true;
+    if (!irExtension.empty()) {
+        written = writeAtomically(base + irExtension, result.ir) && writeAtomically(base + "_opt" + irExtension, result.optIR);
+    }
+    if (!written || !writeAtomically(base + ".s", result.assembly)) return;
+
+    stores++;
+    uint64_t size = result.assembly.size() + (irExtension.empty() ? 0 : result.ir.size() + result.optIR.size());
+    if ((approxBytes += size) > maxBytes) evict();
+}
+
+bool CompileCache::writeAtomically(const string& path, const string& contents) {
+    static atomic<unsigned> counter(0);
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d.%zx.%u", (int)getpid(),
+             hash<thread::id>()(this_thread::get_id()), counter++);
+    string tmp = path + suffix;
+
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Drops the least recently used entries until the cache is back under a
+   90% watermark, so a full cache is not rescanned on every store. */
+void CompileCache::evict() {
+    lock_guard<mutex> guard(evictLock);
+
+    struct Entry {
+        time_t lastUse = 0;
+        uint64_t bytes = 0;
+        vector<string> files;
+    };
+    map<string, Entry> entries;
+    uint64_t total = 0;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (dirent* dirEntry = readdir(d)) {
+        string name = dirEntry->d_name;
+        struct stat st;
+        if (name[0] == '.' || name.find(".tmp.") != string::npos) continue;
+        if (stat((dir + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        size_t dot = name.find_first_of("._");
+        Entry& entry = entries[name.substr(0, dot)];
+        entry.files.push_back(name);
+        entry.bytes += st.st_size;
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, ".s") == 0) entry.lastUse = st.st_mtime;
+        total += st.st_size;
+    }
+    closedir(d);
+
+    vector<pair<time_t, string>> byAge;
+    for (const auto& entry : entries) {
+        byAge.push_back(make_pair(entry.second.lastUse, entry.first));
+    }
+    sort(byAge.begin(), byAge.end());
+
+    uint64_t target = maxBytes / 10 * 9;
+    for (const auto& aged : byAge) {
+        if (total <= target) break;
+        const Entry& entry = entries[aged.second];
+        for (const string& file : entry.files) {
+            unlink((dir + "/" + file).c_str());
+        }
+        total -= entry.bytes;
+        evictions++;
+    }
+    approxBytes = total;
+}
+
+void CompileCache::printStats(ostream& out) const {
+    out << "cache: " << hits << " hits, " << misses << " misses, " << stores << " stores, "
+        << evictions << " evictions" << endl;
+}
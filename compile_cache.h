@@ -0,0 +1,39 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+struct CompileResult;
+
+/* A content-addressed cache of compilation results on local disk. Entries
+   are keyed by a hash of the source bytes, the options that affect code
+   generation and the compiler version. Each entry is <key>.s plus, when
+   the IR was asked for, <key>.ll and <key>_opt.ll (or .bc). Files are written under
+   a temporary name and renamed into place, so readers never see a partial
+   entry, and the least recently used entries are evicted once the cache
+   grows past its size limit. Safe to share between threads and processes. */
+class CompileCache {
+   public:
+    CompileCache(const std::string& dir, uint64_t maxBytes);
+
+    static std::string makeKey(const char* data, size_t length, const std::string& options);
+    bool lookup(const std::string& key, const std::string& irExtension, CompileResult& result);
+    void store(const std::string& key, const CompileResult& result, const std::string& irExtension);
+    void printStats(std::ostream& out) const;
+
+   private:
+    bool writeAtomically(const std::string& path, const std::string& contents);
+    void evict();
+
+    std::string dir;
+    uint64_t maxBytes;
+    std::mutex evictLock;
+    std::atomic<uint64_t> approxBytes;
+    std::atomic<uint64_t> hits, misses, stores, evictions;
+};
+
+#endif  // COMPILE_CACHE_H
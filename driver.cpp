@@ -0,0 +1,427 @@
+#include "driver.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "logging.h"
+#include "part1/semantic.h"
+#include "part2/ir_builder.h"
+#include "part4/cycle_estimator.h"
+#include "part4/fast_codegen.h"
+#include "thread_pool.h"
+#include "time_report.h"
+
+using namespace std;
+
+static bool hasExtension(const string& name, const char* extension) {
+    size_t length = strlen(extension);
+    return name.size() > length && name.compare(name.size() - length, length, extension) == 0;
+}
+
+static bool isIRSource(const string& name) {
+    return hasExtension(name, ".ll") || hasExtension(name, ".bc");
+}
+
+static const char* irExtension(IRFormat format) {
+    return format == IRBitcode ? ".bc" : ".ll";
+}
+
+/* Options that change the generated code; they become part of cache keys. */
+string CompileOptions::fingerprint() const {
+    string options = optLevel == 0 ? "O0" : "O1";
+    if (profileGenerate) options += " profile-generate";
+    if (profile) options += " profile-use\n" + profile->toString();
+    return options;
+}
+
+/* Whether the options go together; when not, diagnostics says why. */
+bool CompileOptions::validate(string& diagnostics) const {
+    if (optLevel == 0 && emitIR) {
+        diagnostics += "-O0 does not build LLVM IR; --emit-ll and --emit-bc need -O1\n";
+        return false;
+    }
+    if (optLevel == 0 && (profileGenerate || profile)) {
+        diagnostics += "-O0 has no LLVM backend to instrument or tune; profiles need -O1\n";
+        return false;
+    }
+    return true;
+}
+
+Compiler::Compiler(CompileCache* _cache, const string& _cacheOptions, int _optLevel)
+    : cache(_cache), cacheOptions(_cacheOptions), optLevel(_optLevel), instrument(false) {
+}
+
+/* Code generation follows profile from now on, when it is not NULL, and
+   with instrument set the modules get block counters before codegen. Both
+   only apply to the LLVM path. The caller keeps the profile alive. */
+void Compiler::setProfile(const BlockProfile* profile, bool _instrument) {
+    generator.setProfile(profile);
+    instrument = _instrument;
+}
+
+/* Takes the code generation options, cache key included, for every
+   compilation from now on; the compile server sets them per request. */
+void Compiler::configure(const CompileOptions& options) {
+    cacheOptions = options.fingerprint();
+    optLevel = options.optLevel;
+    profile = options.profile;
+    setProfile(profile.get(), options.profileGenerate);
+}
+
+/* A cache hit skips the whole pipeline; only successful results are stored.
+   Log messages are collected per compilation so parallel compiles do not
+   interleave them. */
+CompileResult Compiler::compile(const string& name, SourceBuffer& source, bool emitIR, IRFormat irFormat) {
+    TimeScope scope("compile");
+    ostringstream log;
+    LogRedirect redirect(log);
+
+    CompileResult result;
+    if (!cache) {
+        result = build(name, source, emitIR, irFormat);
+    } else {
+        // The key is taken over exactly the bytes that get compiled
+        string key = CompileCache::makeKey(source.data(), source.size(), cacheOptions + (isIRSource(name) ? " ir" : ""));
+        string cachedIR = emitIR ? irExtension(irFormat) : "";
+        bool hit;
+        {
+            TimeScope lookupScope("cache lookup");
+            hit = cache->lookup(key, cachedIR, result);
+        }
+        if (hit) {
+            LOG(LogInfo, LogDriver, name << ": cache hit " << key);
+        } else {
+            result = build(name, source, emitIR, irFormat);
+            if (result.ok) {
+                TimeScope storeScope("cache store");
+                cache->store(key, result, cachedIR);
+            }
+        }
+    }
+
+    result.log = log.str();
+    return result;
+}
+
+/* Builds and optimizes the module as compile() does and runs it in the JIT
+   instead of generating assembly. */
+CompileResult Compiler::execute(const string& name, SourceBuffer& source, int arg, JITRunner& jit, RunResult& run) {
+    TimeScope scope("execute");
+    ostringstream log;
+    LogRedirect redirect(log);
+
+    CompileResult result;
+    LLVMModuleRef module = buildModule(name, source, result);
+    if (module) {
+        if (optLevel > 0) {
+            TimeScope scope("optimizer");
+            optimizer.optimize(module);
+        }
+        if (instrument) instrumentBlocks(module);
+        result.ok = jit.run(module, arg, run, result.diagnostics);
+        if (!result.ok) result.diagnostics += name + ": Cannot run.\n";
+        LLVMDisposeModule(module);
+    }
+
+    result.log = log.str();
+    return result;
+}
+
+/* Part 1: the parsed and analyzed AST, which the parser builds in flat
+   form. */
+bool Compiler::buildAST(const string& name, SourceBuffer& source, CompileResult& result, FlatAst& ast) {
+    {
+        TimeScope scope("parse");
+        if (!parseBuffer(source.data(), source.size(), ast, &result.diagnostics)) {
+            result.diagnostics += name + ": Parsing failed.\n";
+            return false;
+        }
+    }
+
+    bool valid;
+    {
+        TimeScope scope("semantic analysis");
+        valid = runSemanticAnalysis(ast, &result.diagnostics);
+    }
+    if (!valid) {
+        result.diagnostics += name + ": Semantic analysis failed.\n";
+        return false;
+    }
+    return true;
+}
+
+/* Parts 1 and 2, or just parsing the IR for .ll and .bc sources. */
+LLVMModuleRef Compiler::buildModule(const string& name, SourceBuffer& source, CompileResult& result) {
+    if (isIRSource(name)) {
+        TimeScope scope("IR reader");
+        LLVMModuleRef module = parseModule(source.data(), source.size(), name.c_str(), optimizer.getContext());
+        if (!module) result.diagnostics += name + ": Cannot read IR.\n";
+        return module;
+    }
+
+    FlatAst ast;
+    if (!buildAST(name, source, result, ast)) return nullptr;
+
+    // Part 2
+    LLVMModuleRef module;
+    {
+        TimeScope scope("IR builder");
+        module = runIRBuilder(ast, optimizer.getContext());
+    }
+    if (!module) result.diagnostics += name + ": IR builder failed.\n";
+    return module;
+}
+
+CompileResult Compiler::build(const string& name, SourceBuffer& source, bool emitIR, IRFormat irFormat) {
+    CompileResult result;
+
+    if (optLevel == 0 && !isIRSource(name)) {
+        FlatAst ast;
+        if (!buildAST(name, source, result, ast)) return result;
+
+        ostringstream assembly;
+        {
+            TimeScope scope("fast code generator");
+            result.ok = runFastCodegen(ast, assembly);
+        }
+        if (!result.ok) result.diagnostics += name + ": Code generation failed.\n";
+        result.assembly = assembly.str();
+        return result;
+    }
+
+    // The module stays in memory from here through codegen
+    LLVMModuleRef module = buildModule(name, source, result);
+    if (!module) return result;
+    if (emitIR) result.ir = serializeModule(module, irFormat);
+
+    // Part 3
+    if (optLevel > 0) {
+        TimeScope scope("optimizer");
+        optimizer.optimize(module);
+    }
+    if (emitIR) result.optIR = serializeModule(module, irFormat);
+    if (instrument) instrumentBlocks(module);
+
+    // Part 4
+    ostringstream assembly;
+    {
+        TimeScope scope("assembly generator");
+        generator.reset(module, assembly);
+        generator.generateAssembly();
+        generator.reset(nullptr, nullptr);
+    }
+    result.assembly = assembly.str();
+
+    LLVMDisposeModule(module);
+    result.ok = true;
+    return result;
+}
+
+BatchCompiler::BatchCompiler(const CompileOptions& _options)
+    : options(_options) {
+    if (!options.cacheDir.empty()) cache.reset(new CompileCache(options.cacheDir, options.cacheBytes));
+
+    int numWorkers = max(1, options.jobs);
+    for (int i = 0; i < numWorkers; i++) {
+        workers.push_back(unique_ptr<Compiler>(new Compiler(cache.get(), options.fingerprint(), options.optLevel)));
+        workers.back()->setProfile(options.profile.get(), options.profileGenerate);
+    }
+}
+
+CompileResult BatchCompiler::compileFile(const string& source, Compiler& compiler) {
+    SourceBuffer contents;
+    bool read;
+    {
+        TimeScope scope("read source");
+        read = readSource(source, contents);
+    }
+    if (!read) {
+        CompileResult result;
+        result.diagnostics = "Cannot open " + source + "\n";
+        return result;
+    }
+
+    CompileResult result = compiler.compile(source, contents, options.emitIR, options.irFormat);
+    if (!result.ok) return result;
+
+    TimeScope scope("write outputs");
+    OutputPaths paths = outputPathsFor(source, options);
+    bool written = options.assemblyFd >= 0 || writeFile(paths.assembly, result.assembly);
+    if (options.emitIR) {
+        // For IR sources the unoptimized IR is the input itself, maybe at the same path
+        if (!isIRSource(source)) written = writeFile(paths.ir, result.ir) && written;
+        written = writeFile(paths.optIR, result.optIR) && written;
+    }
+    if (!written) {
+        result.diagnostics += source + ": Cannot write outputs to " + options.outputDir + "\n";
+        result.ok = false;
+    }
+    return result;
+}
+
+/* Prints what a compilation reported, and the cycle estimate when asked
+   for, and with an assembly fd sends its assembly there. */
+void BatchCompiler::report(const string& source, CompileResult& result) {
+    cerr << result.log << result.diagnostics;
+    if (result.ok && options.cycleReport) {
+        cerr << source << ":\n";
+        runCycleEstimator(result.assembly, cerr);
+    }
+    if (result.ok && options.assemblyFd >= 0 && !writeAll(options.assemblyFd, result.assembly)) {
+        cerr << source << ": Cannot write assembly to fd " << options.assemblyFd << endl;
+        result.ok = false;
+    }
+}
+
+/* Returns the number of files that failed to compile. Diagnostics, and
+   assembly sent to an fd, come out in input order whatever order the files
+   finish in. */
+int BatchCompiler::compileAll(const vector<string>& sources) {
+    vector<CompileResult> results(sources.size());
+    auto start = chrono::steady_clock::now();
+
+    if (workers.size() == 1) {
+        for (size_t i = 0; i < sources.size(); i++) {
+            results[i] = compileFile(sources[i], *workers[0]);
+            report(sources[i], results[i]);
+        }
+    } else {
+        ThreadPool pool(workers.size());
+        for (size_t i = 0; i < sources.size(); i++) {
+            pool.submit([this, &sources, &results, i](int worker) {
+                results[i] = compileFile(sources[i], *workers[worker]);
+            });
+        }
+        pool.wait();
+        for (size_t i = 0; i < sources.size(); i++) {
+            report(sources[i], results[i]);
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    int failures = 0;
+    for (const CompileResult& result : results) {
+        if (!result.ok) failures++;
+    }
+
+    if (sources.size() > 1) {
+        cerr << sources.size() - failures << "/" << sources.size() << " files compiled in "
+             << seconds << " s (" << sources.size() / seconds << " files/s, "
+             << workers.size() << (workers.size() == 1 ? " job" : " jobs") << ")" << endl;
+    }
+    if (cache) cache->printStats(cerr);
+    return failures;
+}
+
+/* Prints what each program returned on stdout, after its own output, and
+   the time it took on stderr. With profile instrumentation each program's
+   block counts go to <stem>.profile. Returns the number of files that failed to
+   build or run. */
+int BatchCompiler::runAll(const vector<string>& sources) {
+    JITRunner jit;
+    Compiler& compiler = *workers[0];
+    int failures = 0;
+    double jitSeconds = 0, runSeconds = 0;
+    auto start = chrono::steady_clock::now();
+
+    for (const string& source : sources) {
+        CompileResult result;
+        RunResult run;
+        SourceBuffer contents;
+        if (!readSource(source, contents)) {
+            result.diagnostics = "Cannot open " + source + "\n";
+        } else {
+            result = compiler.execute(source, contents, options.runArg, jit, run);
+        }
+        cerr << result.log << result.diagnostics;
+        if (!result.ok) {
+            failures++;
+            continue;
+        }
+
+        cout << source << ": returned " << run.value << endl;
+        if (options.profileGenerate) {
+            string profile = outputPathsFor(source, options).profile;
+            if (!BlockProfile(jit.getBlockCounts()).save(profile)) {
+                cerr << source << ": Cannot write " << profile << endl;
+                failures++;
+            }
+        }
+        cerr << source << ": jit " << run.jitSeconds * 1e3 << " ms, run " << run.runSeconds * 1e3 << " ms" << endl;
+        jitSeconds += run.jitSeconds;
+        runSeconds += run.runSeconds;
+    }
+
+    if (sources.size() > 1) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << sources.size() - failures << "/" << sources.size() << " programs ran in " << seconds << " s (jit "
+             << jitSeconds * 1e3 << " ms, run " << runSeconds * 1e3 << " ms)" << endl;
+    }
+    return failures;
+}
+
+/* foo/bar.c -> <outputDir>/bar.ll, bar_opt.ll, bar.s and bar.profile, with .bc for bitcode.
+   Source read from stdin gets the stem "stdin". */
+OutputPaths outputPathsFor(const string& source, const CompileOptions& options) {
+    size_t slash = source.find_last_of('/');
+    string stem = source == "-" ? "stdin" : slash == string::npos ? source : source.substr(slash + 1);
+    size_t dot = stem.find_last_of('.');
+    if (dot != string::npos && dot > 0) stem = stem.substr(0, dot);
+
+    string prefix = options.outputDir.empty() ? stem : options.outputDir + "/" + stem;
+
+    OutputPaths paths;
+    paths.ir = prefix + irExtension(options.irFormat);
+    paths.optIR = prefix + "_opt" + irExtension(options.irFormat);
+    paths.assembly = prefix + ".s";
+    paths.profile = prefix + ".profile";
+    return paths;
+}
+
+/* A manifest lists one source per line; blank lines and lines starting with '#' are skipped. */
+bool readManifest(const char* filename, vector<string>& sources) {
+    ifstream manifest(filename);
+    if (!manifest) {
+        cerr << "Cannot open manifest " << filename << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(manifest, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == string::npos || line[begin] == '#') continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        sources.push_back(line.substr(begin, end - begin + 1));
+    }
+    return true;
+}
+
+/* Maps a source file, or reads stdin for "-". */
+bool readSource(const string& source, SourceBuffer& buffer) {
+    return source == "-" ? buffer.read(STDIN_FILENO) : buffer.map(source.c_str());
+}
+
+/* Writes all of data to fd, which may be a pipe. */
+bool writeAll(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+bool writeFile(const string& filename, const string& contents) {
+    ofstream file(filename, ios::binary);
+    file << contents;
+    return bool(file);
+}
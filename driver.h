@@ -0,0 +1,111 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <llvm-c/Core.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compile_cache.h"
+#include "jit.h"
+#include "part1/flat_ast.h"
+#include "part1/source_buffer.h"
+#include "part3/llvm_parser.h"
+#include "part4/assembly_generator.h"
+#include "part4/block_profile.h"
+
+struct CompileOptions {
+    bool emitIR = false;           // also write the IR before and after optimizing
+    IRFormat irFormat = IRText;    // <stem>.ll and <stem>_opt.ll, or .bc with IRBitcode
+    std::string outputDir = ".";  // where the per-file outputs go
+    int assemblyFd = -1;           // write all assembly here instead of <stem>.s files
+    int jobs = 1;                  // number of worker threads
+    int optLevel = 1;              // 0 generates code straight from the AST
+    bool run = false;              // run func(runArg) in the JIT instead of writing outputs
+    int runArg = 5;
+    bool profileGenerate = false;  // count block executions; --run writes <stem>.profile
+    std::shared_ptr<const BlockProfile> profile;  // block counts to optimize code generation for
+    bool cycleReport = false;      // print the estimated cycles of each block and loop on stderr
+    std::string cacheDir;          // compilation cache, disabled when empty
+    uint64_t cacheBytes = 256 << 20;
+
+    std::string fingerprint() const;
+    bool validate(std::string& diagnostics) const;
+};
+
+struct OutputPaths {
+    std::string ir;        // IR straight from the IR builder
+    std::string optIR;     // IR after the optimizer
+    std::string assembly;  // generated assembly
+    std::string profile;   // block counts of a --profile-generate run
+};
+
+struct CompileResult {
+    bool ok = false;
+    std::string diagnostics;  // everything reported while compiling this file
+    std::string log;          // log messages emitted while compiling this file
+    std::string ir;           // text or bitcode, only when asked for
+    std::string optIR;
+    std::string assembly;
+};
+
+/* The whole pipeline for one thread: an optimizer, whose LLVM context every
+   module is built in, and an assembly generator, both reused from one
+   compilation to the next. Sources ending in .ll or .bc are taken as IR and
+   start at the optimizer. At -O0 miniC sources skip LLVM and go straight
+   from the AST to assembly, and IR sources skip the optimizer. With
+   instrumentation on, the optimized module counts how often its blocks run;
+   a profile from such a run guides code generation. Sources come from
+   memory, where the scanner reads them without copying, and results go back in
+   memory; only a shared cache, when given, touches the disk. */
+class Compiler {
+   public:
+    explicit Compiler(CompileCache* cache = nullptr, const std::string& cacheOptions = "", int optLevel = 1);
+    CompileResult compile(const std::string& name, SourceBuffer& source, bool emitIR, IRFormat irFormat = IRText);
+    CompileResult execute(const std::string& name, SourceBuffer& source, int arg, JITRunner& jit, RunResult& run);
+    void setProfile(const BlockProfile* profile, bool instrument);
+    void configure(const CompileOptions& options);
+
+   private:
+    CompileResult build(const std::string& name, SourceBuffer& source, bool emitIR, IRFormat irFormat);
+    bool buildAST(const std::string& name, SourceBuffer& source, CompileResult& result, FlatAst& ast);
+    LLVMModuleRef buildModule(const std::string& name, SourceBuffer& source, CompileResult& result);
+
+    Optimizer optimizer;
+    AssemblyGenerator generator;
+    CompileCache* cache;
+    std::string cacheOptions;
+    int optLevel;
+    bool instrument;
+    std::shared_ptr<const BlockProfile> profile;  // kept alive for the generator by configure
+};
+
+/* Compiles a list of miniC files in one process. Each worker has its own
+   Compiler; with more than one job the files are spread over a
+   work-stealing thread pool. A source named "-" is read from stdin. With
+   run set the files are run in the JIT one after another, since their
+   print and read share the process's stdout and stdin. */
+class BatchCompiler {
+   public:
+    explicit BatchCompiler(const CompileOptions& options);
+    int compileAll(const std::vector<std::string>& sources);
+    int runAll(const std::vector<std::string>& sources);
+
+   private:
+    CompileResult compileFile(const std::string& source, Compiler& compiler);
+    void report(const std::string& source, CompileResult& result);
+
+    CompileOptions options;
+    std::unique_ptr<CompileCache> cache;
+    std::vector<std::unique_ptr<Compiler>> workers;
+};
+
+OutputPaths outputPathsFor(const std::string& source, const CompileOptions& options);
+bool readManifest(const char* filename, std::vector<std::string>& sources);
+bool readSource(const std::string& source, SourceBuffer& buffer);
+bool writeFile(const std::string& filename, const std::string& contents);
+bool writeAll(int fd, const std::string& data);
+
+#endif  // DRIVER_H
@@ -0,0 +1,143 @@
+#include "jit.h"
+
+#include <llvm-c/Analysis.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Target.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "part3/llvm_parser.h"
+#include "part4/block_profile.h"
+#include "time_report.h"
+
+using namespace std;
+
+static void hostPrint(int x) {
+    printf("%d\n", x);
+}
+
+static int hostRead() {
+    int x = 0;
+    if (scanf("%d", &x) != 1) x = 0;
+    return x;
+}
+
+// Like print and read's stdout and stdin, shared by every runner; programs run one at a time
+static vector<uint64_t> blockCounts;
+
+static void hostCountBlock(int block) {
+    if (block < 0) return;
+    if ((size_t)block >= blockCounts.size()) blockCounts.resize(block + 1);
+    blockCounts[block]++;
+}
+
+JITRunner::JITRunner() : jit(nullptr) {
+    LLVMInitializeNativeTarget();
+    LLVMInitializeNativeAsmPrinter();
+
+    if (!check(LLVMOrcCreateLLJIT(&jit, nullptr), setupError)) {
+        jit = nullptr;
+        return;
+    }
+
+    LLVMJITSymbolFlags flags = {LLVMJITSymbolGenericFlagsExported | LLVMJITSymbolGenericFlagsCallable, 0};
+    LLVMJITCSymbolMapPair hostSymbols[] = {
+        {LLVMOrcLLJITMangleAndIntern(jit, "print"), {(LLVMOrcExecutorAddress)(uintptr_t)&hostPrint, flags}},
+        {LLVMOrcLLJITMangleAndIntern(jit, "read"), {(LLVMOrcExecutorAddress)(uintptr_t)&hostRead, flags}},
+        {LLVMOrcLLJITMangleAndIntern(jit, PROFILE_COUNTER), {(LLVMOrcExecutorAddress)(uintptr_t)&hostCountBlock, flags}},
+    };
+    LLVMOrcMaterializationUnitRef symbols = LLVMOrcAbsoluteSymbols(hostSymbols, 3);
+    if (!check(LLVMOrcJITDylibDefine(LLVMOrcLLJITGetMainJITDylib(jit), symbols), setupError)) {
+        LLVMOrcDisposeMaterializationUnit(symbols);
+    }
+}
+
+JITRunner::~JITRunner() {
+    if (jit) {
+        string ignored;
+        check(LLVMOrcDisposeLLJIT(jit), ignored);
+    }
+}
+
+/* Appends the message of a failed ORC call to diagnostics. */
+bool JITRunner::check(LLVMErrorRef error, string& diagnostics) {
+    if (!error) return true;
+    char* message = LLVMGetErrorMessage(error);
+    diagnostics += string("JIT: ") + message + "\n";
+    LLVMDisposeErrorMessage(message);
+    return false;
+}
+
+/* Calls the module's function with arg. The module stays with the caller:
+   LLJIT only takes modules in a context it owns, so a copy moves over
+   through bitcode, which for miniC programs takes microseconds. */
+bool JITRunner::run(LLVMModuleRef module, int arg, RunResult& result, string& diagnostics) {
+    if (!setupError.empty()) {
+        diagnostics += setupError;
+        return false;
+    }
+
+    char* message = nullptr;
+    if (LLVMVerifyModule(module, LLVMReturnStatusAction, &message)) {
+        diagnostics += string("Invalid module: ") + message;
+        LLVMDisposeMessage(message);
+        return false;
+    }
+    LLVMDisposeMessage(message);
+
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    while (function && LLVMIsDeclaration(function)) function = LLVMGetNextFunction(function);
+    if (!function) {
+        diagnostics += "Nothing to run: the module defines no function\n";
+        return false;
+    }
+    string name = LLVMGetValueName(function);
+    bool takesArg = LLVMCountParams(function) > 0;
+
+    auto start = chrono::steady_clock::now();
+    LLVMOrcThreadSafeContextRef context = LLVMOrcCreateNewThreadSafeContext();
+    string bitcode = serializeModule(module, IRBitcode);
+    LLVMModuleRef copy = parseModule(bitcode.data(), bitcode.size(), name.c_str(), LLVMOrcThreadSafeContextGetContext(context));
+    if (!copy) {
+        LLVMOrcDisposeThreadSafeContext(context);
+        diagnostics += "JIT: cannot copy the module\n";
+        return false;
+    }
+    LLVMOrcThreadSafeModuleRef threadSafeModule = LLVMOrcCreateNewThreadSafeModule(copy, context);
+    LLVMOrcDisposeThreadSafeContext(context);
+
+    LLVMOrcResourceTrackerRef tracker = LLVMOrcJITDylibCreateResourceTracker(LLVMOrcLLJITGetMainJITDylib(jit));
+    LLVMOrcExecutorAddress address = 0;
+    bool ok;
+    {
+        TimeScope scope("JIT compile");
+        ok = check(LLVMOrcLLJITAddLLVMIRModuleWithRT(jit, tracker, threadSafeModule), diagnostics) &&
+             check(LLVMOrcLLJITLookup(jit, &address, name.c_str()), diagnostics);
+    }
+    auto compiled = chrono::steady_clock::now();
+
+    blockCounts.clear();
+    if (ok) {
+        TimeScope scope("JIT run");
+        if (takesArg) {
+            result.value = ((int (*)(int))(uintptr_t)address)(arg);
+        } else {
+            result.value = ((int (*)())(uintptr_t)address)();
+        }
+        fflush(stdout);
+    }
+    auto finished = chrono::steady_clock::now();
+
+    result.jitSeconds = chrono::duration<double>(compiled - start).count();
+    result.runSeconds = chrono::duration<double>(finished - compiled).count();
+
+    ok = check(LLVMOrcResourceTrackerRemove(tracker), diagnostics) && ok;
+    LLVMOrcReleaseResourceTracker(tracker);
+    return ok;
+}
+
+const vector<uint64_t>& JITRunner::getBlockCounts() const {
+    return blockCounts;
+}
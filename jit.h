@@ -0,0 +1,40 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <llvm-c/Core.h>
+#include <llvm-c/LLJIT.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RunResult {
+    int value = 0;          // what the program's function returned
+    double jitSeconds = 0;  // turning the module into machine code
+    double runSeconds = 0;  // the call itself
+};
+
+/* Runs modules in process on ORC's LLJIT instead of assembling and linking
+   them. print and read resolve to host functions that behave like the ones
+   in builder_tests/main.c. Each module is added under its own resource
+   tracker and removed once it ran, so one instance runs a whole corpus.
+   Modules instrumented with block counters count into the host as well;
+   the counts of the last run stay available until the next one. */
+class JITRunner {
+   public:
+    JITRunner();
+    ~JITRunner();
+    JITRunner(const JITRunner&) = delete;
+    JITRunner& operator=(const JITRunner&) = delete;
+
+    bool run(LLVMModuleRef module, int arg, RunResult& result, std::string& diagnostics);
+    const std::vector<uint64_t>& getBlockCounts() const;
+
+   private:
+    bool check(LLVMErrorRef error, std::string& diagnostics);
+
+    LLVMOrcLLJITRef jit;
+    std::string setupError;  // why the JIT could not be created, if it could not
+};
+
+#endif  // JIT_H
@@ -0,0 +1,41 @@
+#ifndef LLVM_PRINT_H
+#define LLVM_PRINT_H
+
+#include <llvm-c/Core.h>
+
+#include <ostream>
+
+/* Stream adapters for LLVM values and modules, mainly for log messages:
+       LOG(LogDebug, LogCSE, printed(inst));
+   The text LLVM allocates for them is freed as soon as it is written. */
+struct PrintedValue {
+    LLVMValueRef value;
+};
+
+struct PrintedModule {
+    LLVMModuleRef module;
+};
+
+inline PrintedValue printed(LLVMValueRef value) {
+    return PrintedValue{value};
+}
+
+inline PrintedModule printed(LLVMModuleRef module) {
+    return PrintedModule{module};
+}
+
+inline std::ostream& operator<<(std::ostream& out, PrintedValue printed) {
+    char* str = LLVMPrintValueToString(printed.value);
+    out << str;
+    LLVMDisposeMessage(str);
+    return out;
+}
+
+inline std::ostream& operator<<(std::ostream& out, PrintedModule printed) {
+    char* str = LLVMPrintModuleToString(printed.module);
+    out << str;
+    LLVMDisposeMessage(str);
+    return out;
+}
+
+#endif  // LLVM_PRINT_H
@@ -0,0 +1,88 @@
+#include "logging.h"
+
+#include <iostream>
+
+using namespace std;
+
+atomic<int> logLevel(LogWarning);
+atomic<unsigned> logCategories(LogAll);
+
+// Where this thread's messages go; stderr when NULL
+static thread_local ostream* logTarget = nullptr;
+
+static const char* LEVEL_NAMES[] = {"error", "warning", "info", "debug", "trace"};
+
+static const struct {
+    const char* name;
+    unsigned category;
+} CATEGORY_NAMES[] = {
+    {"parser", LogParser},     {"semantic", LogSemantic}, {"irbuilder", LogIRBuilder},
+    {"optimizer", LogOptimizer}, {"cse", LogCSE},         {"constfold", LogConstFold},
+    {"dce", LogDCE},           {"constprop", LogConstProp}, {"liveness", LogLiveness},
+    {"regalloc", LogRegAlloc}, {"frame", LogFrame},       {"codegen", LogCodeGen},
+    {"driver", LogDriver},     {"all", LogAll},
+};
+
+/* Writes one message, adding the final newline if it has none. Errors and
+   warnings are prefixed with their level. */
+void writeLog(LogLevel level, unsigned, const string& message) {
+    ostream& out = logTarget ? *logTarget : cerr;
+    if (level <= LogWarning) out << LEVEL_NAMES[level] << ": ";
+    out << message;
+    if (message.empty() || message.back() != '\n') out << '\n';
+}
+
+/* Parses "<level>[:<category>,<category>...]", e.g. "debug:cse,regalloc".
+   Without a category list every category is enabled. */
+bool configureLogging(const string& spec) {
+    size_t colon = spec.find(':');
+    string levelName = spec.substr(0, colon);
+
+    int level = -1;
+    for (int i = 0; i <= LogTrace; i++) {
+        if (levelName == LEVEL_NAMES[i]) level = i;
+    }
+    if (level < 0) {
+        cerr << "Unknown log level '" << levelName << "'" << endl;
+        return false;
+    }
+
+    unsigned categories = LogAll;
+    if (colon != string::npos) {
+        categories = 0;
+        size_t begin = colon + 1;
+        while (begin <= spec.size()) {
+            size_t end = spec.find(',', begin);
+            if (end == string::npos) end = spec.size();
+            string name = spec.substr(begin, end - begin);
+
+            bool found = false;
+            for (const auto& category : CATEGORY_NAMES) {
+                if (name == category.name) {
+                    categories |= category.category;
+                    found = true;
+                }
+            }
+            if (!found) {
+                cerr << "Unknown log category '" << name << "'" << endl;
+                return false;
+            }
+            begin = end + 1;
+        }
+    }
+
+    if (level > MINIC_MAX_LOG_LEVEL) {
+        cerr << "Log level '" << levelName << "' was compiled out of this build" << endl;
+    }
+    logLevel = level;
+    logCategories = categories;
+    return true;
+}
+
+LogRedirect::LogRedirect(ostream& target) : previous(logTarget) {
+    logTarget = &target;
+}
+
+LogRedirect::~LogRedirect() {
+    logTarget = previous;
+}
@@ -0,0 +1,78 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <atomic>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+/*
+Leveled, per-category diagnostic logging:
+
+    LOG(LogDebug, LogConstFold, "folding " << printed(inst));
+
+The message is only formatted when its level and category are enabled at
+run time. Levels above MINIC_MAX_LOG_LEVEL are removed at compile time, so
+building with -DMINIC_MAX_LOG_LEVEL=LogWarning leaves no trace of the debug
+dumps in the binary. Messages go to the calling thread's log target, which
+is stderr unless a LogRedirect is in scope.
+*/
+
+enum LogLevel { LogError, LogWarning, LogInfo, LogDebug, LogTrace };
+
+enum LogCategory : unsigned {
+    LogParser = 1u << 0,     // parsing and the AST
+    LogSemantic = 1u << 1,   // semantic analysis
+    LogIRBuilder = 1u << 2,  // IR construction
+    LogOptimizer = 1u << 3,  // optimizer driver loop
+    LogCSE = 1u << 4,        // commonSubexpressionElimination
+    LogConstFold = 1u << 5,  // constantFolding
+    LogDCE = 1u << 6,        // deadCodeElimination
+    LogConstProp = 1u << 7,  // constantPropagation
+    LogLiveness = 1u << 8,   // computeLiveness
+    LogRegAlloc = 1u << 9,   // regAllocation
+    LogFrame = 1u << 10,     // stack slots and labels
+    LogCodeGen = 1u << 11,   // codeGeneration
+    LogDriver = 1u << 12,    // driver, cache and server
+    LogAll = ~0u
+};
+
+#ifndef MINIC_MAX_LOG_LEVEL
+#define MINIC_MAX_LOG_LEVEL LogTrace
+#endif
+
+extern std::atomic<int> logLevel;
+extern std::atomic<unsigned> logCategories;
+
+inline bool logEnabled(LogLevel level, unsigned category) {
+    return level <= logLevel.load(std::memory_order_relaxed) &&
+           (category & logCategories.load(std::memory_order_relaxed));
+}
+
+#define LOG(level, category, message)                          \
+    do {                                                       \
+        if constexpr ((level) <= MINIC_MAX_LOG_LEVEL) {        \
+            if (logEnabled(level, category)) {                 \
+                std::ostringstream _logMessage;                \
+                _logMessage << message;                        \
+                writeLog(level, category, _logMessage.str());  \
+            }                                                  \
+        }                                                      \
+    } while (0)
+
+void writeLog(LogLevel level, unsigned category, const std::string& message);
+bool configureLogging(const std::string& spec);
+
+/* Sends this thread's log messages to another stream while in scope. */
+class LogRedirect {
+   public:
+    explicit LogRedirect(std::ostream& target);
+    ~LogRedirect();
+    LogRedirect(const LogRedirect&) = delete;
+    LogRedirect& operator=(const LogRedirect&) = delete;
+
+   private:
+    std::ostream* previous;
+};
+
+#endif  // LOGGING_H
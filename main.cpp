@@ -1,40 +1,163 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 
-#include "part1/semantic.h"
-#include "part2/ir_builder.h"
-#include "part3/llvm_parser.h"
-#include "part4/assembly_generator.h"
+#include "driver.h"
+#include "logging.h"
+#include "server.h"
+#include "time_report.h"
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <testfile>.c" << endl;
-        return 1;
+using namespace std;
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-O0|-O1] [--emit-ll|--emit-bc] [--profile-generate|--profile-use <file>] [-j <jobs>] [-o <dir>] [--stdout|--asm-fd <fd>] [--manifest <file>]"
+         << " [--cycle-report] [--cache-dir <dir>] [--cache-size <MB>] [<time report options>] <testfile>.c|.ll|.bc|- ..." << endl;
+    cerr << "       " << prog << " --serve <socket> [-j <jobs>] [--cache-dir <dir>] [--cache-size <MB>]" << endl;
+    cerr << "       " << prog << " --connect <socket> [-O0|-O1] [--emit-ll|--emit-bc] [--profile-generate|--profile-use <file>] [--cycle-report] [-o <dir>] [--stdout|--asm-fd <fd>] [--manifest <file>]"
+         << " <testfile>.c|.ll|.bc|- ..." << endl;
+    cerr << "       " << prog << " --run [--run-arg <n>] [-O0|-O1] [--profile-generate] <testfile>.c|.ll|.bc|- ..." << endl;
+    cerr << "--run runs func(<n>), func(5) by default, in process with the JIT, with print and read on stdout and stdin." << endl;
+    cerr << "-O0 generates code straight from the AST without LLVM; -O1, the default, builds and optimizes LLVM IR." << endl;
+    cerr << "--profile-generate makes programs count their blocks, into <stem>.profile with --run or, linked with"
+         << " part4/profile_runtime.c, into $MINIC_PROFILE or minic.profile; --profile-use lays out code and"
+         << " spills for such a profile." << endl;
+    cerr << "--cycle-report estimates on stderr how many cycles each block and loop of the generated code takes." << endl;
+    cerr << "A source named - is read from stdin; --stdout and --asm-fd send the assembly to a file descriptor instead of <stem>.s." << endl;
+    cerr << "Time report options: --time-report (table on stderr), --time-report-json <file>, --time-trace <file>" << endl;
+    cerr << "Logging: --log <level>[:<category>,...] with level error, warning, info, debug or trace" << endl;
+}
+
+/* Prints and writes whichever reports were asked for. */
+static bool finishTimeReport(TimeReport& report, bool text, const string& jsonFile, const string& traceFile) {
+    report.stop();
+    bool ok = true;
+    if (text) report.printText(cerr);
+    if (!jsonFile.empty()) {
+        ofstream json(jsonFile);
+        report.printJSON(json);
+        if (!json) {
+            cerr << "Cannot write " << jsonFile << endl;
+            ok = false;
+        }
+    }
+    if (!traceFile.empty() && !report.writeTrace(traceFile)) {
+        cerr << "Cannot write " << traceFile << endl;
+        ok = false;
     }
+    return ok;
+}
 
-    char* cFile = argv[1];
+int main(int argc, char** argv) {
+    CompileOptions options;
+    vector<string> sources;
+    string serveSocket, connectSocket;
+    bool timeReportText = false;
+    string timeReportJSON, timeTrace;
 
-    // Part 1
-    if (!runParser(cFile)) {
-        cerr << "Parsing failed." << endl;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit-ll") == 0) {
+            options.emitIR = true;
+            options.irFormat = IRText;
+        } else if (strcmp(argv[i], "--emit-bc") == 0) {
+            options.emitIR = true;
+            options.irFormat = IRBitcode;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0) {
+            options.optLevel = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--run") == 0) {
+            options.run = true;
+        } else if (strcmp(argv[i], "--run-arg") == 0 && i + 1 < argc) {
+            options.run = true;
+            options.runArg = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--profile-generate") == 0) {
+            options.profileGenerate = true;
+        } else if (strcmp(argv[i], "--profile-use") == 0 && i + 1 < argc) {
+            auto profile = make_shared<BlockProfile>();
+            string diagnostics;
+            if (!profile->load(argv[++i], diagnostics)) {
+                cerr << diagnostics;
+                return 1;
+            }
+            options.profile = profile;
+        } else if (strcmp(argv[i], "--cycle-report") == 0) {
+            options.cycleReport = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            options.jobs = atoi(argv[i] + 2);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.outputDir = argv[++i];
+        } else if (strcmp(argv[i], "--stdout") == 0) {
+            options.assemblyFd = STDOUT_FILENO;
+        } else if (strcmp(argv[i], "--asm-fd") == 0 && i + 1 < argc) {
+            options.assemblyFd = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            if (!readManifest(argv[++i], sources)) return 1;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            options.cacheDir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            options.cacheBytes = strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            if (!configureLogging(argv[++i])) return 1;
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            timeReportText = true;
+        } else if (strcmp(argv[i], "--time-report-json") == 0 && i + 1 < argc) {
+            timeReportJSON = argv[++i];
+        } else if (strcmp(argv[i], "--time-trace") == 0 && i + 1 < argc) {
+            timeTrace = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectSocket = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            sources.push_back(argv[i]);
+        }
+    }
+
+    string conflict;
+    if (!options.validate(conflict)) {
+        cerr << conflict;
         return 1;
     }
 
-    if (!runSemanticAnalysis(false)) {
-        cerr << "Semantic analysis failed." << endl;
+    if (options.jobs < 1) {
+        cerr << "-j expects a positive number of jobs" << endl;
         return 1;
     }
 
-    // Part 2
-    if (!runIRBuilder("out.ll")) {
-        cerr << "IR builder failed." << endl;
+    unique_ptr<TimeReport> report;
+    if (timeReportText || !timeReportJSON.empty() || !timeTrace.empty()) {
+        report.reset(new TimeReport(!timeTrace.empty()));
+        report->start();
+    }
+
+    if (!serveSocket.empty()) {
+        bool served = CompileServer(serveSocket, options).run();
+        if (report) served = finishTimeReport(*report, timeReportText, timeReportJSON, timeTrace) && served;
+        LLVMShutdown();
+        return served ? 0 : 1;
+    }
+
+    if (sources.empty()) {
+        usage(argv[0]);
         return 1;
     }
 
-    // Part 3
-    llvm_parse("out.ll", "out_new.ll");
+    if (!connectSocket.empty()) {
+        return runClient(connectSocket, sources, options) == 0 ? 0 : 1;
+    }
+
+    BatchCompiler batch(options);
+    int failures = options.run ? batch.runAll(sources) : batch.compileAll(sources);
+    if (report && !finishTimeReport(*report, timeReportText, timeReportJSON, timeTrace)) failures++;
 
-    // Part 4
-    AssemblyGenerator("out_new.ll", "out_new.s").generateAssembly();
+    LLVMShutdown();
 
-    return 0;
-}
\ No newline at end of file
+    return failures == 0 ? 0 : 1;
+}
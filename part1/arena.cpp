@@ -0,0 +1,76 @@
+#include "arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+using namespace std;
+
+// Blocks start small, since most programs are, and double up to the largest
+static const size_t FIRST_BLOCK_SIZE = 16 * 1024;
+static const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+// Largest blocks of arenas that are gone, for the next ones: fresh memory
+// that size is mapped and page faulted in every time, which costs big trees
+// more than the bump allocation saves. They are freed at exit, so leak
+// checkers do not take them for leaks.
+static const size_t MAX_CACHED_BLOCKS = 64;
+static mutex cacheLock;
+static struct BlockCache : vector<char*> {
+    ~BlockCache() {
+        for (char* block : *this) free(block);
+    }
+} cachedBlocks;
+
+thread_local Arena* Arena::current = nullptr;
+
+Arena::Arena() : cursor(nullptr), limit(nullptr), nextBlockSize(FIRST_BLOCK_SIZE), used(0), reserved(0) {
+}
+
+Arena::~Arena() {
+    lock_guard<mutex> guard(cacheLock);
+    for (const auto& block : blocks) {
+        if (block.second == MAX_BLOCK_SIZE && cachedBlocks.size() < MAX_CACHED_BLOCKS) {
+            cachedBlocks.push_back(block.first);
+        } else {
+            free(block.first);
+        }
+    }
+}
+
+/* Starts a block with room for size bytes at any alignment; what was left
+   of the previous one is wasted. */
+void Arena::grow(size_t size) {
+    size_t blockSize = nextBlockSize;
+    while (blockSize < size + alignof(max_align_t)) blockSize *= 2;
+    if (nextBlockSize < MAX_BLOCK_SIZE) nextBlockSize *= 2;
+
+    char* block = nullptr;
+    if (blockSize == MAX_BLOCK_SIZE) {
+        lock_guard<mutex> guard(cacheLock);
+        if (!cachedBlocks.empty()) {
+            block = cachedBlocks.back();
+            cachedBlocks.pop_back();
+        }
+    }
+    if (!block) block = (char*)malloc(blockSize);
+    if (!block) abort();
+    blocks.push_back({block, blockSize});
+    cursor = block;
+    limit = block + blockSize;
+    reserved += blockSize;
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    uintptr_t aligned = ((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1);
+    if (!cursor || aligned + size > (uintptr_t)limit) {
+        grow(size);
+        aligned = ((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    char* result = (char*)aligned;
+    used += result + size - cursor;
+    cursor = result + size;
+    memset(result, 0, size);
+    return result;
+}
@@ -0,0 +1,56 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/* A bump allocator for one compilation: allocations come zeroed out of
+   ever larger blocks and are only released all at once, with the arena,
+   which keeps the largest blocks for the next arenas. Not thread safe;
+   every compilation has its own. */
+class Arena {
+   public:
+    Arena();
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+
+    /* The arena the create* functions of ast.h allocate from on this
+       thread, NULL when they calloc every node. */
+    static Arena* active() { return current; }
+
+   private:
+    friend class ArenaScope;
+    static thread_local Arena* current;
+
+    void grow(size_t size);
+
+    std::vector<std::pair<char*, size_t>> blocks;  // and their sizes
+    char* cursor;
+    char* limit;
+    size_t nextBlockSize;
+    size_t used;      // handed out, padding included
+    size_t reserved;  // in blocks
+};
+
+/* Makes the arena the active one on this thread until the scope ends:
+       ArenaScope scope(arena);
+       ... createVar(...) ...
+   Scopes nest. */
+class ArenaScope {
+   public:
+    explicit ArenaScope(Arena* arena) : previous(Arena::current) { Arena::current = arena; }
+    ~ArenaScope() { Arena::current = previous; }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+   private:
+    Arena* previous;
+};
+
+#endif  // ARENA_H
@@ -5,46 +5,48 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <string>
+
+#include "arena.h"
+
 /* local helper functions */
-char *get_indent_str(int n) {
-    char *ret = (char *)calloc(n + 1, sizeof(char));
-    for (int i = 0; i < n; i++)
-        ret[i] = ' ';
-    return ret;
+static astNode *newNode() {
+    Arena *arena = Arena::active();
+    if (arena) return (astNode *)arena->allocate(sizeof(astNode));
+    return (astNode *)calloc(1, sizeof(astNode));
 }
 
 /* create and free functions for ast_prog type astNode */
 astNode *createProg(astNode *ext1, astNode *ext2, astNode *func) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_prog;
 
     node->prog.ext1 = ext1;
     node->prog.ext2 = ext2;
     node->prog.func = func;
+    node->prog.arena = Arena::active();
 
     return (node);
 }
 
 void freeProg(astNode *node) {
     assert(node != NULL && node->type == ast_prog);
-
-    freeExtern(node->prog.ext1);
-    freeExtern(node->prog.ext2);
-    freeFunc(node->prog.func);
-
-    free(node);
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for ast_func type astNode */
 astNode *createFunc(const char *name, astNode *param, astNode *body) {
+    return createFunc(internSymbol(name), param, body);
+}
+
+astNode *createFunc(Symbol name, astNode *param, astNode *body) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_func;
 
-    node->func.name = (char *)calloc(1, sizeof(char) * (strlen(name) + 1));
-    strcpy(node->func.name, name);
+    node->func.name = name;
 
     node->func.param = param;
     node->func.body = body;
@@ -54,66 +56,55 @@ astNode *createFunc(const char *name, astNode *param, astNode *body) {
 
 void freeFunc(astNode *node) {
     assert(node != NULL && node->type == ast_func);
-
-    free(node->func.name);
-    if (node->func.param != NULL)
-        freeVar(node->func.param);
-
-    freeBlock(node->func.body);
-
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /*create and free functionns for ast_extern*/
 
 astNode *createExtern(const char *name) {
+    return createExtern(internSymbol(name));
+}
+
+astNode *createExtern(Symbol name) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_extern;
 
-    node->ext.name = (char *)calloc(1, sizeof(char) * (strlen(name) + 1));
-    strcpy(node->ext.name, name);
+    node->ext.name = name;
 
     return (node);
 }
 
 void freeExtern(astNode *node) {
     assert(node != NULL && node->type == ast_extern);
-
-    free(node->ext.name);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for ast_var*/
 
 astNode *createVar(const char *name) {
+    return createVar(internSymbol(name));
+}
+
+astNode *createVar(Symbol name) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_var;
 
-    node->var.name = (char *)calloc(1, sizeof(char) * (strlen(name) + 1));
-    strcpy(node->var.name, name);
+    node->var.name = name;
 
     return (node);
 }
 
 void freeVar(astNode *node) {
     assert(node != NULL && node->type == ast_var);
-
-    free(node->var.name);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for ast_cnst type of node*/
 astNode *createCnst(int value) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_cnst;
 
     node->cnst.value = value;
@@ -122,15 +113,13 @@ astNode *createCnst(int value) {
 
 void freeCnst(astNode *node) {
     assert(node != NULL);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for ast_rexpr type of node*/
 astNode *createRExpr(astNode *lhs, astNode *rhs, rop_type op) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_rexpr;
 
     node->rexpr.lhs = lhs;
@@ -142,19 +131,13 @@ astNode *createRExpr(astNode *lhs, astNode *rhs, rop_type op) {
 
 void freeRExpr(astNode *node) {
     assert(node != NULL && node->type == ast_rexpr);
-
-    // We call freeNode as we don't know the type of nodes for lhs and rhs
-    freeNode(node->rexpr.lhs);
-    freeNode(node->rexpr.rhs);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for ast_bexpr type of node*/
 astNode *createBExpr(astNode *lhs, astNode *rhs, op_type op) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_bexpr;
 
     node->bexpr.lhs = lhs;
@@ -166,20 +149,13 @@ astNode *createBExpr(astNode *lhs, astNode *rhs, op_type op) {
 
 void freeBExpr(astNode *node) {
     assert(node != NULL && node->type == ast_bexpr);
-
-    // We call freeNode as we don't know the type of nodes for rhs and lhs
-    freeNode(node->bexpr.lhs);
-    freeNode(node->bexpr.rhs);
-
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /* create and free functions for ast_uexpr type of node */
 astNode *createUExpr(astNode *expr, op_type op) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_uexpr;
 
     node->uexpr.expr = expr;
@@ -190,22 +166,21 @@ astNode *createUExpr(astNode *expr, op_type op) {
 
 void freeUExpr(astNode *node) {
     assert(node != NULL && node->type == ast_uexpr);
-
-    freeNode(node->uexpr.expr);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /* create and free functions for a statement of type ast_call */
 astNode *createCall(const char *name, astNode *param) {
+    return createCall(internSymbol(name), param);
+}
+
+astNode *createCall(Symbol name, astNode *param) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_call;
 
-    node->stmt.call.name = (char *)calloc(strlen(name) + 1, sizeof(char));
-    strcpy(node->stmt.call.name, name);
+    node->stmt.call.name = name;
 
     node->stmt.call.param = param;
 
@@ -215,19 +190,13 @@ astNode *createCall(const char *name, astNode *param) {
 void freeCall(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_call);
-
-    free(node->stmt.call.name);
-    if (node->stmt.call.param != NULL)
-        freeNode(node->stmt.call.param);
-
-    free(node);
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for a stmt of type ast_ret*/
 astNode *createRet(astNode *expr) {
     astNode *node;
-    node = (astNode *)calloc(1, sizeof(astNode));
+    node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_ret;
 
@@ -238,20 +207,27 @@ astNode *createRet(astNode *expr) {
 void freeRet(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_ret);
-
-    freeNode(node->stmt.ret.expr);
-    free(node);
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for a stmt of type ast_block*/
 astNode *createBlock(vector<astNode *> *stmt_list) {
-    vector<astNode *> slist;
-    astNode *node = (astNode *)calloc(1, sizeof(astNode));
+    astNode *node = createBlock(stmt_list->data(), stmt_list->size());
+    delete stmt_list;
+    return node;
+}
+
+astNode *createBlock(astNode **stmts, size_t count) {
+    astNode *node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_block;
 
-    node->stmt.block.stmt_list = stmt_list;
+    Arena *arena = Arena::active();
+    size_t size = count * sizeof(astNode *);
+    astNode **items = (astNode **)(arena ? arena->allocate(size) : malloc(size));
+    if (count > 0) memcpy(items, stmts, size);
+    node->stmt.block.stmt_list.items = items;
+    node->stmt.block.stmt_list.count = count;
 
     return (node);
 }
@@ -259,23 +235,12 @@ astNode *createBlock(vector<astNode *> *stmt_list) {
 void freeBlock(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_block);
-
-    vector<astNode *> slist = *(node->stmt.block.stmt_list);
-    vector<astNode *>::iterator it = slist.begin();
-
-    while (it != slist.end()) {
-        freeNode(*it);
-        it++;
-    }
-
-    delete (node->stmt.block.stmt_list);
-    free(node);
-    return;
+    freeNode(node);
 }
 
 /* create and free functions for stmt of type while*/
 astNode *createWhile(astNode *cond, astNode *body) {
-    astNode *node = (astNode *)calloc(1, sizeof(astNode));
+    astNode *node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_while;
 
@@ -288,17 +253,12 @@ astNode *createWhile(astNode *cond, astNode *body) {
 void freeWhile(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_while);
-
-    freeNode(node->stmt.whilen.cond);
-    freeNode(node->stmt.whilen.body);
-
-    free(node);
-    return;
+    freeNode(node);
 }
 
 /*create and free functions for stmt of type if*/
 astNode *createIf(astNode *cond, astNode *ifbody, astNode *elsebody) {
-    astNode *node = (astNode *)calloc(1, sizeof(astNode));
+    astNode *node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_if;
 
@@ -312,25 +272,20 @@ astNode *createIf(astNode *cond, astNode *ifbody, astNode *elsebody) {
 void freeIf(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_if);
-
-    freeNode(node->stmt.ifn.cond);
-    freeNode(node->stmt.ifn.if_body);
-    if (node->stmt.ifn.else_body != NULL)
-        freeNode(node->stmt.ifn.else_body);
-
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
 /* create and free functions of stmt type ast_decl */
 astNode *createDecl(const char *name) {
-    astNode *node = (astNode *)calloc(1, sizeof(astNode));
+    return createDecl(internSymbol(name));
+}
+
+astNode *createDecl(Symbol name) {
+    astNode *node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_decl;
 
-    node->stmt.decl.name = (char *)calloc(strlen(name) + 1, sizeof(char));
-    strcpy(node->stmt.decl.name, name);
+    node->stmt.decl.name = name;
 
     return (node);
 }
@@ -338,14 +293,12 @@ astNode *createDecl(const char *name) {
 void freeDecl(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_decl);
-
-    free(node->stmt.decl.name);
-    free(node);
+    freeNode(node);
 }
 
 /* create and free functions of stmt type ast_assign */
 astNode *createAsgn(astNode *lhs, astNode *rhs) {
-    astNode *node = (astNode *)calloc(1, sizeof(astNode));
+    astNode *node = newNode();
     node->type = ast_stmt;
     node->stmt.type = ast_asgn;
 
@@ -358,56 +311,80 @@ astNode *createAsgn(astNode *lhs, astNode *rhs) {
 void freeAsgn(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
     assert(node->stmt.type == ast_asgn);
-
-    freeVar(node->stmt.asgn.lhs);
-    freeNode(node->stmt.asgn.rhs);
-    free(node);
-
-    return;
+    freeNode(node);
 }
 
-/* free function for releasing all the memory assigned to a node based
-on the type. This function is called by other free* functions when
-the type of a child node is not obvious from the context */
-
-void freeNode(astNode *node) {
-    assert(node != NULL);
+/* Frees the node and hands its children to pending, so that freeNode
+   takes a tree of any depth apart without recursing. */
+static void releaseNode(astNode *node, vector<astNode *> &pending) {
+    auto later = [&pending](astNode *child) {
+        if (child != NULL) pending.push_back(child);
+    };
 
     switch (node->type) {
         case ast_prog: {
-            freeProg(node);
+            later(node->prog.ext1);
+            later(node->prog.ext2);
+            later(node->prog.func);
             break;
         }
         case ast_func: {
-            freeFunc(node);
+            later(node->func.param);
+            later(node->func.body);
             break;
         }
         case ast_stmt: {
-            freeStmt(node);
-            break;
-        }
-        case ast_extern: {
-            freeExtern(node);
-            break;
-        }
-        case ast_var: {
-            freeVar(node);
+            switch (node->stmt.type) {
+                case ast_call:
+                    later(node->stmt.call.param);
+                    break;
+                case ast_ret:
+                    later(node->stmt.ret.expr);
+                    break;
+                case ast_block:
+                    for (astNode *stmt : node->stmt.block.stmt_list) {
+                        later(stmt);
+                    }
+                    free(node->stmt.block.stmt_list.items);
+                    break;
+                case ast_while:
+                    later(node->stmt.whilen.cond);
+                    later(node->stmt.whilen.body);
+                    break;
+                case ast_if:
+                    later(node->stmt.ifn.cond);
+                    later(node->stmt.ifn.if_body);
+                    later(node->stmt.ifn.else_body);
+                    break;
+                case ast_asgn:
+                    later(node->stmt.asgn.lhs);
+                    later(node->stmt.asgn.rhs);
+                    break;
+                case ast_decl:
+                    break;
+                default: {
+                    fprintf(stderr, "Incorrect node type\n");
+                    exit(1);
+                }
+            }
             break;
         }
-        case ast_cnst: {
-            freeCnst(node);
+        case ast_extern:
+        case ast_var:
+        case ast_cnst:
             break;
-        }
         case ast_rexpr: {
-            freeRExpr(node);
+            later(node->rexpr.lhs);
+            later(node->rexpr.rhs);
             break;
         }
         case ast_bexpr: {
-            freeBExpr(node);
+            later(node->bexpr.lhs);
+            later(node->bexpr.rhs);
             break;
         }
         case ast_uexpr: {
-            freeUExpr(node);
+            later(node->uexpr.expr);
             break;
         }
         default: {
@@ -415,93 +392,105 @@ void freeNode(astNode *node) {
             exit(1);
         }
     }
+    free(node);
+}
+
+/* free function for releasing all the memory assigned to a node and
+everything under it, whatever the type. All the other free* functions
+come here. */
+
+void freeNode(astNode *node) {
+    assert(node != NULL);
+
+    // The root is in the arena too, so this frees it along with the rest
+    if (node->type == ast_prog && node->prog.arena) {
+        delete node->prog.arena;
+        return;
+    }
+
+    vector<astNode *> pending(1, node);
+    while (!pending.empty()) {
+        astNode *next = pending.back();
+        pending.pop_back();
+        releaseNode(next, pending);
+    }
 }
 
 /* free function to stmt. To be called when stmt type is not obvious
 from the context */
 void freeStmt(astNode *node) {
     assert(node != NULL && node->type == ast_stmt);
+    freeNode(node);
+}
 
-    switch (node->stmt.type) {
-        case ast_call:
-            freeCall(node);
-            break;
-        case ast_ret:
-            freeRet(node);
-            break;
-        case ast_block:
-            freeBlock(node);
-            break;
-        case ast_while:
-            freeWhile(node);
-            break;
-        case ast_if:
-            freeIf(node);
-            break;
-        case ast_asgn:
-            freeAsgn(node);
-            break;
-        case ast_decl:
-            freeDecl(node);
-            break;
-        default: {
-            fprintf(stderr, "Incorrect node type\n");
-            exit(1);
-        };
+void printIndent(ostream &out, int n) {
+    static const string spaces(4096, ' ');
+    for (; n > 0; n -= (int)spaces.size()) {
+        out.write(spaces.data(), min(n, (int)spaces.size()));
     }
 }
 
-void printNode(astNode *node, int n) {
-    assert(node != NULL);
-    char *indent = get_indent_str(n);
+/* What printNode has left to print, the next item last: a node, a
+   statement or a line of text, each at its indentation. */
+struct PrintItem {
+    const astNode *node;
+    const astStmt *stmt;
+    const char *text;
+    int indent;
+};
+
+/* Prints the node's own line and queues what goes under it. */
+static void printOne(const astNode *node, int n, vector<PrintItem> &pending, ostream &out) {
+    auto later = [&pending](const astNode *child, int indent) {
+        pending.push_back({child, NULL, NULL, indent});
+    };
 
+    printIndent(out, n);
     switch (node->type) {
         case ast_prog: {
-            printf("%sProg:\n", indent);
-            printNode(node->prog.func, n + 1);
+            out << "Prog:\n";
+            later(node->prog.func, n + 1);
             break;
         }
         case ast_func: {
-            printf("%sFunc: %s\n", indent, node->func.name);
+            out << "Func: " << symbolName(node->func.name) << "\n";
+            later(node->func.body, n + 1);
             if (node->func.param != NULL)
-                printNode(node->func.param, n + 1);
-
-            printNode(node->func.body, n + 1);
+                later(node->func.param, n + 1);
             break;
         }
         case ast_stmt: {
-            printf("%sStmt: \n", indent);
-            astStmt stmt = node->stmt;
-            printStmt(&stmt, n + 1);
+            out << "Stmt: \n";
+            pending.push_back({NULL, &node->stmt, NULL, n + 1});
             break;
         }
         case ast_extern: {
-            printf("%sExtern: %s\n", indent, node->ext.name);
+            out << "Extern: " << symbolName(node->ext.name) << "\n";
             break;
         }
         case ast_var: {
-            printf("%sVar: %s\n", indent, node->var.name);
+            out << "Var: " << symbolName(node->var.name) << "\n";
             break;
         }
         case ast_cnst: {
-            printf("%sConst: %d\n", indent, node->cnst.value);
+            out << "Const: " << node->cnst.value << "\n";
             break;
         }
         case ast_rexpr: {
-            printf("%sRExpr: \n", indent);
-            printNode(node->rexpr.lhs, n + 1);
-            printNode(node->rexpr.rhs, n + 1);
+            out << "RExpr: \n";
+            later(node->rexpr.rhs, n + 1);
+            later(node->rexpr.lhs, n + 1);
             break;
         }
         case ast_bexpr: {
-            printf("%sBExpr: \n", indent);
-            printNode(node->bexpr.lhs, n + 1);
-            printNode(node->bexpr.rhs, n + 1);
+            out << "BExpr: \n";
+            later(node->bexpr.rhs, n + 1);
+            later(node->bexpr.lhs, n + 1);
             break;
         }
         case ast_uexpr: {
-            printf("%sUExpr: \n", indent);
-            printNode(node->uexpr.expr, n + 1);
+            out << "UExpr: \n";
+            later(node->uexpr.expr, n + 1);
             break;
         }
         default: {
@@ -509,64 +498,66 @@ void printNode(astNode *node, int n) {
             exit(1);
         }
     }
-    free(indent);
 }
 
-void printStmt(astStmt *stmt, int n) {
-    assert(stmt != NULL);
-    char *indent = get_indent_str(n);
+static void printOne(const astStmt *stmt, int n, vector<PrintItem> &pending, ostream &out) {
+    auto later = [&pending](const astNode *child, int indent) {
+        pending.push_back({child, NULL, NULL, indent});
+    };
+    auto text = [&pending](const char *line, int indent) {
+        pending.push_back({NULL, NULL, line, indent});
+    };
 
+    printIndent(out, n);
     switch (stmt->type) {
         case ast_call: {
-            printf("%sCall: name %s\n", indent, stmt->call.name);
+            out << "Call: name " << symbolName(stmt->call.name) << "\n";
             if (stmt->call.param != NULL) {
-                printf("%sCall: param\n", indent);
-                printNode(stmt->call.param, n + 1);
+                later(stmt->call.param, n + 1);
+                text("Call: param\n", n);
             }
             break;
         }
         case ast_ret: {
-            printf("%sRet:\n", indent);
-            printNode(stmt->ret.expr, n + 1);
+            out << "Ret:\n";
+            later(stmt->ret.expr, n + 1);
             break;
         }
         case ast_block: {
-            printf("%sBlock:\n", indent);
-            vector<astNode *> slist = *(stmt->block.stmt_list);
-            vector<astNode *>::iterator it = slist.begin();
-            while (it != slist.end()) {
-                printNode(*it, n + 1);
-                it++;
+            out << "Block:\n";
+            const astList &stmts = stmt->block.stmt_list;
+            for (size_t i = stmts.count; i > 0; i--) {
+                later(stmts.items[i - 1], n + 1);
             }
             break;
         }
         case ast_while: {
-            printf("%sWhile: cond \n", indent);
-            printNode(stmt->whilen.cond, n + 1);
-            printf("%sWhile: body \n", indent);
-            printNode(stmt->whilen.body, n + 1);
+            out << "While: cond \n";
+            later(stmt->whilen.body, n + 1);
+            text("While: body \n", n);
+            later(stmt->whilen.cond, n + 1);
             break;
         }
         case ast_if: {
-            printf("%sIf: cond\n", indent);
-            printNode(stmt->ifn.cond, n + 1);
-            printf("%sIf: body\n", indent);
-            printNode(stmt->ifn.if_body, n + 1);
+            out << "If: cond\n";
             if (stmt->ifn.else_body != NULL) {
-                printf("%sElse: body\n", indent);
-                printNode(stmt->ifn.else_body, n + 1);
+                later(stmt->ifn.else_body, n + 1);
+                text("Else: body\n", n);
             }
+            later(stmt->ifn.if_body, n + 1);
+            text("If: body\n", n);
+            later(stmt->ifn.cond, n + 1);
             break;
         }
         case ast_asgn: {
-            printf("%sAsgn: lhs\n", indent);
-            printNode(stmt->asgn.lhs, n + 1);
-            printf("%sAsgn: rhs\n", indent);
-            printNode(stmt->asgn.rhs, n + 1);
+            out << "Asgn: lhs\n";
+            later(stmt->asgn.rhs, n + 1);
+            text("Asgn: rhs\n", n);
+            later(stmt->asgn.lhs, n + 1);
             break;
         }
         case ast_decl: {
-            printf("%sDecl: %s\n", indent, stmt->decl.name);
+            out << "Decl: " << symbolName(stmt->decl.name) << "\n";
             break;
         }
         default: {
@@ -574,5 +565,38 @@ void printStmt(astStmt *stmt, int n) {
             exit(1);
         }
     }
-    free(indent);
+}
+
+/* Works through the items, children queued in reverse so they come out
+   in order; the tree's depth only grows the vector. */
+static void printItems(vector<PrintItem> &pending, ostream &out) {
+    while (!pending.empty()) {
+        PrintItem item = pending.back();
+        pending.pop_back();
+        if (item.text) {
+            printIndent(out, item.indent);
+            out << item.text;
+        } else if (item.stmt) {
+            printOne(item.stmt, item.indent, pending, out);
+        } else {
+            printOne(item.node, item.indent, pending, out);
+        }
+    }
+}
+
+void printNode(astNode *node, int n, ostream &out) {
+    assert(node != NULL);
+    vector<PrintItem> pending(1, {node, NULL, NULL, n});
+    printItems(pending, out);
+}
+
+void printStmt(astStmt *stmt, int n, ostream &out) {
+    assert(stmt != NULL);
+    vector<PrintItem> pending(1, {NULL, stmt, NULL, n});
+    printItems(pending, out);
+}
+
+ostream &operator<<(ostream &out, const astNode &node) {
+    printNode(const_cast<astNode *>(&node), 0, out);
+    return out;
 }
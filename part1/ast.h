@@ -2,7 +2,10 @@
 #define AST_H
 
 #include <cstddef>
+#include <iostream>
 #include <vector>
+
+#include "symbols.h"
 using namespace std;
 
 struct ast_Node;
@@ -11,6 +14,8 @@ typedef struct ast_Node astNode;
 struct ast_Stmt;
 typedef struct ast_Stmt astStmt;
 
+class Arena;
+
 // enum to identify node type
 typedef enum {
     ast_prog,
@@ -59,20 +64,21 @@ typedef struct {
     astNode* ext1;  // extern function print
     astNode* ext2;  // extern function read
     astNode* func;  // function defined in input miniC program
+    Arena* arena;   // the whole tree is in it when not NULL, see arena.h
 } astProg;
 
 typedef struct {
-    char* name;      // name of the function
+    Symbol name;     // name of the function
     astNode* param;  // parameter, possibly NULL if the function doesn't take a param
     astNode* body;   // function body
 } astFunc;
 
 typedef struct {
-    char* name;  // For extern functions defined we will only save function names
+    Symbol name;  // For extern functions defined we will only save function names
 } astExtern;
 
 typedef struct {
-    char* name;
+    Symbol name;
 } astVar;
 
 typedef struct {
@@ -98,7 +104,7 @@ typedef struct {
 
 /* structs for different statement types */
 typedef struct {
-    char* name;
+    Symbol name;
     astNode* param;  // For read function this field will be NULL
 } astCall;
 
@@ -106,8 +112,18 @@ typedef struct {
     astNode* expr;  // Can be an expression/variable/constant
 } astRet;
 
+/* The statements of a block, declarations first. The array is in the
+   tree's arena, or malloc'd when it has none. */
+typedef struct {
+    astNode** items;
+    size_t count;
+
+    astNode** begin() const { return items; }
+    astNode** end() const { return items + count; }
+} astList;
+
 typedef struct {
-    vector<astNode*>* stmt_list;
+    astList stmt_list;
 } astBlock;
 
 typedef struct {
@@ -122,7 +138,7 @@ typedef struct {
 } astIf;
 
 typedef struct {
-    char* name;
+    Symbol name;
 } astDecl;
 
 typedef struct {
@@ -161,6 +177,8 @@ struct ast_Node {
 /*
 Declarations of create* functions for all the types of nodes
 defined above. All the create* functions return a astNode*.
+They allocate from the active arena, see arena.h, and calloc
+every node when there is none.
 */
 
 astNode* createProg(astNode* extern1, astNode* extern2, astNode* func);
@@ -181,15 +199,28 @@ a astNode*.
 
 astNode* createCall(const char* name, astNode* param = NULL);
 astNode* createRet(astNode* expr);
-astNode* createBlock(vector<astNode*>* stmt_list);
+astNode* createBlock(vector<astNode*>* stmt_list);  // takes the vector and deletes it
+astNode* createBlock(astNode** stmts, size_t count);  // copies the statements
 astNode* createWhile(astNode* cond, astNode* body);
 astNode* createIf(astNode* cond, astNode* if_body, astNode* else_body = NULL);
 astNode* createDecl(const char* decl);
 astNode* createAsgn(astNode* lhs, astNode* rhs);
 
+/*
+The same for names already interned, such as the identifiers the scanner
+returns. The ones above intern their names.
+*/
+
+astNode* createFunc(Symbol name, astNode* param, astNode* body);
+astNode* createExtern(Symbol name);
+astNode* createVar(Symbol name);
+astNode* createCall(Symbol name, astNode* param);
+astNode* createDecl(Symbol name);
+
 /*
 Declarations for all free* functions. All these functions take a astNode* as parameter
-as free the memory allocated by corresponding create functions.
+as free the memory allocated by corresponding create functions. A tree built in an
+arena is only freed whole, by freeNode or freeProg on its root, which deletes the arena.
 */
 
 void freeProg(astNode*);
@@ -210,15 +241,23 @@ void freeIf(astNode*);
 void freeDecl(astNode*);
 void freeAsgn(astNode*);
 
-/* freeNode checks the node type and calls the corresponding free* function.*/
+/* freeNode frees the node and everything under it, whatever the type. It keeps the
+   nodes still to free in a vector rather than recursing, so trees of any depth can go.*/
 void freeNode(astNode*);
 
-/* freeStmt checks the stmt type and calls the corresponding free* function.*/
+/* freeStmt does the same for a statement.*/
 void freeStmt(astNode*);
 
-/* Function to print astNode and astStmt. The second parameter is to beautify the output.*/
+/* Function to print astNode and astStmt. The second parameter is to beautify the output.
+   Like freeNode they do not recurse.*/
+
+void printNode(astNode*, int indent = 0, ostream& out = cout);
+void printStmt(astStmt*, int indent = 0, ostream& out = cout);
+
+/* Writes the indentation of a line printNode prints at the given depth. */
+void printIndent(ostream& out, int indent);
 
-void printNode(astNode*, int indent = 0);
-void printStmt(astStmt*, int indent = 0);
+/* Prints the whole tree, so it can be streamed into a log message. */
+ostream& operator<<(ostream& out, const astNode& node);
 
 #endif
@@ -0,0 +1,450 @@
+#include "flat_ast.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "arena.h"
+
+using namespace std;
+
+/* Lists the children of a tree node that are there, in source order. */
+static void childrenOf(const astNode* node, vector<const astNode*>& children) {
+    auto child = [&children](const astNode* c) {
+        if (c) children.push_back(c);
+    };
+
+    children.clear();
+    switch (node->type) {
+        case ast_prog:
+            child(node->prog.ext1);
+            child(node->prog.ext2);
+            child(node->prog.func);
+            break;
+        case ast_func:
+            child(node->func.param);
+            child(node->func.body);
+            break;
+        case ast_rexpr:
+            child(node->rexpr.lhs);
+            child(node->rexpr.rhs);
+            break;
+        case ast_bexpr:
+            child(node->bexpr.lhs);
+            child(node->bexpr.rhs);
+            break;
+        case ast_uexpr:
+            child(node->uexpr.expr);
+            break;
+        case ast_stmt:
+            switch (node->stmt.type) {
+                case ast_call:
+                    child(node->stmt.call.param);
+                    break;
+                case ast_ret:
+                    child(node->stmt.ret.expr);
+                    break;
+                case ast_block:
+                    for (const astNode* stmt : node->stmt.block.stmt_list) child(stmt);
+                    break;
+                case ast_while:
+                    child(node->stmt.whilen.cond);
+                    child(node->stmt.whilen.body);
+                    break;
+                case ast_if:
+                    child(node->stmt.ifn.cond);
+                    child(node->stmt.ifn.if_body);
+                    child(node->stmt.ifn.else_body);
+                    break;
+                case ast_asgn:
+                    child(node->stmt.asgn.lhs);
+                    child(node->stmt.asgn.rhs);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Adds the node whose children were added last, their indices at the end
+   of done, and replaces those with its own. */
+static void addNode(FlatAstBuilder& builder, const astNode* node, size_t childCount, vector<int32_t>& done) {
+    const int32_t* ids = done.data() + done.size() - childCount;
+    size_t next = 0;
+    auto take = [&](const astNode* child) { return child ? ids[next++] : FlatAst::NO_NODE; };
+
+    int32_t index;
+    switch (node->type) {
+        case ast_prog: {
+            int32_t ext1 = take(node->prog.ext1);
+            int32_t ext2 = take(node->prog.ext2);
+            index = builder.add(flat_prog, 0, take(node->prog.func), ext1, ext2);
+            break;
+        }
+        case ast_func: {
+            int32_t param = take(node->func.param);
+            index = builder.add(flat_func, node->func.name, param, take(node->func.body));
+            break;
+        }
+        case ast_extern:
+            index = builder.add(flat_extern, node->ext.name);
+            break;
+        case ast_var:
+            index = builder.add(flat_var, node->var.name);
+            break;
+        case ast_cnst:
+            index = builder.add(flat_cnst, node->cnst.value);
+            break;
+        case ast_rexpr: {
+            int32_t lhs = take(node->rexpr.lhs);
+            index = builder.add(flat_rexpr, node->rexpr.op, lhs, take(node->rexpr.rhs));
+            break;
+        }
+        case ast_bexpr: {
+            int32_t lhs = take(node->bexpr.lhs);
+            index = builder.add(flat_bexpr, node->bexpr.op, lhs, take(node->bexpr.rhs));
+            break;
+        }
+        case ast_uexpr:
+            index = builder.add(flat_uexpr, node->uexpr.op, take(node->uexpr.expr));
+            break;
+        case ast_stmt:
+            switch (node->stmt.type) {
+                case ast_call:
+                    index = builder.add(flat_call, node->stmt.call.name, take(node->stmt.call.param));
+                    break;
+                case ast_ret:
+                    index = builder.add(flat_ret, 0, take(node->stmt.ret.expr));
+                    break;
+                case ast_block:
+                    index = builder.addBlock(ids, childCount);
+                    break;
+                case ast_while: {
+                    int32_t cond = take(node->stmt.whilen.cond);
+                    index = builder.add(flat_while, 0, cond, take(node->stmt.whilen.body));
+                    break;
+                }
+                case ast_if: {
+                    int32_t cond = take(node->stmt.ifn.cond);
+                    int32_t ifBody = take(node->stmt.ifn.if_body);
+                    index = builder.add(flat_if, 0, cond, ifBody, take(node->stmt.ifn.else_body));
+                    break;
+                }
+                case ast_asgn: {
+                    int32_t lhs = take(node->stmt.asgn.lhs);
+                    index = builder.add(flat_asgn, 0, lhs, take(node->stmt.asgn.rhs));
+                    break;
+                }
+                case ast_decl:
+                    index = builder.add(flat_decl, node->stmt.decl.name);
+                    break;
+                default: {
+                    fprintf(stderr, "Incorrect node type\n");
+                    exit(1);
+                }
+            }
+            break;
+        default: {
+            fprintf(stderr, "Incorrect node type\n");
+            exit(1);
+        }
+    }
+    done.resize(done.size() - childCount);
+    done.push_back(index);
+}
+
+/* The tree's nodes in the order the parser would have added them: a node
+   is added once its children are, which a stack of nodes, each visited
+   twice, gets without recursing, whatever the depth. */
+FlatAst::FlatAst(const astNode* root) {
+    assert(root != NULL && root->type == ast_prog);
+
+    FlatAstBuilder builder(*this);
+    // Every node of a tree in an arena takes at least sizeof(astNode) of it
+    if (root->prog.arena) builder.reserve(root->prog.arena->bytesUsed() / sizeof(astNode));
+
+    struct Visit {
+        const astNode* node;
+        int32_t children;  // how many were queued, or NOT_QUEUED the first time
+    };
+    const int32_t NOT_QUEUED = -1;
+    vector<Visit> pending(1, {root, NOT_QUEUED});
+    vector<int32_t> done;  // nodes added whose parent is not yet
+    vector<const astNode*> children;
+    while (!pending.empty()) {
+        Visit next = pending.back();
+        pending.pop_back();
+        if (next.children != NOT_QUEUED) {
+            addNode(builder, next.node, next.children, done);
+            continue;
+        }
+        childrenOf(next.node, children);
+        pending.push_back({next.node, (int32_t)children.size()});
+        for (size_t i = children.size(); i > 0; i--) {
+            pending.push_back({children[i - 1], NOT_QUEUED});
+        }
+    }
+}
+
+size_t FlatAst::bytes() const {
+    return kinds.capacity() * sizeof(flat_kind) +
+           (payload.capacity() + first.capacity() + second.capacity() + third.capacity() + lists.capacity()) *
+               sizeof(int32_t);
+}
+
+void FlatAstBuilder::reserve(size_t nodes) {
+    ast.kinds.reserve(nodes);
+    ast.payload.reserve(nodes);
+    ast.first.reserve(nodes);
+    ast.second.reserve(nodes);
+    ast.third.reserve(nodes);
+}
+
+int32_t FlatAstBuilder::add(flat_kind kind, int32_t value, int32_t first, int32_t second, int32_t third) {
+    ast.kinds.push_back(kind);
+    ast.payload.push_back(value);
+    ast.first.push_back(first);
+    ast.second.push_back(second);
+    ast.third.push_back(third);
+    return ast.size() - 1;
+}
+
+int32_t FlatAstBuilder::addBlock(const int32_t* statements, size_t count) {
+    int32_t start = (int32_t)ast.lists.size();
+    ast.lists.insert(ast.lists.end(), statements, statements + count);
+    return add(flat_block, 0, start, (int32_t)count);
+}
+
+/* The pointer tree of the same program, in an arena of its own that
+   freeNode on the root releases. Going through the nodes in order builds
+   every child before its parent. */
+astNode* FlatAst::toTree() const {
+    if (empty()) return nullptr;
+
+    vector<astNode*> built(size(), nullptr);
+    auto child = [&built](int32_t node) { return node == NO_NODE ? nullptr : built[node]; };
+    vector<astNode*> items;
+    Arena* arena = new Arena();
+    ArenaScope scope(arena);
+    for (int32_t node = 0; node < size(); node++) {
+        astNode* result;
+        switch (kinds[node]) {
+            case flat_prog:
+                result = createProg(child(second[node]), child(third[node]), child(first[node]));
+                break;
+            case flat_func:
+                result = createFunc(name(node), child(param(node)), child(body(node)));
+                break;
+            case flat_extern:
+                result = createExtern(name(node));
+                break;
+            case flat_var:
+                result = createVar(name(node));
+                break;
+            case flat_cnst:
+                result = createCnst(value(node));
+                break;
+            case flat_rexpr:
+                result = createRExpr(child(lhs(node)), child(rhs(node)), (rop_type)op(node));
+                break;
+            case flat_bexpr:
+                result = createBExpr(child(lhs(node)), child(rhs(node)), (op_type)op(node));
+                break;
+            case flat_uexpr:
+                result = createUExpr(child(expr(node)), (op_type)op(node));
+                break;
+            case flat_call:
+                result = createCall(name(node), child(param(node)));
+                break;
+            case flat_ret:
+                result = createRet(child(expr(node)));
+                break;
+            case flat_block:
+                items.clear();
+                for (int32_t stmt : statements(node)) items.push_back(built[stmt]);
+                result = createBlock(items.data(), items.size());
+                break;
+            case flat_while:
+                result = createWhile(child(cond(node)), child(body(node)));
+                break;
+            case flat_if:
+                result = createIf(child(cond(node)), child(body(node)), child(elseBody(node)));
+                break;
+            case flat_asgn:
+                result = createAsgn(child(lhs(node)), child(rhs(node)));
+                break;
+            case flat_decl:
+                result = createDecl(name(node));
+                break;
+            default: {
+                fprintf(stderr, "Incorrect node type\n");
+                exit(1);
+            }
+        }
+        built[node] = result;
+    }
+    return built[root()];
+}
+
+/* What printNode has left to print, the next item last: a node, the
+   statement under a node's Stmt line, or a line of text. */
+struct FlatPrintItem {
+    int32_t node;
+    bool stmt;
+    const char* text;
+    int indent;
+};
+
+/* Prints the node's own line and queues what goes under it, as printNode
+   does for the pointer tree. */
+static void printOne(const FlatAst& ast, int32_t node, int n, vector<FlatPrintItem>& pending, ostream& out) {
+    auto later = [&pending](int32_t child, int indent) {
+        pending.push_back({child, false, NULL, indent});
+    };
+
+    printIndent(out, n);
+    switch (ast.kind(node)) {
+        case flat_prog: {
+            out << "Prog:\n";
+            later(ast.func(), n + 1);
+            break;
+        }
+        case flat_func: {
+            out << "Func: " << symbolName(ast.name(node)) << "\n";
+            later(ast.body(node), n + 1);
+            if (ast.param(node) != FlatAst::NO_NODE)
+                later(ast.param(node), n + 1);
+            break;
+        }
+        case flat_extern: {
+            out << "Extern: " << symbolName(ast.name(node)) << "\n";
+            break;
+        }
+        case flat_var: {
+            out << "Var: " << symbolName(ast.name(node)) << "\n";
+            break;
+        }
+        case flat_cnst: {
+            out << "Const: " << ast.value(node) << "\n";
+            break;
+        }
+        case flat_rexpr: {
+            out << "RExpr: \n";
+            later(ast.rhs(node), n + 1);
+            later(ast.lhs(node), n + 1);
+            break;
+        }
+        case flat_bexpr: {
+            out << "BExpr: \n";
+            later(ast.rhs(node), n + 1);
+            later(ast.lhs(node), n + 1);
+            break;
+        }
+        case flat_uexpr: {
+            out << "UExpr: \n";
+            later(ast.expr(node), n + 1);
+            break;
+        }
+        default: {
+            // Every statement prints under a Stmt line of its own
+            out << "Stmt: \n";
+            pending.push_back({node, true, NULL, n + 1});
+            break;
+        }
+    }
+}
+
+static void printStmt(const FlatAst& ast, int32_t node, int n, vector<FlatPrintItem>& pending, ostream& out) {
+    auto later = [&pending](int32_t child, int indent) {
+        pending.push_back({child, false, NULL, indent});
+    };
+    auto text = [&pending](const char* line, int indent) {
+        pending.push_back({FlatAst::NO_NODE, false, line, indent});
+    };
+
+    printIndent(out, n);
+    switch (ast.kind(node)) {
+        case flat_call: {
+            out << "Call: name " << symbolName(ast.name(node)) << "\n";
+            if (ast.param(node) != FlatAst::NO_NODE) {
+                later(ast.param(node), n + 1);
+                text("Call: param\n", n);
+            }
+            break;
+        }
+        case flat_ret: {
+            out << "Ret:\n";
+            later(ast.expr(node), n + 1);
+            break;
+        }
+        case flat_block: {
+            out << "Block:\n";
+            FlatRange stmts = ast.statements(node);
+            for (int32_t i = stmts.count; i > 0; i--) {
+                later(stmts.items[i - 1], n + 1);
+            }
+            break;
+        }
+        case flat_while: {
+            out << "While: cond \n";
+            later(ast.body(node), n + 1);
+            text("While: body \n", n);
+            later(ast.cond(node), n + 1);
+            break;
+        }
+        case flat_if: {
+            out << "If: cond\n";
+            if (ast.elseBody(node) != FlatAst::NO_NODE) {
+                later(ast.elseBody(node), n + 1);
+                text("Else: body\n", n);
+            }
+            later(ast.body(node), n + 1);
+            text("If: body\n", n);
+            later(ast.cond(node), n + 1);
+            break;
+        }
+        case flat_asgn: {
+            out << "Asgn: lhs\n";
+            later(ast.rhs(node), n + 1);
+            text("Asgn: rhs\n", n);
+            later(ast.lhs(node), n + 1);
+            break;
+        }
+        case flat_decl: {
+            out << "Decl: " << symbolName(ast.name(node)) << "\n";
+            break;
+        }
+        default: {
+            fprintf(stderr, "Incorrect node type\n");
+            exit(1);
+        }
+    }
+}
+
+void printNode(const FlatAst& ast, int32_t node, int n, ostream& out) {
+    assert(node != FlatAst::NO_NODE);
+
+    vector<FlatPrintItem> pending(1, {node, false, NULL, n});
+    while (!pending.empty()) {
+        FlatPrintItem item = pending.back();
+        pending.pop_back();
+        if (item.text) {
+            printIndent(out, item.indent);
+            out << item.text;
+        } else if (item.stmt) {
+            printStmt(ast, item.node, item.indent, pending, out);
+        } else {
+            printOne(ast, item.node, item.indent, pending, out);
+        }
+    }
+}
+
+ostream& operator<<(ostream& out, const FlatAst& ast) {
+    printNode(ast, ast.root(), 0, out);
+    return out;
+}
@@ -0,0 +1,127 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "ast.h"
+
+/* The kind of a node in the flat AST, the node and statement types of
+   ast.h in one byte. */
+enum flat_kind : uint8_t {
+    flat_prog,
+    flat_func,
+    flat_extern,
+    flat_var,
+    flat_cnst,
+    flat_rexpr,
+    flat_bexpr,
+    flat_uexpr,
+    flat_call,
+    flat_ret,
+    flat_block,
+    flat_while,
+    flat_if,
+    flat_asgn,
+    flat_decl
+};
+
+/* The statements of a block, as node indices. */
+struct FlatRange {
+    const int32_t* items;
+    int32_t count;
+
+    const int32_t* begin() const { return items; }
+    const int32_t* end() const { return items + count; }
+};
+
+/*
+An AST in structure-of-arrays form: node i is kinds[i], with its children
+at index i of the child arrays and its constant, name or operator in
+payload[i]. Nodes are numbered in the order the parser reduces them,
+children before their parent, so every subtree is a run of consecutive
+nodes ending in its root, and the root of the program is the last node.
+
+    kind     payload   first     second    third
+    prog               func      extern    extern
+    func     name      param     body
+    extern   name
+    var      name
+    cnst     value
+    rexpr    op        lhs       rhs
+    bexpr    op        lhs       rhs
+    uexpr    op        expr
+    call     name      param
+    ret                expr
+    block              start     count
+    while              cond      body
+    if                 cond      if_body   else_body
+    asgn               lhs       rhs
+    decl     name
+
+A missing child is NO_NODE. The statements of a block are lists[start]
+through lists[start + count - 1].
+*/
+class FlatAst {
+   public:
+    static constexpr int32_t NO_NODE = -1;
+
+    FlatAst() {}
+    explicit FlatAst(const astNode* root);
+
+    int32_t size() const { return (int32_t)kinds.size(); }
+    bool empty() const { return kinds.empty(); }
+    size_t bytes() const;
+    int32_t root() const { return size() - 1; }
+
+    flat_kind kind(int32_t node) const { return kinds[node]; }
+    Symbol name(int32_t node) const { return payload[node]; }
+    int value(int32_t node) const { return payload[node]; }
+    int op(int32_t node) const { return payload[node]; }
+
+    int32_t lhs(int32_t node) const { return first[node]; }
+    int32_t rhs(int32_t node) const { return second[node]; }
+    int32_t expr(int32_t node) const { return first[node]; }
+    int32_t param(int32_t node) const { return first[node]; }
+    int32_t cond(int32_t node) const { return first[node]; }
+    int32_t body(int32_t node) const { return second[node]; }
+    int32_t elseBody(int32_t node) const { return third[node]; }
+    int32_t func() const { return first[root()]; }
+    FlatRange statements(int32_t node) const { return {lists.data() + first[node], second[node]}; }
+
+    astNode* toTree() const;
+
+   private:
+    friend class FlatAstBuilder;
+
+    std::vector<flat_kind> kinds;
+    std::vector<int32_t> payload;
+    std::vector<int32_t> first;
+    std::vector<int32_t> second;
+    std::vector<int32_t> third;
+    std::vector<int32_t> lists;
+};
+
+/* Appends nodes to a FlatAst the way the parser reduces, bottom up: each
+   node is added after its children, which it names by the indices add
+   returned for them, in the slots of the table above. */
+class FlatAstBuilder {
+   public:
+    explicit FlatAstBuilder(FlatAst& _ast) : ast(_ast) {}
+
+    void reserve(size_t nodes);
+    int32_t add(flat_kind kind, int32_t value = 0, int32_t first = FlatAst::NO_NODE,
+                int32_t second = FlatAst::NO_NODE, int32_t third = FlatAst::NO_NODE);
+    int32_t addBlock(const int32_t* statements, size_t count);
+
+   private:
+    FlatAst& ast;
+};
+
+/* The same output as printNode for the tree it was built from. */
+void printNode(const FlatAst& ast, int32_t node, int indent = 0, ostream& out = cout);
+
+ostream& operator<<(ostream& out, const FlatAst& ast);
+
+#endif  // FLAT_AST_H
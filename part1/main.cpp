@@ -1,5 +1,6 @@
 #include <iostream>
 #include "semantic.h"
+#include "../logging.h"
 
 int main(int argc, char** argv) {
     if (argc != 2) {
@@ -7,13 +8,17 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    if (!runParser(argv[1])) {
+    // This tool exists to show the tree
+    configureLogging("debug:parser");
+
+    astNode* root = runParser(argv[1]);
+    if (!root) {
         return 1;
     }
 
-    if (!runSemanticAnalysis()) {
+    if (!runSemanticAnalysis(root, true)) {
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,26 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "flat_ast.h"
+
+typedef void* yyscan_t;
+
+/* Everything one parse produces. The grammar fills it in through the
+   parse-param of the reentrant parser, so parses never share state. */
+struct ParseState {
+    explicit ParseState(FlatAst& ast) : builder(ast) {}
+
+    FlatAstBuilder builder;              // the AST, built as the grammar reduces
+    std::string* diagnostics = nullptr;  // syntax errors go to stderr when NULL
+    std::vector<int32_t> statements;     // of the blocks being parsed, innermost last
+};
+
+bool parseBuffer(const char* data, size_t length, FlatAst& ast, std::string* diagnostics = nullptr);
+astNode* parseBuffer(const char* data, size_t length, std::string* diagnostics = nullptr);
+
+#endif  // PARSER_H
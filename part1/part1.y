@@ -1,29 +1,38 @@
-%{
+%code requires {
 #include "ast.h"
+#include "parser.h"
+}
+
+%code {
+int yylex(YYSTYPE* yylval_param, yyscan_t yyscanner);
+void yyerror(yyscan_t scanner, ParseState* state, const char* msg);
 
-extern int yylex();
-extern void yyerror(const char *);
+// The parser stack grows on the heap, so nesting is bounded by memory
+// rather than by the default of 10000 entries
+#define YYMAXDEPTH 100000000
+}
 
-extern int yylineno;
-astNode* root;
-%}
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {ParseState* state}
 
 %union {
     int ival;
-    char *idname;
-    astNode *nptr;
-    vector<astNode*> *svec_ptr;
+    Symbol symbol;
+    char *idname;  // what the flex scanner in part1.l returns instead of symbol
+    int32_t node;  // in the AST state->builder appends to
+    size_t mark;  // where a list starts on state->statements
 }
 
-%token <idname> IDENTIFIER PRINT READ
+%token <symbol> IDENTIFIER PRINT READ
 %token <ival> NUMBER
 %token INT VOID IF ELSE WHILE RETURN EXTERN
 %token LT GT LE GE EQ NEQ
 
-%type <svec_ptr> statements var_declarations
-%type <nptr> program extern_declaration function block
-%type <nptr> var_declaration statement
-%type <nptr> condition expression arithmetic_expression call_expression terminal
+%type <mark> statements var_declarations
+%type <node> program extern_declaration function block
+%type <node> var_declaration statement
+%type <node> condition expression arithmetic_expression call_expression terminal
 
 %nonassoc LOWER_THAN_ELSE
 %nonassoc ELSE
@@ -37,100 +46,96 @@ astNode* root;
 
 program:
     extern_declaration extern_declaration function {
-        $$ = createProg($1, $2, $3);
-        root = $$;
+        $$ = state->builder.add(flat_prog, 0, $3, $1, $2);
     }
 
 extern_declaration:
     EXTERN VOID IDENTIFIER '(' INT ')' ';' {
-        $$ = createExtern($3);
-        free($3);
+        $$ = state->builder.add(flat_extern, $3);
     }
   | EXTERN INT IDENTIFIER '(' ')' ';' {
-        $$ = createExtern($3);
-        free($3);
+        $$ = state->builder.add(flat_extern, $3);
     }
 
 function:
     INT IDENTIFIER '(' INT IDENTIFIER ')' block {
-        $$ = createFunc($2, createVar($5), $7);
-        free($2);
-        free($5);
+        $$ = state->builder.add(flat_func, $2, state->builder.add(flat_var, $5), $7);
     }
   | INT IDENTIFIER '(' ')' block {
-        $$ = createFunc($2, nullptr, $5);
-        free($2);
+        $$ = state->builder.add(flat_func, $2, FlatAst::NO_NODE, $5);
     }
 
+/* A block's statements stay on state->statements until the block is
+   added, when they are copied into the AST's lists; nested blocks are built first, so
+   the innermost block's are always on top. */
 block:
     '{' var_declarations statements '}' {
-        $2->insert($2->end(), $3->begin(), $3->end()); 
-        $$ = createBlock($2);
-        delete($3);
+        $$ = state->builder.addBlock(&state->statements[$2], state->statements.size() - $2);
+        state->statements.resize($2);
     }
   | '{' statements '}' {
-        $$ = createBlock($2);
+        $$ = state->builder.addBlock(&state->statements[$2], state->statements.size() - $2);
+        state->statements.resize($2);
     }
   | '{' var_declarations '}' {
-        $$ = createBlock($2);
+        $$ = state->builder.addBlock(&state->statements[$2], state->statements.size() - $2);
+        state->statements.resize($2);
     }
   | '{' '}' {
-        $$ = createBlock(new vector<astNode*>());
+        $$ = state->builder.addBlock(nullptr, 0);
     }
 
 var_declarations:
     var_declarations var_declaration {
         $$ = $1;
-        $$->push_back($2);
+        state->statements.push_back($2);
     }
   | var_declaration {
-        $$ = new vector<astNode*>();
-        $$->push_back($1);
+        $$ = state->statements.size();
+        state->statements.push_back($1);
     }
 
 var_declaration:
     INT IDENTIFIER ';' {
-        $$ = createDecl($2);
-        free($2);
+        $$ = state->builder.add(flat_decl, $2);
     }
 
 statements:
     statements statement {
         $$ = $1;
-        $$->push_back($2);
+        state->statements.push_back($2);
     }
   | statement {
-        $$ = new vector<astNode*>();
-        $$->push_back($1);
+        $$ = state->statements.size();
+        state->statements.push_back($1);
     }
 
 statement:
     expression ';' { $$ = $1; }
   | block { $$ = $1; }
   | IDENTIFIER '=' expression ';' {
-        $$ = createAsgn(createVar($1), $3);
-        free($1);
+        $$ = state->builder.add(flat_asgn, 0, state->builder.add(flat_var, $1), $3);
     }
   | IF '(' condition ')' statement ELSE statement {
-        $$ = createIf($3, $5, $7);
+        $$ = state->builder.add(flat_if, 0, $3, $5, $7);
     }
   | IF '(' condition ')' statement %prec LOWER_THAN_ELSE {
-        $$ = createIf($3, $5, nullptr);
+        $$ = state->builder.add(flat_if, 0, $3, $5);
     }
   | WHILE '(' condition ')' statement {
-        $$ = createWhile($3, $5);
+        $$ = state->builder.add(flat_while, 0, $3, $5);
     }
   | RETURN expression ';' {
-        $$ = createRet($2);
+        $$ = state->builder.add(flat_ret, 0, $2);
     }
 
 condition:
-    expression GT expression { $$ = createRExpr($1, $3, gt); }
-  | expression LT expression { $$ = createRExpr($1, $3, lt); }
-  | expression EQ expression { $$ = createRExpr($1, $3, eq); }
-  | expression GE expression { $$ = createRExpr($1, $3, ge); }
-  | expression LE expression { $$ = createRExpr($1, $3, le); }
-  | expression NEQ expression { $$ = createRExpr($1, $3, neq); }
+    expression GT expression { $$ = state->builder.add(flat_rexpr, gt, $1, $3); }
+  | expression LT expression { $$ = state->builder.add(flat_rexpr, lt, $1, $3); }
+  | expression EQ expression { $$ = state->builder.add(flat_rexpr, eq, $1, $3); }
+  | expression GE expression { $$ = state->builder.add(flat_rexpr, ge, $1, $3); }
+  | expression LE expression { $$ = state->builder.add(flat_rexpr, le, $1, $3); }
+  | expression NEQ expression { $$ = state->builder.add(flat_rexpr, neq, $1, $3); }
 
 expression:
     terminal { $$ = $1; }
@@ -139,18 +144,18 @@ expression:
   | arithmetic_expression { $$ = $1; }
 
 call_expression:
-    IDENTIFIER '(' ')' { $$ = createCall($1, nullptr); free($1); }
-  | IDENTIFIER '(' expression ')' { $$ = createCall($1, $3); free($1); }
+    IDENTIFIER '(' ')' { $$ = state->builder.add(flat_call, $1); }
+  | IDENTIFIER '(' expression ')' { $$ = state->builder.add(flat_call, $1, $3); }
 
 arithmetic_expression:
-    expression '+' expression { $$ = createBExpr($1, $3, add); }
-  | expression '-' expression { $$ = createBExpr($1, $3, sub); }
-  | expression '*' expression { $$ = createBExpr($1, $3, mul); }
-  | expression '/' expression { $$ = createBExpr($1, $3, divide); }
-  | '-' expression %prec UMINUS { $$ = createUExpr($2, uminus); }
+    expression '+' expression { $$ = state->builder.add(flat_bexpr, add, $1, $3); }
+  | expression '-' expression { $$ = state->builder.add(flat_bexpr, sub, $1, $3); }
+  | expression '*' expression { $$ = state->builder.add(flat_bexpr, mul, $1, $3); }
+  | expression '/' expression { $$ = state->builder.add(flat_bexpr, divide, $1, $3); }
+  | '-' expression %prec UMINUS { $$ = state->builder.add(flat_uexpr, uminus, $2); }
 
 terminal:
-    NUMBER { $$ = createCnst($1); }
-  | IDENTIFIER { $$ = createVar($1); free($1); }
+    NUMBER { $$ = state->builder.add(flat_cnst, $1); }
+  | IDENTIFIER { $$ = state->builder.add(flat_var, $1); }
 
 %%
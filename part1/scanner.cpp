@@ -0,0 +1,285 @@
+#include "scanner.h"
+
+#include <climits>
+#include <cstring>
+
+#include "symbols.h"
+#include "y.tab.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86
+#endif
+
+using namespace std;
+
+/* Each kernel returns how many bytes from p on belong to its kind of run,
+   without reading at or past end. */
+struct ScanKernels {
+    size_t (*whitespace)(const char* p, const char* end, int& newlines);
+    size_t (*identifier)(const char* p, const char* end);
+    size_t (*digits)(const char* p, const char* end);
+};
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static inline bool isLetter(char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+static inline bool isDigit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline bool isIdentifier(char c) {
+    return isLetter(c) || isDigit(c) || c == '_';
+}
+
+static size_t whitespaceScalar(const char* p, const char* end, int& newlines) {
+    const char* start = p;
+    for (; p < end && isSpace(*p); p++) newlines += *p == '\n';
+    return p - start;
+}
+
+static size_t identifierScalar(const char* p, const char* end) {
+    const char* start = p;
+    while (p < end && isIdentifier(*p)) p++;
+    return p - start;
+}
+
+static size_t digitsScalar(const char* p, const char* end) {
+    const char* start = p;
+    while (p < end && isDigit(*p)) p++;
+    return p - start;
+}
+
+static const ScanKernels SCALAR_KERNELS = {whitespaceScalar, identifierScalar, digitsScalar};
+
+#ifdef SCANNER_X86
+
+/* The vector kernels classify a whole block at once and stop at the first
+   byte outside the class; the tail shorter than a block goes byte by
+   byte. Bytes from 0x80 up are negative in the signed compares, so they
+   never fall in an ASCII range. */
+
+__attribute__((target("sse2"))) static inline __m128i inRange128(__m128i x, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8(hi + 1)));
+}
+
+__attribute__((target("sse2"))) static inline __m128i identifierClass128(__m128i x) {
+    __m128i letter = inRange128(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = inRange128(x, '0', '9');
+    return _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+__attribute__((target("sse2"))) static size_t whitespaceSSE2(const char* p, const char* end, int& newlines) {
+    const char* start = p;
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        __m128i newline = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+        unsigned other = ~_mm_movemask_epi8(_mm_or_si128(space, newline)) & 0xffff;
+        unsigned lines = _mm_movemask_epi8(newline);
+        if (other) {
+            unsigned n = __builtin_ctz(other);
+            newlines += __builtin_popcount(lines & ((1u << n) - 1));
+            return p + n - start;
+        }
+        newlines += __builtin_popcount(lines);
+    }
+    return p - start + whitespaceScalar(p, end, newlines);
+}
+
+__attribute__((target("sse2"))) static size_t identifierSSE2(const char* p, const char* end) {
+    const char* start = p;
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        unsigned other = ~_mm_movemask_epi8(identifierClass128(block)) & 0xffff;
+        if (other) return p + __builtin_ctz(other) - start;
+    }
+    return p - start + identifierScalar(p, end);
+}
+
+__attribute__((target("sse2"))) static size_t digitsSSE2(const char* p, const char* end) {
+    const char* start = p;
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        unsigned other = ~_mm_movemask_epi8(inRange128(block, '0', '9')) & 0xffff;
+        if (other) return p + __builtin_ctz(other) - start;
+    }
+    return p - start + digitsScalar(p, end);
+}
+
+__attribute__((target("avx2"))) static inline __m256i inRange256(__m256i x, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), x));
+}
+
+__attribute__((target("avx2"))) static inline __m256i identifierClass256(__m256i x) {
+    __m256i letter = inRange256(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = inRange256(x, '0', '9');
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t whitespaceAVX2(const char* p, const char* end, int& newlines) {
+    const char* start = p;
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        __m256i newline = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')));
+        unsigned other = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(space, newline));
+        unsigned lines = _mm256_movemask_epi8(newline);
+        if (other) {
+            unsigned n = __builtin_ctz(other);
+            newlines += __builtin_popcount(lines & ((1ull << n) - 1));
+            return p + n - start;
+        }
+        newlines += __builtin_popcount(lines);
+    }
+    return p - start + whitespaceSSE2(p, end, newlines);
+}
+
+__attribute__((target("avx2"))) static size_t identifierAVX2(const char* p, const char* end) {
+    const char* start = p;
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        unsigned other = ~(unsigned)_mm256_movemask_epi8(identifierClass256(block));
+        if (other) return p + __builtin_ctz(other) - start;
+    }
+    return p - start + identifierSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) static size_t digitsAVX2(const char* p, const char* end) {
+    const char* start = p;
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        unsigned other = ~(unsigned)_mm256_movemask_epi8(inRange256(block, '0', '9'));
+        if (other) return p + __builtin_ctz(other) - start;
+    }
+    return p - start + digitsSSE2(p, end);
+}
+
+static const ScanKernels SSE2_KERNELS = {whitespaceSSE2, identifierSSE2, digitsSSE2};
+static const ScanKernels AVX2_KERNELS = {whitespaceAVX2, identifierAVX2, digitsAVX2};
+
+#endif  // SCANNER_X86
+
+bool Scanner::supported(ScanMode mode) {
+    switch (mode) {
+        case ScanAuto:
+        case ScanScalar:
+            return true;
+#ifdef SCANNER_X86
+        case ScanSSE2:
+            return __builtin_cpu_supports("sse2");
+        case ScanAVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+    }
+}
+
+/* Modes the CPU lacks fall back to the scalar kernels. */
+Scanner::Scanner(const char* _text, size_t _length, ScanMode mode)
+    : cursor(_text), end(_text + _length), lineNumber(1), kernels(&SCALAR_KERNELS) {
+    if (mode == ScanAuto) mode = supported(ScanAVX2) ? ScanAVX2 : ScanSSE2;
+    if (!supported(mode)) return;
+#ifdef SCANNER_X86
+    if (mode == ScanSSE2) kernels = &SSE2_KERNELS;
+    if (mode == ScanAVX2) kernels = &AVX2_KERNELS;
+#endif
+}
+
+static int keyword(const char* text, size_t length) {
+    switch (length) {
+        case 2:
+            if (memcmp(text, "if", 2) == 0) return IF;
+            break;
+        case 3:
+            if (memcmp(text, "int", 3) == 0) return INT;
+            break;
+        case 4:
+            if (memcmp(text, "void", 4) == 0) return VOID;
+            if (memcmp(text, "else", 4) == 0) return ELSE;
+            break;
+        case 5:
+            if (memcmp(text, "while", 5) == 0) return WHILE;
+            break;
+        case 6:
+            if (memcmp(text, "return", 6) == 0) return RETURN;
+            if (memcmp(text, "extern", 6) == 0) return EXTERN;
+            break;
+    }
+    return 0;
+}
+
+// Most runs are shorter than this and not worth a call and a vector load
+static const ptrdiff_t SHORT_RUN = 8;
+
+/* Skips a run of the class from p on: its first SHORT_RUN bytes one at a
+   time, the rest, if any, with the kernel. */
+static inline const char* skipRun(const char* p, const char* end, bool (*inClass)(char),
+                                  size_t (*kernel)(const char*, const char*)) {
+    const char* limit = end - p > SHORT_RUN ? p + SHORT_RUN : end;
+    while (p < limit && inClass(*p)) p++;
+    return p == limit && p < end ? p + kernel(p, end) : p;
+}
+
+/* Returns the next token and sets its value, or 0 at the end of the text. */
+int Scanner::next(YYSTYPE* value) {
+    const char* limit = end - cursor > SHORT_RUN ? cursor + SHORT_RUN : end;
+    while (cursor < limit && isSpace(*cursor)) lineNumber += *cursor++ == '\n';
+    if (cursor == limit && cursor < end) {
+        int newlines = 0;
+        cursor += kernels->whitespace(cursor, end, newlines);
+        lineNumber += newlines;
+    }
+    if (cursor == end) return 0;
+
+    const char* start = cursor;
+    char c = *cursor++;
+    if (isLetter(c)) {
+        cursor = skipRun(cursor, end, isIdentifier, kernels->identifier);
+        size_t length = cursor - start;
+        int token = keyword(start, length);
+        if (token) return token;
+        value->symbol = internSymbol(start, length);
+        return IDENTIFIER;
+    }
+    if (isDigit(c)) {
+        cursor = skipRun(cursor, end, isDigit, kernels->digits);
+        // atoi on glibc is strtol cut to an int: it saturates at LONG_MAX
+        long number = 0;
+        for (const char* p = start; p < cursor; p++) {
+            int digit = *p - '0';
+            number = number > (LONG_MAX - digit) / 10 ? LONG_MAX : number * 10 + digit;
+        }
+        value->ival = (int)number;
+        return NUMBER;
+    }
+
+    bool equals = cursor < end && *cursor == '=';
+    switch (c) {
+        case '<':
+            cursor += equals;
+            return equals ? LE : LT;
+        case '>':
+            cursor += equals;
+            return equals ? GE : GT;
+        case '=':
+            if (!equals) return '=';
+            cursor++;
+            return EQ;
+        default:
+            // Like flex's catch-all rule, which returns yytext[0]
+            return c;
+    }
+}
+
+int yylex(YYSTYPE* value, yyscan_t scanner) {
+    return static_cast<Scanner*>(scanner)->next(value);
+}
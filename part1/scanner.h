@@ -0,0 +1,35 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+
+union YYSTYPE;
+struct ScanKernels;
+
+/* How the scanner finds the end of whitespace, identifiers and numbers:
+   a byte at a time, or 16 or 32 bytes at a time with SSE2 or AVX2.
+   ScanAuto takes the widest the CPU has. */
+enum ScanMode { ScanAuto, ScanScalar, ScanSSE2, ScanAVX2 };
+
+/* The hand-written miniC scanner. It returns exactly the tokens of the flex
+   rules in part1.l, which stay as the reference: keywords, the relational
+   operators, identifiers, numbers, and any other character as itself.
+   Spaces, tabs and newlines are skipped and counted for line numbers. The
+   text needs no terminator and is never written to; identifiers come back
+   interned, see symbols.h, and numbers converted. */
+class Scanner {
+   public:
+    Scanner(const char* text, size_t length, ScanMode mode = ScanAuto);
+
+    int next(YYSTYPE* value);
+    int line() const { return lineNumber; }
+    static bool supported(ScanMode mode);
+
+   private:
+    const char* cursor;
+    const char* end;
+    int lineNumber;
+    const ScanKernels* kernels;
+};
+
+#endif  // SCANNER_H
@@ -1,170 +1,250 @@
 #include "semantic.h"
 
+#include <assert.h>
+
 #include <iostream>
 #include <stdexcept>
 
-void SymbolTable::insert(const string& identifier, int value) {
-    if (exists(identifier)) {
-        throw runtime_error("Variable '" + identifier + "' already declared in this scope.");
+#include "../logging.h"
+#include "scanner.h"
+#include "source_buffer.h"
+
+void SymbolTable::new_scope() {
+    undo.push_back({NO_SYMBOL, false, {0, 0}});
+    depth++;
+}
+
+void SymbolTable::end_scope() {
+    assert(depth > 0);
+
+    for (;;) {
+        Undo last = undo.back();
+        undo.pop_back();
+        if (last.identifier == NO_SYMBOL) break;
+
+        if (last.hid) {
+            table[last.identifier] = last.binding;
+        } else {
+            table.erase(last.identifier);
+        }
+    }
+    depth--;
+}
+
+void SymbolTable::insert(Symbol identifier, int value) {
+    auto it = table.find(identifier);
+    if (it == table.end()) {
+        undo.push_back({identifier, false, {0, 0}});
+        table.emplace(identifier, Binding{depth, value});
+        return;
+    }
+
+    if (it->second.scope == depth) {
+        throw runtime_error("Variable '" + string(symbolName(identifier)) + "' already declared in this scope.");
     }
-    table[identifier] = value;
+    undo.push_back({identifier, true, it->second});
+    it->second = {depth, value};
 }
 
-bool SymbolTable::exists(const string& identifier) {
+bool SymbolTable::exists(Symbol identifier) {
     return table.find(identifier) != table.end();
 }
 
-bool SemanticAnalyzer::analyze(astNode* root) {
+bool SemanticAnalyzer::analyze(const FlatAst& _ast) {
+    ast = &_ast;
     try {
-        traverse(root);
+        traverse(ast->root());
         return true;
     } catch (const runtime_error& e) {
-        cerr << "Semantic error: " << e.what() << endl;
+        error = string("Semantic error: ") + e.what();
         return false;
     }
 }
 
 void SemanticAnalyzer::new_scope() {
-    symbol_tables.push_back(SymbolTable());
+    symbols.new_scope();
 }
 
 void SemanticAnalyzer::end_scope() {
-    symbol_tables.pop_back();
+    symbols.end_scope();
+}
+
+void SemanticAnalyzer::insert(Symbol identifier, int value) {
+    symbols.insert(identifier, value);
 }
 
-void SemanticAnalyzer::insert(const string& identifier, int value) {
-    symbol_tables.back().insert(identifier, value);
+bool SemanticAnalyzer::exists(Symbol identifier) {
+    return symbols.exists(identifier);
 }
 
-bool SemanticAnalyzer::exists(const string& identifier) {
-    for (auto it = symbol_tables.rbegin(); it != symbol_tables.rend(); ++it) {
-        if (it->exists(identifier)) {
-            return true;
+/* Pushed where a scope's statements end, to close the scope there. */
+static const int32_t END_SCOPE = -2;
+
+/* Visits the nodes under node in order, children pushed last first on an
+   explicit stack so that no nesting depth can overflow the call stack. */
+void SemanticAnalyzer::traverse(int32_t node) {
+    vector<int32_t> pending(1, node);
+    auto later = [&pending](int32_t child) {
+        if (child != FlatAst::NO_NODE) pending.push_back(child);
+    };
+    auto laterScope = [&](FlatRange stmts) {
+        new_scope();
+        pending.push_back(END_SCOPE);
+        for (int32_t i = stmts.count; i > 0; i--) {
+            later(stmts.items[i - 1]);
+        }
+    };
+
+    while (!pending.empty()) {
+        node = pending.back();
+        pending.pop_back();
+        if (node == END_SCOPE) {
+            end_scope();
+            continue;
+        }
+
+        switch (ast->kind(node)) {
+            case flat_prog:
+                later(ast->func());
+                break;
+
+            case flat_func:
+                laterScope(ast->statements(ast->body(node)));
+                if (ast->param(node) != FlatAst::NO_NODE) {
+                    insert(ast->name(ast->param(node)));
+                }
+                break;
+
+            case flat_call:
+                later(ast->param(node));
+                break;
+
+            case flat_ret:
+                later(ast->expr(node));
+                break;
+
+            case flat_block:
+                laterScope(ast->statements(node));
+                break;
+
+            case flat_while:
+                later(ast->body(node));
+                later(ast->cond(node));
+                break;
+
+            case flat_if:
+                later(ast->elseBody(node));
+                later(ast->body(node));
+                later(ast->cond(node));
+                break;
+
+            case flat_asgn:
+                later(ast->rhs(node));
+                later(ast->lhs(node));
+                break;
+
+            case flat_decl:
+                insert(ast->name(node));
+                break;
+
+            case flat_extern:
+                break;
+
+            case flat_var:
+                if (!exists(ast->name(node))) {
+                    throw runtime_error("Variable '" + string(symbolName(ast->name(node))) + "' not declared.");
+                }
+                break;
+
+            case flat_cnst:
+                break;
+
+            case flat_rexpr:
+            case flat_bexpr:
+                later(ast->rhs(node));
+                later(ast->lhs(node));
+                break;
+
+            case flat_uexpr:
+                later(ast->expr(node));
+                break;
+
+            default:
+                break;
         }
     }
-    return false;
 }
 
-void SemanticAnalyzer::traverse(astNode* node) {
-    if (!node) return;
-
-    switch (node->type) {
-        case ast_prog:
-            traverse(node->prog.func);
-            break;
+extern int yyparse(yyscan_t scanner, ParseState* state);
 
-        case ast_func:
-            new_scope();
-            if (node->func.param) {
-                insert(node->func.param->var.name);
-            }
-            for (auto& stmt : *node->func.body->stmt.block.stmt_list) {
-                traverse(stmt);
-            }
-            end_scope();
-            break;
-
-        case ast_stmt:
-            switch (node->stmt.type) {
-                case ast_call:
-                    traverse(node->stmt.call.param);
-                    break;
-
-                case ast_ret:
-                    traverse(node->stmt.ret.expr);
-                    break;
-
-                case ast_block:
-                    new_scope();
-                    for (auto& stmt : *node->stmt.block.stmt_list) {
-                        traverse(stmt);
-                    }
-                    end_scope();
-                    break;
-
-                case ast_while:
-                    traverse(node->stmt.whilen.cond);
-                    traverse(node->stmt.whilen.body);
-                    break;
-
-                case ast_if:
-                    traverse(node->stmt.ifn.cond);
-                    traverse(node->stmt.ifn.if_body);
-                    traverse(node->stmt.ifn.else_body);
-                    break;
-
-                case ast_asgn:
-                    traverse(node->stmt.asgn.lhs);
-                    traverse(node->stmt.asgn.rhs);
-                    break;
-
-                case ast_decl:
-                    insert(node->stmt.decl.name);
-                    break;
-
-                default:
-                    break;
-            }
-            break;
-
-        case ast_extern:
-            break;
-
-        case ast_var:
-            if (!exists(node->var.name)) {
-                throw runtime_error("Variable '" + string(node->var.name) + "' not declared.");
-            }
-            break;
-
-        case ast_cnst:
-            break;
-
-        case ast_rexpr:
-            traverse(node->rexpr.lhs);
-            traverse(node->rexpr.rhs);
-            break;
-
-        case ast_bexpr:
-            traverse(node->bexpr.lhs);
-            traverse(node->bexpr.rhs);
-            break;
-
-        case ast_uexpr:
-            traverse(node->uexpr.expr);
-            break;
-
-        default:
-            break;
+void yyerror(yyscan_t scanner, ParseState* state, const char*) {
+    int line = static_cast<Scanner*>(scanner)->line();
+    if (state->diagnostics) {
+        *state->diagnostics += "Syntax Error: line " + to_string(line) + "\n";
+    } else {
+        fprintf(stderr, "Syntax Error: line %d\n", line);
     }
-};
+}
 
-extern int yyparse();
-extern int yylex_destroy();
-extern FILE* yyin;
-extern int yylineno;
-extern astNode* root;
+/* Parses miniC source held in memory, which the AST does not point into,
+   straight into ast. False, with ast empty, on a syntax error. */
+bool parseBuffer(const char* data, size_t length, FlatAst& ast, string* diagnostics) {
+    ast = FlatAst();
+    ParseState state(ast);
+    state.diagnostics = diagnostics;
+
+    // Code has a node every six bytes or so; a short guess only costs the arrays a regrowth
+    state.builder.reserve(length / 4);
+    Scanner scanner(data, length);
+    if (yyparse(&scanner, &state) != 0) {
+        ast = FlatAst();
+        return false;
+    }
+    return true;
+}
 
-void yyerror(const char*) {
-    fprintf(stderr, "Syntax Error: line %d\n", yylineno);
+/* The same as a pointer tree, for the tools that show or measure one.
+   Returns the AST, built in an arena of its own that freeNode on the root
+   releases at once, or NULL on a syntax error. */
+astNode* parseBuffer(const char* data, size_t length, string* diagnostics) {
+    FlatAst ast;
+    if (!parseBuffer(data, length, ast, diagnostics)) return nullptr;
+    return ast.toTree();
 }
 
-bool runParser(const char* filename) {
-    yyin = fopen(filename, "r");
-    int result = yyparse();
-    fclose(yyin);
-    yylex_destroy();
+astNode* runParser(const char* filename, string* diagnostics) {
+    SourceBuffer source;
+    if (!source.map(filename)) {
+        if (diagnostics) {
+            *diagnostics += "Cannot open " + string(filename) + "\n";
+        } else {
+            fprintf(stderr, "Cannot open %s\n", filename);
+        }
+        return nullptr;
+    }
 
-    return result == 0;
+    return parseBuffer(source.data(), source.size(), diagnostics);
 }
 
-bool runSemanticAnalysis(bool cleanup) {
+bool runSemanticAnalysis(const FlatAst& ast, string* diagnostics) {
+    LOG(LogDebug, LogParser, ast);
+    SemanticAnalyzer sa;
+    bool result = sa.analyze(ast);
+    if (!result) {
+        if (diagnostics) {
+            *diagnostics += sa.getError() + "\n";
+        } else {
+            cerr << sa.getError() << endl;
+        }
+    }
+    return result;
+}
+
+bool runSemanticAnalysis(astNode* root, bool cleanup, string* diagnostics) {
     if (!root) return true;
 
-    printNode(root);
-    SemanticAnalyzer sa;
-    bool result = sa.analyze(root);
-    
+    bool result = runSemanticAnalysis(FlatAst(root), diagnostics);
     if (cleanup) freeNode(root);
-    
+
     return result;
 }
@@ -6,34 +6,61 @@
 #include <vector>
 
 #include "ast.h"
+#include "flat_ast.h"
+#include "parser.h"
 
 using namespace std;
 
+/* Every name in scope, bound to its innermost declaration, in one table:
+   a lookup is one probe however deep the scopes nest. Declaring a name
+   logs the binding it hides, and ending a scope restores the bindings
+   logged since the scope began, so scopes cost nothing to open. */
 class SymbolTable {
    public:
-    void insert(const string& identifier, int value);
-    bool exists(const string& identifier);
+    void new_scope();
+    void end_scope();
+    void insert(Symbol identifier, int value);
+    bool exists(Symbol identifier);
 
    private:
-    unordered_map<string, int> table;
+    struct Binding {
+        int scope;  // the depth of the scope that declared it
+        int value;
+    };
+
+    // A hidden binding, or with identifier NO_SYMBOL where a scope begins
+    struct Undo {
+        Symbol identifier;
+        bool hid;  // false when the name was not in scope before
+        Binding binding;
+    };
+
+    static constexpr Symbol NO_SYMBOL = -1;
+
+    unordered_map<Symbol, Binding> table;
+    vector<Undo> undo;
+    int depth = 0;
 };
 
 class SemanticAnalyzer {
    public:
-    bool analyze(astNode* root);
+    bool analyze(const FlatAst& ast);
+    const string& getError() const { return error; }
 
    private:
-    vector<SymbolTable> symbol_tables;
+    const FlatAst* ast = nullptr;
+    string error;
+    SymbolTable symbols;
 
     void new_scope();
     void end_scope();
-    void insert(const string& identifier, int value = 0);
-    bool exists(const string& identifier);
-    void traverse(astNode* node);
+    void insert(Symbol identifier, int value = 0);
+    bool exists(Symbol identifier);
+    void traverse(int32_t node);
 };
 
-void yyerror(const char*);
-bool runParser(const char* filename);
-bool runSemanticAnalysis(bool cleanup);
+astNode* runParser(const char* filename, string* diagnostics = nullptr);
+bool runSemanticAnalysis(const FlatAst& ast, string* diagnostics = nullptr);
+bool runSemanticAnalysis(astNode* root, bool cleanup, string* diagnostics = nullptr);
 
 #endif  // SEMANTIC_H
\ No newline at end of file
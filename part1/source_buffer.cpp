@@ -0,0 +1,117 @@
+#include "source_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// yy_scan_buffer needs two NULs after the text
+static const size_t PADDING = 2;
+
+SourceBuffer::SourceBuffer() : base(nullptr), length(0), capacity(0), mapped(false) {
+}
+
+SourceBuffer::~SourceBuffer() {
+    clear();
+}
+
+void SourceBuffer::clear() {
+    if (mapped) {
+        munmap(base, capacity);
+    } else {
+        free(base);
+    }
+    base = nullptr;
+    length = capacity = 0;
+    mapped = false;
+}
+
+/* Returns false when the file cannot be opened or read. */
+bool SourceBuffer::map(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    bool ok = read(fd);
+    close(fd);
+    return ok;
+}
+
+/* Takes everything up to end of file from fd, e.g. stdin. A regular file
+   read from its start is mapped; anything else is read into memory. */
+bool SourceBuffer::read(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        return mapFile(fd, st.st_size);
+    }
+    return readAll(fd);
+}
+
+/* The file is mapped over an anonymous reservation one padding longer than
+   it, so the bytes after the end are zero even when the file fills its last
+   page exactly. */
+bool SourceBuffer::mapFile(int fd, size_t fileSize) {
+    clear();
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t total = (fileSize + PADDING + page - 1) / page * page;
+    void* reserved = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) return readAll(fd);
+
+    void* text = mmap(reserved, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (text == MAP_FAILED) {
+        munmap(reserved, total);
+        return readAll(fd);
+    }
+
+    base = (char*)text;
+    length = fileSize;
+    capacity = total;
+    mapped = true;
+    return true;
+}
+
+bool SourceBuffer::readAll(int fd) {
+    clear();
+
+    size_t used = 0;
+    for (;;) {
+        if (capacity - used < PADDING + 1) {
+            size_t grown = capacity ? capacity * 2 : 65536;
+            char* bigger = (char*)realloc(base, grown);
+            if (!bigger) return false;
+            base = bigger;
+            capacity = grown;
+        }
+        ssize_t n = ::read(fd, base + used, capacity - used - PADDING);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        used += n;
+    }
+
+    length = used;
+    memset(base + length, 0, PADDING);
+    return true;
+}
+
+/* Room for length bytes of text the caller fills in, padding already in
+   place. NULL when that much cannot be had, the padding included. */
+char* SourceBuffer::allocate(size_t _length) {
+    clear();
+    if (_length > SIZE_MAX - PADDING) return nullptr;
+    base = (char*)malloc(_length + PADDING);
+    if (!base) return nullptr;
+    length = _length;
+    capacity = _length + PADDING;
+    memset(base + length, 0, PADDING);
+    return base;
+}
+
+void SourceBuffer::assign(const char* data, size_t _length) {
+    if (allocate(_length)) memcpy(base, data, _length);
+}
@@ -0,0 +1,39 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <cstddef>
+#include <string>
+
+/* Source text held without copying it: regular files are mapped
+   privately, pipes and sockets are read into memory. The text is writable
+   and followed by two NUL bytes, the way flex's yy_scan_buffer wants it for
+   scanning in place; the scanner in scanner.h needs neither, but the flex
+   one still runs this way in bench/lexer_throughput. */
+class SourceBuffer {
+   public:
+    SourceBuffer();
+    ~SourceBuffer();
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    bool map(const char* filename);
+    bool read(int fd);
+    char* allocate(size_t length);
+    void assign(const char* data, size_t length);
+    void clear();
+
+    char* data() { return base; }
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+   private:
+    bool mapFile(int fd, size_t fileSize);
+    bool readAll(int fd);
+
+    char* base;
+    size_t length;
+    size_t capacity;  // bytes allocated or mapped, padding included
+    bool mapped;
+};
+
+#endif  // SOURCE_BUFFER_H
@@ -0,0 +1,143 @@
+#include "symbols.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// Names are copied into chunks of this size, longer ones get their own
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+static const int FIRST_SEGMENT_BITS = 10;
+static const size_t FIRST_SEGMENT = 1 << FIRST_SEGMENT_BITS;
+static const size_t FIRST_TABLE = 4096;
+
+/* FNV-1a; identifiers are short enough that a byte at a time is fine. */
+static uint64_t hashName(const char* text, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)text[i]) * 1099511628211ull;
+    return hash;
+}
+
+/* The low bits of FNV-1a are weak, so the index mixes in the high ones. */
+static inline size_t slotIndex(uint64_t hash) {
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+static void locate(Symbol symbol, int& segment, size_t& offset) {
+    size_t n = (size_t)symbol + FIRST_SEGMENT;
+    int top = 63 - __builtin_clzll(n);
+    segment = top - FIRST_SEGMENT_BITS;
+    offset = n - ((size_t)1 << top);
+}
+
+Interner::Interner() : count(0), chunkUsed(0), chunkSize(0) {
+    Table* first = new Table{FIRST_TABLE - 1, unique_ptr<atomic<uint64_t>[]>(new atomic<uint64_t>[FIRST_TABLE])};
+    for (size_t i = 0; i < FIRST_TABLE; i++) first->slots[i].store(0, memory_order_relaxed);
+    tables.push_back(first);
+    table.store(first, memory_order_release);
+    for (auto& segment : segments) segment.store(nullptr, memory_order_relaxed);
+}
+
+Interner::~Interner() {
+    for (Table* t : tables) delete t;
+    for (auto& segment : segments) delete[] segment.load(memory_order_relaxed);
+}
+
+/* The ID of the name in the table, or -1 when it is not there. */
+Symbol Interner::find(const Table* t, const char* text, size_t length, uint64_t hash) const {
+    uint64_t tag = hash >> 32;
+    for (size_t i = slotIndex(hash) & t->mask;; i = (i + 1) & t->mask) {
+        uint64_t slot = t->slots[i].load(memory_order_acquire);
+        if (slot == 0) return -1;
+        if ((slot >> 32) != tag) continue;
+        Symbol symbol = (Symbol)(uint32_t)slot - 1;
+        const char* candidate = name(symbol);
+        if (strncmp(candidate, text, length) == 0 && candidate[length] == '\0') return symbol;
+    }
+}
+
+/* Publishes the ID in the table; the name has to be stored first. */
+void Interner::insert(Table* t, uint64_t hash, Symbol symbol) {
+    size_t i = slotIndex(hash) & t->mask;
+    while (t->slots[i].load(memory_order_relaxed) != 0) i = (i + 1) & t->mask;
+    t->slots[i].store((hash >> 32 << 32) | (uint32_t)(symbol + 1), memory_order_release);
+}
+
+/* Copies the name, NUL-terminated, where it never moves. */
+const char* Interner::store(const char* text, size_t length) {
+    if (length + 1 > chunkSize - chunkUsed) {
+        chunkSize = max(CHUNK_SIZE, length + 1);
+        chunks.emplace_back(new char[chunkSize]);
+        chunkUsed = 0;
+    }
+    char* copy = chunks.back().get() + chunkUsed;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    chunkUsed += length + 1;
+    return copy;
+}
+
+Symbol Interner::intern(const char* text, size_t length) {
+    uint64_t hash = hashName(text, length);
+    Symbol symbol = find(table.load(memory_order_acquire), text, length, hash);
+    if (symbol >= 0) return symbol;
+
+    lock_guard<mutex> guard(writeLock);
+    // Someone else may have added it since
+    Table* current = table.load(memory_order_relaxed);
+    symbol = find(current, text, length, hash);
+    if (symbol >= 0) return symbol;
+
+    symbol = count.load(memory_order_relaxed);
+    int segment;
+    size_t offset;
+    locate(symbol, segment, offset);
+    const char** names = segments[segment].load(memory_order_relaxed);
+    if (!names) {
+        names = new const char*[FIRST_SEGMENT << segment];
+        segments[segment].store(names, memory_order_release);
+    }
+    names[offset] = store(text, length);
+
+    // Kept at most half full, so probes stay short and always end
+    if ((size_t)(symbol + 1) * 2 > current->mask + 1) {
+        size_t capacity = (current->mask + 1) * 2;
+        Table* grown = new Table{capacity - 1, unique_ptr<atomic<uint64_t>[]>(new atomic<uint64_t>[capacity])};
+        for (size_t i = 0; i < capacity; i++) grown->slots[i].store(0, memory_order_relaxed);
+        for (Symbol old = 0; old < symbol; old++) {
+            const char* oldName = name(old);
+            insert(grown, hashName(oldName, strlen(oldName)), old);
+        }
+        tables.push_back(grown);
+        table.store(grown, memory_order_release);
+        current = grown;
+    }
+    insert(current, hash, symbol);
+    count.store(symbol + 1, memory_order_release);
+    return symbol;
+}
+
+const char* Interner::name(Symbol symbol) const {
+    int segment;
+    size_t offset;
+    locate(symbol, segment, offset);
+    return segments[segment].load(memory_order_acquire)[offset];
+}
+
+Interner& identifiers() {
+    static Interner interner;
+    return interner;
+}
+
+Symbol internSymbol(const char* text, size_t length) {
+    return identifiers().intern(text, length);
+}
+
+Symbol internSymbol(const char* name) {
+    return identifiers().intern(name, strlen(name));
+}
+
+const char* symbolName(Symbol symbol) {
+    return identifiers().name(symbol);
+}
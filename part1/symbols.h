@@ -0,0 +1,67 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* An interned identifier: equal names get equal IDs, dense from 0. */
+typedef int Symbol;
+
+/* Gives every distinct name an ID the first time it is seen and copies it
+   once; later lookups hash it and compare it with one name, nothing else.
+   Names are never removed, so IDs and the names they map back to stay
+   valid as long as the interner. Lookups of known names take no lock, so
+   any number of compilations can intern at once; only new names are
+   serialized. Names must not contain NUL bytes. */
+class Interner {
+   public:
+    Interner();
+    ~Interner();
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    Symbol intern(const char* text, size_t length);
+    const char* name(Symbol symbol) const;
+    int size() const { return count.load(std::memory_order_acquire); }
+
+   private:
+    /* Open addressing with linear probing; a slot holds the upper half of
+       the name's hash and its ID plus one, 0 when empty. A full table is
+       replaced by one twice the size, the old one kept for lookups that
+       may still be probing it. */
+    struct Table {
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    };
+
+    Symbol find(const Table* table, const char* text, size_t length, uint64_t hash) const;
+    void insert(Table* table, uint64_t hash, Symbol symbol);
+    const char* store(const char* text, size_t length);
+
+    std::atomic<Table*> table;
+    std::vector<Table*> tables;  // the current one last
+
+    // Names by ID in segments that never move, segment k holding FIRST_SEGMENT << k of them
+    static const int SEGMENTS = 32;
+    std::atomic<const char**> segments[SEGMENTS];
+    std::atomic<int> count;
+
+    std::mutex writeLock;  // held to add a name
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunkUsed;
+    size_t chunkSize;
+};
+
+/* The interner the whole front end shares; the scanner interns every
+   identifier with it, and the AST and everything after it key on the IDs. */
+Interner& identifiers();
+
+Symbol internSymbol(const char* text, size_t length);
+Symbol internSymbol(const char* name);
+const char* symbolName(Symbol symbol);
+
+#endif  // SYMBOLS_H
@@ -3,153 +3,300 @@
 #include <iostream>
 #include <queue>
 #include <unordered_set>
+#include <vector>
 
-extern astNode* root;
+#include "../llvm_print.h"
+#include "../logging.h"
+#include "../part3/llvm_parser.h"
 
-LLVMModuleRef IRBuilder::buildIR() {
-    module = LLVMModuleCreateWithName("miniC");
+IRBuilder::IRBuilder(LLVMContextRef _context) : context(_context), ast(nullptr) {
+}
+
+LLVMModuleRef IRBuilder::buildIR(const FlatAst& _ast) {
+    ast = &_ast;
+    module = LLVMModuleCreateWithNameInContext("miniC", context);
     LLVMSetTarget(module, "x86_64-pc-linux-gnu");
 
-    LLVMTypeRef printParamTypes[] = {LLVMInt32Type()};
-    LLVMTypeRef printFuncType = LLVMFunctionType(LLVMVoidType(), printParamTypes, 1, 0);
+    LLVMTypeRef printParamTypes[] = {LLVMInt32TypeInContext(context)};
+    LLVMTypeRef printFuncType = LLVMFunctionType(LLVMVoidTypeInContext(context), printParamTypes, 1, 0);
     LLVMAddFunction(module, "print", printFuncType);
 
-    LLVMTypeRef readFuncType = LLVMFunctionType(LLVMInt32Type(), nullptr, 0, 0);
+    LLVMTypeRef readFuncType = LLVMFunctionType(LLVMInt32TypeInContext(context), nullptr, 0, 0);
     LLVMAddFunction(module, "read", readFuncType);
 
     // Traverse the AST and build the LLVM IR
-    if (root && root->type == ast_prog) {
-        buildFunction(root->prog.func);
+    if (!ast->empty() && ast->kind(ast->root()) == flat_prog) {
+        buildFunction(ast->func());
     }
 
-    freeNode(root);
-
     return module;
 }
 
-void IRBuilder::buildFunction(astNode* func_node) {
-    if (!func_node || func_node->type != ast_func) return;
+void IRBuilder::buildFunction(int32_t func_node) {
+    if (func_node == FlatAst::NO_NODE || ast->kind(func_node) != flat_func) return;
 
-    LLVMTypeRef paramTypes[] = {LLVMInt32Type()};
-    LLVMTypeRef funcType = LLVMFunctionType(LLVMInt32Type(), paramTypes, 1, 0);
-    LLVMValueRef func = LLVMAddFunction(module, func_node->func.name, funcType);
+    int32_t param_node = ast->param(func_node);
+    LLVMTypeRef paramTypes[] = {LLVMInt32TypeInContext(context)};
+    LLVMTypeRef funcType = LLVMFunctionType(LLVMInt32TypeInContext(context), paramTypes, param_node != FlatAst::NO_NODE ? 1 : 0, 0);
+    LLVMValueRef func = LLVMAddFunction(module, symbolName(ast->name(func_node)), funcType);
 
-    LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(func, "entry");
+    LLVMBasicBlockRef entryBB = LLVMAppendBasicBlockInContext(context, func, "entry");
 
-    builder = LLVMCreateBuilder();
+    builder = LLVMCreateBuilderInContext(context);
     LLVMPositionBuilderAtEnd(builder, entryBB);
 
-    unordered_map<string, LLVMValueRef> var_map;
-
-    LLVMValueRef param = LLVMGetParam(func, 0);
-    LLVMValueRef paramAlloca = LLVMBuildAlloca(builder, LLVMInt32Type(), "p");
-    LLVMBuildStore(builder, param, paramAlloca);
-    var_map[func_node->func.param->var.name] = paramAlloca;
+    unordered_map<Symbol, LLVMValueRef> var_map;
 
-    for (astNode* stmt : *func_node->func.body->stmt.block.stmt_list) {
-        if (stmt->type == ast_stmt && stmt->stmt.type == ast_decl) {
-            LLVMValueRef alloca = LLVMBuildAlloca(builder, LLVMInt32Type(), stmt->stmt.decl.name);
-            var_map[stmt->stmt.decl.name] = alloca;
-        }
+    if (param_node != FlatAst::NO_NODE) {
+        LLVMValueRef param = LLVMGetParam(func, 0);
+        LLVMValueRef paramAlloca = LLVMBuildAlloca(builder, LLVMInt32TypeInContext(context), "p");
+        LLVMBuildStore(builder, param, paramAlloca);
+        var_map[ast->name(param_node)] = paramAlloca;
     }
 
-    LLVMValueRef retAlloca = LLVMBuildAlloca(builder, LLVMInt32Type(), "ret");
+    declAllocas.assign(ast->size(), nullptr);
+    allocateDecls(ast->body(func_node));
+
+    LLVMValueRef retAlloca = LLVMBuildAlloca(builder, LLVMInt32TypeInContext(context), "ret");
 
-    LLVMBasicBlockRef exitBB = buildStatement(func_node->func.body, var_map, retAlloca);
+    // Every return branches here; the block goes last once the body is built
+    exitBB = LLVMCreateBasicBlockInContext(context, "end");
+    buildStatement(ast->body(func_node), var_map, retAlloca);
+    LLVMBuildBr(builder, exitBB);
 
+    LLVMAppendExistingBasicBlock(func, exitBB);
     LLVMPositionBuilderAtEnd(builder, exitBB);
-    LLVMValueRef retVal = LLVMBuildLoad2(builder, LLVMInt32Type(), retAlloca, "ret_val");
+    LLVMValueRef retVal = LLVMBuildLoad2(builder, LLVMInt32TypeInContext(context), retAlloca, "ret_val");
     LLVMBuildRet(builder, retVal);
 
     removeUnusedBasicBlocks(func);
     LLVMDisposeBuilder(builder);
 }
 
-LLVMBasicBlockRef IRBuilder::buildStatement(astNode* stmt_node, unordered_map<string, LLVMValueRef>& var_map, LLVMValueRef retAlloca) {
-    if (!stmt_node || stmt_node->type != ast_stmt) return nullptr;
-
-    LLVMBasicBlockRef currentBB = LLVMGetInsertBlock(builder);
-
-    switch (stmt_node->stmt.type) {
-        case ast_asgn: {
-            LLVMValueRef rhs = buildExpression(stmt_node->stmt.asgn.rhs, var_map);
-            LLVMValueRef lhs = var_map[stmt_node->stmt.asgn.lhs->var.name];
-            LLVMBuildStore(builder, rhs, lhs);
-            return currentBB;
-        }
-        case ast_ret: {
-            LLVMValueRef retVal = buildExpression(stmt_node->stmt.ret.expr, var_map);
-            LLVMBuildStore(builder, retVal, retAlloca);
-            LLVMBasicBlockRef retBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(currentBB), "end");
-            LLVMBuildBr(builder, retBB);
-            return retBB;
+/* Gives every declaration in the function, nested ones included, an alloca
+   in the entry block, in source order. Blocks bind the names as they are
+   built. */
+void IRBuilder::allocateDecls(int32_t stmt_node) {
+    vector<int32_t> pending(1, stmt_node);
+    auto later = [&pending](int32_t child) {
+        if (child != FlatAst::NO_NODE) pending.push_back(child);
+    };
+
+    while (!pending.empty()) {
+        int32_t node = pending.back();
+        pending.pop_back();
+        if (node == FlatAst::NO_NODE) continue;
+
+        switch (ast->kind(node)) {
+            case flat_decl:
+                declAllocas[node] = LLVMBuildAlloca(builder, LLVMInt32TypeInContext(context), symbolName(ast->name(node)));
+                break;
+            case flat_block: {
+                FlatRange stmts = ast->statements(node);
+                for (int32_t i = stmts.count; i > 0; i--) {
+                    later(stmts.items[i - 1]);
+                }
+                break;
+            }
+            case flat_while:
+                later(ast->body(node));
+                break;
+            case flat_if:
+                later(ast->elseBody(node));
+                later(ast->body(node));
+                break;
+            default:
+                break;
         }
-        case ast_block: {
-            LLVMBasicBlockRef prevBB = currentBB;
-            for (astNode* stmt : *stmt_node->stmt.block.stmt_list) {
-                prevBB = buildStatement(stmt, var_map, retAlloca);
+    }
+}
+
+/* Builds the statement and everything under it on an explicit stack, so a
+   deeply nested body cannot overflow the call stack. Returns the block the
+   builder is left in. */
+LLVMBasicBlockRef IRBuilder::buildStatement(int32_t stmt_node, unordered_map<Symbol, LLVMValueRef>& var_map, LLVMValueRef retAlloca) {
+    if (stmt_node == FlatAst::NO_NODE) return nullptr;
+
+    // Declarations in a block shadow outer names until it ends: var_map holds
+    // the innermost binding of each name, shadowed the bindings a declaration
+    // replaced (nullptr for none) and blockStarts where each open block's entries begin
+    vector<pair<Symbol, LLVMValueRef>> shadowed;
+    vector<size_t> blockStarts;
+
+    vector<StatementTask> pending(1, {stmt_node, 0, nullptr, nullptr});
+    auto later = [&pending](int32_t node) { pending.push_back({node, 0, nullptr, nullptr}); };
+    auto resume = [&pending](const StatementTask& task, LLVMBasicBlockRef first, LLVMBasicBlockRef second) {
+        pending.push_back({task.node, task.step + 1, first, second});
+    };
+
+    while (!pending.empty()) {
+        StatementTask task = pending.back();
+        pending.pop_back();
+        LLVMBasicBlockRef currentBB = LLVMGetInsertBlock(builder);
+
+        switch (ast->kind(task.node)) {
+            case flat_asgn: {
+                LLVMValueRef rhs = buildExpression(ast->rhs(task.node), var_map);
+                LLVMValueRef lhs = var_map[ast->name(ast->lhs(task.node))];
+                LLVMBuildStore(builder, rhs, lhs);
+                break;
+            }
+            case flat_call:
+                buildExpression(task.node, var_map);
+                break;
+            case flat_ret: {
+                LLVMValueRef retVal = buildExpression(ast->expr(task.node), var_map);
+                LLVMBuildStore(builder, retVal, retAlloca);
+                LLVMBuildBr(builder, exitBB);
+                // Anything after the return lands in a block nothing branches to
+                LLVMBasicBlockRef deadBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(currentBB), "after_ret");
+                LLVMPositionBuilderAtEnd(builder, deadBB);
+                break;
+            }
+            case flat_decl: {
+                LLVMValueRef& binding = var_map[ast->name(task.node)];
+                shadowed.push_back({ast->name(task.node), binding});
+                binding = declAllocas[task.node];
+                break;
+            }
+            case flat_block: {
+                if (task.step == 1) {
+                    for (size_t i = shadowed.size(); i > blockStarts.back(); i--) {
+                        const pair<Symbol, LLVMValueRef>& entry = shadowed[i - 1];
+                        if (entry.second) {
+                            var_map[entry.first] = entry.second;
+                        } else {
+                            var_map.erase(entry.first);
+                        }
+                    }
+                    shadowed.resize(blockStarts.back());
+                    blockStarts.pop_back();
+                    break;
+                }
+                blockStarts.push_back(shadowed.size());
+                resume(task, nullptr, nullptr);
+                FlatRange stmts = ast->statements(task.node);
+                for (int32_t i = stmts.count; i > 0; i--) {
+                    later(stmts.items[i - 1]);
+                }
+                break;
             }
-            return prevBB;
+            case flat_while: {
+                // first is the condition's block, second the one after the loop
+                if (task.step == 1) {
+                    LLVMBuildBr(builder, task.first);
+                    LLVMPositionBuilderAtEnd(builder, task.second);
+                    break;
+                }
+                LLVMBasicBlockRef condBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(currentBB), "while_cond");
+                LLVMBuildBr(builder, condBB);
+                LLVMPositionBuilderAtEnd(builder, condBB);
+                LLVMValueRef cond = buildExpression(ast->cond(task.node), var_map);
+                LLVMBasicBlockRef trueBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(condBB), "while_true");
+                LLVMBasicBlockRef falseBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(condBB), "while_false");
+                LLVMBuildCondBr(builder, cond, trueBB, falseBB);
+                LLVMPositionBuilderAtEnd(builder, trueBB);
+
+                resume(task, condBB, falseBB);
+                later(ast->body(task.node));
+                break;
+            }
+            case flat_if: {
+                // first is the else block, second the one both branches join in
+                if (task.step == 1) {
+                    LLVMBuildBr(builder, task.second);
+                    LLVMPositionBuilderAtEnd(builder, task.first);
+                    resume(task, task.first, task.second);
+                    if (ast->elseBody(task.node) != FlatAst::NO_NODE) {
+                        later(ast->elseBody(task.node));
+                    }
+                    break;
+                }
+                if (task.step == 2) {
+                    LLVMBuildBr(builder, task.second);
+                    LLVMPositionBuilderAtEnd(builder, task.second);
+                    break;
+                }
+                LLVMValueRef cond = buildExpression(ast->cond(task.node), var_map);
+                LLVMBasicBlockRef trueBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(currentBB), "if_true");
+                LLVMBasicBlockRef falseBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(currentBB), "if_false");
+                LLVMBasicBlockRef endBB = LLVMAppendBasicBlockInContext(context, LLVMGetBasicBlockParent(currentBB), "if_end");
+                LLVMBuildCondBr(builder, cond, trueBB, falseBB);
+                LLVMPositionBuilderAtEnd(builder, trueBB);
+
+                resume(task, falseBB, endBB);
+                later(ast->body(task.node));
+                break;
+            }
+            default:
+                break;
         }
-        case ast_while: {
-            LLVMBasicBlockRef condBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(currentBB), "while_cond");
-            LLVMBuildBr(builder, condBB);
-            LLVMPositionBuilderAtEnd(builder, condBB);
-            LLVMValueRef cond = buildExpression(stmt_node->stmt.whilen.cond, var_map);
-            LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(condBB), "while_true");
-            LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(condBB), "while_false");
-            LLVMBuildCondBr(builder, cond, trueBB, falseBB);
-            LLVMPositionBuilderAtEnd(builder, trueBB);
-
-            buildStatement(stmt_node->stmt.whilen.body, var_map, retAlloca);
-
-            LLVMBuildBr(builder, condBB);
-            LLVMPositionBuilderAtEnd(builder, falseBB);
-            return falseBB;
+    }
+    return LLVMGetInsertBlock(builder);
+}
+
+/* Builds the expression in post-order on an explicit stack, so long operator
+   chains cannot overflow the call stack. */
+LLVMValueRef IRBuilder::buildExpression(int32_t expr_node, unordered_map<Symbol, LLVMValueRef>& var_map) {
+    if (expr_node == FlatAst::NO_NODE) return nullptr;
+
+    vector<ExpressionTask> pending(1, {expr_node, false});
+    vector<LLVMValueRef> values;
+    while (!pending.empty()) {
+        ExpressionTask task = pending.back();
+        pending.pop_back();
+        if (task.ready) {
+            values.push_back(buildOperation(task.node, values, var_map));
+            continue;
         }
-        case ast_if: {
-            LLVMValueRef cond = buildExpression(stmt_node->stmt.ifn.cond, var_map);
-            LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(currentBB), "if_true");
-            LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(currentBB), "if_false");
-            LLVMBasicBlockRef endBB = LLVMAppendBasicBlock(LLVMGetBasicBlockParent(currentBB), "if_end");
-            LLVMBuildCondBr(builder, cond, trueBB, falseBB);
-
-            LLVMPositionBuilderAtEnd(builder, trueBB);
-            buildStatement(stmt_node->stmt.ifn.if_body, var_map, retAlloca);
-            LLVMBuildBr(builder, endBB);
-
-            LLVMPositionBuilderAtEnd(builder, falseBB);
-            if (stmt_node->stmt.ifn.else_body) {
-                buildStatement(stmt_node->stmt.ifn.else_body, var_map, retAlloca);
-            }
-            LLVMBuildBr(builder, endBB);
 
-            LLVMPositionBuilderAtEnd(builder, endBB);
-            return endBB;
+        // Operands go on last first, so the left one is built first
+        pending.push_back({task.node, true});
+        switch (ast->kind(task.node)) {
+            case flat_uexpr:
+                pending.push_back({ast->expr(task.node), false});
+                break;
+            case flat_bexpr:
+            case flat_rexpr:
+                pending.push_back({ast->rhs(task.node), false});
+                pending.push_back({ast->lhs(task.node), false});
+                break;
+            case flat_call:
+                if (ast->param(task.node) != FlatAst::NO_NODE) {
+                    pending.push_back({ast->param(task.node), false});
+                }
+                break;
+            default:
+                break;
         }
-        default:
-            return nullptr;
     }
+    return values.back();
 }
 
-LLVMValueRef IRBuilder::buildExpression(astNode* expr_node, unordered_map<string, LLVMValueRef>& var_map) {
-    if (!expr_node) return nullptr;
-
-    switch (expr_node->type) {
-        case ast_cnst:
-            return LLVMConstInt(LLVMInt32Type(), expr_node->cnst.value, 0);
-        case ast_var: {
-            LLVMValueRef varAlloca = var_map[expr_node->var.name];
-            return LLVMBuildLoad2(builder, LLVMInt32Type(), varAlloca, "");
+/* Builds one expression node, taking the values of its operands off the
+   top of values. */
+LLVMValueRef IRBuilder::buildOperation(int32_t expr_node, vector<LLVMValueRef>& values, unordered_map<Symbol, LLVMValueRef>& var_map) {
+    auto operand = [&values]() {
+        LLVMValueRef value = values.back();
+        values.pop_back();
+        return value;
+    };
+
+    switch (ast->kind(expr_node)) {
+        case flat_cnst:
+            return LLVMConstInt(LLVMInt32TypeInContext(context), ast->value(expr_node), 0);
+        case flat_var: {
+            LLVMValueRef varAlloca = var_map[ast->name(expr_node)];
+            return LLVMBuildLoad2(builder, LLVMInt32TypeInContext(context), varAlloca, "");
         }
-        case ast_uexpr: {
-            LLVMValueRef operand = buildExpression(expr_node->uexpr.expr, var_map);
-            return LLVMBuildSub(builder, LLVMConstInt(LLVMInt32Type(), 0, 0), operand, "");
+        case flat_uexpr: {
+            LLVMValueRef value = operand();
+            return LLVMBuildSub(builder, LLVMConstInt(LLVMInt32TypeInContext(context), 0, 0), value, "");
         }
-        case ast_bexpr: {
-            LLVMValueRef lhs = buildExpression(expr_node->bexpr.lhs, var_map);
-            LLVMValueRef rhs = buildExpression(expr_node->bexpr.rhs, var_map);
-            switch (expr_node->bexpr.op) {
+        case flat_bexpr: {
+            LLVMValueRef rhs = operand();
+            LLVMValueRef lhs = operand();
+            switch (ast->op(expr_node)) {
                 case add:
                     return LLVMBuildAdd(builder, lhs, rhs, "");
                 case sub:
@@ -162,10 +309,10 @@ LLVMValueRef IRBuilder::buildExpression(astNode* expr_node, unordered_map<string
                     return nullptr;
             }
         }
-        case ast_rexpr: {
-            LLVMValueRef lhs = buildExpression(expr_node->rexpr.lhs, var_map);
-            LLVMValueRef rhs = buildExpression(expr_node->rexpr.rhs, var_map);
-            switch (expr_node->rexpr.op) {
+        case flat_rexpr: {
+            LLVMValueRef rhs = operand();
+            LLVMValueRef lhs = operand();
+            switch (ast->op(expr_node)) {
                 case lt:
                     return LLVMBuildICmp(builder, LLVMIntSLT, lhs, rhs, "");
                 case gt:
@@ -182,6 +329,15 @@ LLVMValueRef IRBuilder::buildExpression(astNode* expr_node, unordered_map<string
                     return nullptr;
             }
         }
+        case flat_call: {
+            LLVMValueRef callee = LLVMGetNamedFunction(module, symbolName(ast->name(expr_node)));
+            LLVMValueRef args[1];
+            unsigned numArgs = 0;
+            if (ast->param(expr_node) != FlatAst::NO_NODE) {
+                args[numArgs++] = operand();
+            }
+            return LLVMBuildCall2(builder, LLVMGlobalGetValueType(callee), callee, args, numArgs, "");
+        }
         default:
             return nullptr;
     }
@@ -212,14 +368,18 @@ void IRBuilder::removeUnusedBasicBlocks(LLVMValueRef func) {
         }
     }
 
-    LLVMBasicBlockRef current = LLVMGetFirstBasicBlock(func);
-    while (current) {
-        LLVMBasicBlockRef next = LLVMGetNextBasicBlock(current);
-        if (visited.find(current) == visited.end()) {
-            LLVMRemoveBasicBlockFromParent(current);
-            LLVMDeleteBasicBlock(current);
-        }
-        current = next;
+    // Unreachable blocks may branch to each other, so their branches go
+    // before any of them is deleted
+    vector<LLVMBasicBlockRef> unreachable;
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        if (visited.find(bb) == visited.end()) unreachable.push_back(bb);
+    }
+    for (LLVMBasicBlockRef bb : unreachable) {
+        LLVMValueRef terminator = LLVMGetBasicBlockTerminator(bb);
+        if (terminator) LLVMInstructionEraseFromParent(terminator);
+    }
+    for (LLVMBasicBlockRef bb : unreachable) {
+        LLVMDeleteBasicBlock(bb);
     }
 }
 
@@ -229,17 +389,21 @@ void printLLVMIR(LLVMModuleRef module) {
     LLVMDisposeMessage(ir);
 }
 
-bool runIRBuilder(const string &filename) {
-    if (root == nullptr) {
-        cerr << "AST root is nullptr. Skipping IR builder." << endl;
-        return false;
+/* Builds the module for the parsed AST and hands it to the caller, who owns it.
+   The AST is left for the caller to free. The IR is only written out when a
+   filename is given, as bitcode for .bc files and as text otherwise. */
+LLVMModuleRef runIRBuilder(const FlatAst& ast, LLVMContextRef context, const char* filename) {
+    if (ast.empty()) {
+        LOG(LogError, LogIRBuilder, "AST is empty. Skipping IR builder.");
+        return nullptr;
     }
 
-    IRBuilder builder;
-    LLVMModuleRef m = builder.buildIR();
-    printLLVMIR(m);
-    LLVMPrintModuleToFile(m, filename.c_str(), nullptr);
-    LLVMDisposeModule(m);
+    IRBuilder builder(context);
+    LLVMModuleRef m = builder.buildIR(ast);
+    LOG(LogDebug, LogIRBuilder, printed(m));
+    if (filename) {
+        writeModule(m, filename);
+    }
 
-    return true;
-}
+    return m;
+}
\ No newline at end of file
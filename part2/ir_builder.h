@@ -5,24 +5,47 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
-#include "../part1/ast.h"
+#include "../part1/flat_ast.h"
 
 class IRBuilder {
    public:
-    LLVMModuleRef buildIR();
+    explicit IRBuilder(LLVMContextRef context);
+    LLVMModuleRef buildIR(const FlatAst& ast);
 
    private:
+    // A statement buildStatement is part way through: statements that hold
+    // others come off its stack again after each part, step telling which
+    struct StatementTask {
+        int32_t node;
+        int step;
+        LLVMBasicBlockRef first;
+        LLVMBasicBlockRef second;
+    };
+
+    // An expression node, ready once its operands' values are built
+    struct ExpressionTask {
+        int32_t node;
+        bool ready;
+    };
+
+    LLVMContextRef context;
     LLVMModuleRef module;
     LLVMBuilderRef builder;
-
-    void buildFunction(astNode* func_node);
-    LLVMBasicBlockRef buildStatement(astNode* stmt_node, std::unordered_map<std::string, LLVMValueRef>& var_map, LLVMValueRef retAlloca);
-    LLVMValueRef buildExpression(astNode* expr_node, std::unordered_map<std::string, LLVMValueRef>& var_map);
+    LLVMBasicBlockRef exitBB;  // the function's single return block
+    const FlatAst* ast;
+    std::vector<LLVMValueRef> declAllocas;  // by node
+
+    void buildFunction(int32_t func_node);
+    void allocateDecls(int32_t stmt_node);
+    LLVMBasicBlockRef buildStatement(int32_t stmt_node, std::unordered_map<Symbol, LLVMValueRef>& var_map, LLVMValueRef retAlloca);
+    LLVMValueRef buildExpression(int32_t expr_node, std::unordered_map<Symbol, LLVMValueRef>& var_map);
+    LLVMValueRef buildOperation(int32_t expr_node, std::vector<LLVMValueRef>& values, std::unordered_map<Symbol, LLVMValueRef>& var_map);
     void removeUnusedBasicBlocks(LLVMValueRef func);
 };
 
 void printLLVMIR(LLVMModuleRef module);
-bool runIRBuilder(const string &filename);
+LLVMModuleRef runIRBuilder(const FlatAst& ast, LLVMContextRef context, const char* filename = nullptr);
 
 #endif  // IR_BUILDER_H
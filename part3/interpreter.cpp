@@ -0,0 +1,278 @@
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "llvm_parser.h"
+
+using namespace std;
+
+static const struct {
+    LLVMOpcode opcode;
+    const char* name;
+} OPCODES[] = {
+    {LLVMAlloca, "alloca"}, {LLVMLoad, "load"}, {LLVMStore, "store"}, {LLVMAdd, "add"},
+    {LLVMSub, "sub"},       {LLVMMul, "mul"},   {LLVMSDiv, "sdiv"},   {LLVMICmp, "icmp"},
+    {LLVMBr, "br"},         {LLVMCall, "call"}, {LLVMRet, "ret"},
+};
+
+// Large enough to index by any LLVMOpcode
+static const int MAX_OPCODE = 128;
+
+Interpreter::Interpreter(const vector<int>& _input, ostream& _output)
+    : input(_input), nextInput(0), output(_output), stepLimit(1000000000), argument(0) {
+}
+
+/* Runs the first function the module defines, which for miniC is the
+   program's only one. */
+bool Interpreter::run(LLVMModuleRef module, int arg, ExecutionCounts& counts) {
+    error.clear();
+    nextInput = 0;
+    counts = ExecutionCounts();
+
+    for (LLVMValueRef function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        if (!LLVMIsDeclaration(function)) return execute(function, arg, counts);
+    }
+    return fail("the module defines no function");
+}
+
+bool Interpreter::execute(LLVMValueRef function, int arg, ExecutionCounts& counts) {
+    values.clear();
+    memory.clear();
+    argument = arg;
+
+    uint64_t opcodeCounts[MAX_OPCODE] = {};
+    unordered_map<LLVMBasicBlockRef, uint64_t> blockCounts;
+    uint64_t steps = 0;
+    bool ok = true, returned = false;
+
+    LLVMBasicBlockRef bb = LLVMGetEntryBasicBlock(function);
+    while (ok && !returned) {
+        blockCounts[bb]++;
+        LLVMBasicBlockRef next = nullptr;
+
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst && ok && !next && !returned;
+             inst = LLVMGetNextInstruction(inst)) {
+            if (++steps > stepLimit) {
+                ok = fail("step limit of " + to_string(stepLimit) + " instructions reached");
+                break;
+            }
+
+            LLVMOpcode opcode = LLVMGetInstructionOpcode(inst);
+            if (opcode < MAX_OPCODE) opcodeCounts[opcode]++;
+
+            switch (opcode) {
+                case LLVMAlloca:
+                    values[inst] = memory.size();
+                    memory.push_back(0);
+                    break;
+                case LLVMLoad:
+                    values[inst] = memory[valueOf(LLVMGetOperand(inst, 0))];
+                    break;
+                case LLVMStore:
+                    memory[valueOf(LLVMGetOperand(inst, 1))] = valueOf(LLVMGetOperand(inst, 0));
+                    break;
+                case LLVMAdd:
+                case LLVMSub:
+                case LLVMMul:
+                case LLVMSDiv: {
+                    // 32-bit wraparound, computed unsigned to stay defined
+                    uint32_t a = valueOf(LLVMGetOperand(inst, 0));
+                    uint32_t b = valueOf(LLVMGetOperand(inst, 1));
+                    if (opcode == LLVMAdd) {
+                        values[inst] = a + b;
+                    } else if (opcode == LLVMSub) {
+                        values[inst] = a - b;
+                    } else if (opcode == LLVMMul) {
+                        values[inst] = a * b;
+                    } else if (b == 0 || (a == 0x80000000u && b == 0xffffffffu)) {
+                        ok = fail("division overflow or by zero");
+                    } else {
+                        values[inst] = (int32_t)a / (int32_t)b;
+                    }
+                    break;
+                }
+                case LLVMICmp: {
+                    int32_t a = valueOf(LLVMGetOperand(inst, 0));
+                    int32_t b = valueOf(LLVMGetOperand(inst, 1));
+                    bool holds = false;
+                    switch (LLVMGetICmpPredicate(inst)) {
+                        case LLVMIntEQ:
+                            holds = a == b;
+                            break;
+                        case LLVMIntNE:
+                            holds = a != b;
+                            break;
+                        case LLVMIntSGT:
+                            holds = a > b;
+                            break;
+                        case LLVMIntSGE:
+                            holds = a >= b;
+                            break;
+                        case LLVMIntSLT:
+                            holds = a < b;
+                            break;
+                        case LLVMIntSLE:
+                            holds = a <= b;
+                            break;
+                        default:
+                            ok = fail("unsupported icmp predicate");
+                            break;
+                    }
+                    values[inst] = holds;
+                    break;
+                }
+                case LLVMBr:
+                    // Successor 0 is the true target of a conditional branch
+                    if (LLVMIsConditional(inst)) {
+                        next = LLVMGetSuccessor(inst, valueOf(LLVMGetCondition(inst)) ? 0 : 1);
+                    } else {
+                        next = LLVMGetSuccessor(inst, 0);
+                    }
+                    break;
+                case LLVMCall: {
+                    int32_t result;
+                    ok = call(inst, result);
+                    if (ok) values[inst] = result;
+                    break;
+                }
+                case LLVMRet:
+                    counts.result = LLVMGetNumOperands(inst) ? valueOf(LLVMGetOperand(inst, 0)) : 0;
+                    returned = true;
+                    break;
+                default: {
+                    char* text = LLVMPrintValueToString(inst);
+                    ok = fail(string("unsupported instruction: ") + text);
+                    LLVMDisposeMessage(text);
+                    break;
+                }
+            }
+        }
+
+        if (ok && !returned) {
+            if (!next) ok = fail("block without a terminator");
+            bb = next;
+        }
+    }
+
+    for (const auto& op : OPCODES) {
+        if (opcodeCounts[op.opcode]) counts.opcodes.push_back({op.name, opcodeCounts[op.opcode]});
+    }
+    int index = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block; block = LLVMGetNextBasicBlock(block), index++) {
+        const char* name = LLVMGetBasicBlockName(block);
+        counts.blocks.push_back({*name ? name : "bb" + to_string(index), blockCounts[block]});
+    }
+    counts.instructions = min(steps, stepLimit);
+    return ok;
+}
+
+/* print and read are the only functions a miniC program can call. */
+bool Interpreter::call(LLVMValueRef inst, int32_t& result) {
+    const char* name = LLVMGetValueName(LLVMGetCalledValue(inst));
+    result = 0;
+    if (strcmp(name, "print") == 0 && LLVMGetNumArgOperands(inst) == 1) {
+        output << valueOf(LLVMGetOperand(inst, 0)) << "\n";
+        return true;
+    }
+    if (strcmp(name, "read") == 0 && LLVMGetNumArgOperands(inst) == 0) {
+        if (nextInput < input.size()) result = input[nextInput++];
+        return true;
+    }
+    return fail(string("call to unknown function ") + name);
+}
+
+int32_t Interpreter::valueOf(LLVMValueRef value) {
+    if (LLVMIsAConstantInt(value)) return (int32_t)LLVMConstIntGetSExtValue(value);
+    if (LLVMIsAArgument(value)) return argument;
+    return values[value];
+}
+
+bool Interpreter::fail(const string& message) {
+    if (error.empty()) error = message;
+    return false;
+}
+
+/* Interprets the module as it is, after each pass on its own and after all
+   of them, and tabulates the dynamic counts side by side. Every variant
+   must print and return what the original does; a difference is reported
+   and makes the profile fail. The module itself is left unchanged. */
+bool profileOptimizer(LLVMModuleRef module, int arg, const vector<int>& input, ostream& report) {
+    static const struct {
+        const char* name;
+        unsigned passes;
+    } VARIANTS[] = {
+        {"before", 0}, {"cse", PassCSE}, {"constfold", PassConstFold},
+        {"dce", PassDCE}, {"constprop", PassConstProp}, {"all", PassAll},
+    };
+    const int NUM_VARIANTS = sizeof(VARIANTS) / sizeof(VARIANTS[0]);
+
+    Optimizer optimizer;
+    vector<ExecutionCounts> counts(NUM_VARIANTS);
+    vector<string> outputs(NUM_VARIANTS);
+    bool ok = true;
+
+    for (int i = 0; i < NUM_VARIANTS; i++) {
+        LLVMModuleRef variant = LLVMCloneModule(module);
+        optimizer.setPasses(VARIANTS[i].passes);
+        if (VARIANTS[i].passes) optimizer.optimize(variant);
+
+        ostringstream output;
+        Interpreter interpreter(input, output);
+        if (!interpreter.run(variant, arg, counts[i])) {
+            report << VARIANTS[i].name << ": " << interpreter.getError() << "\n";
+            ok = false;
+        }
+        outputs[i] = output.str();
+        LLVMDisposeModule(variant);
+
+        if (i > 0 && (outputs[i] != outputs[0] || counts[i].result != counts[0].result)) {
+            report << VARIANTS[i].name << ": the optimized program behaves differently\n";
+            ok = false;
+        }
+    }
+
+    // Rows for every opcode any variant ran, in the interpreter's order
+    vector<string> opcodes;
+    for (const auto& op : OPCODES) {
+        for (const ExecutionCounts& c : counts) {
+            bool ran = false;
+            for (const auto& [name, count] : c.opcodes) ran = ran || name == op.name;
+            if (ran) {
+                opcodes.push_back(op.name);
+                break;
+            }
+        }
+    }
+    auto countOf = [](const ExecutionCounts& c, const string& opcode) -> uint64_t {
+        for (const auto& [name, count] : c.opcodes) {
+            if (name == opcode) return count;
+        }
+        return 0;
+    };
+
+    report << "func(" << arg << ") = " << counts[0].result << "\n";
+    report << left << setw(12) << "opcode" << right;
+    for (const auto& variant : VARIANTS) report << setw(12) << variant.name;
+    report << "\n";
+    for (const string& opcode : opcodes) {
+        report << left << setw(12) << opcode << right;
+        for (const ExecutionCounts& c : counts) report << setw(12) << countOf(c, opcode);
+        report << "\n";
+    }
+    report << left << setw(12) << "total" << right;
+    for (const ExecutionCounts& c : counts) report << setw(12) << c.instructions;
+    report << "\n";
+
+    // The passes leave the control flow graph alone, so the blocks line up
+    const ExecutionCounts& after = counts[NUM_VARIANTS - 1];
+    report << "\n" << left << setw(24) << "block" << right << setw(12) << "before" << setw(12) << "all" << "\n";
+    for (size_t i = 0; i < counts[0].blocks.size(); i++) {
+        report << left << setw(24) << counts[0].blocks[i].first << right << setw(12) << counts[0].blocks[i].second;
+        if (i < after.blocks.size()) report << setw(12) << after.blocks[i].second;
+        report << "\n";
+    }
+    return ok;
+}
@@ -0,0 +1,53 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <llvm-c/Core.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* What one run executed, counted dynamically. */
+struct ExecutionCounts {
+    std::vector<std::pair<std::string, uint64_t>> opcodes;  // the opcodes that ran, in a fixed order
+    std::vector<std::pair<std::string, uint64_t>> blocks;   // every block of the function, in layout order
+    uint64_t instructions = 0;
+    int result = 0;  // what the function returned
+};
+
+/* Executes the IR subset the IR builder produces: alloca, load, store, add,
+   sub, mul, sdiv, icmp, br, calls to print and read, and ret. read takes
+   the next number of the given input, 0 once it runs out, and print writes
+   one number per line to the given stream. Anything else, or running for
+   more than the step limit, stops the run with an error. */
+class Interpreter {
+   public:
+    Interpreter(const std::vector<int>& input, std::ostream& output);
+
+    bool run(LLVMModuleRef module, int arg, ExecutionCounts& counts);
+    void setStepLimit(uint64_t limit) { stepLimit = limit; }
+    const std::string& getError() const { return error; }
+
+   private:
+    bool execute(LLVMValueRef function, int arg, ExecutionCounts& counts);
+    bool call(LLVMValueRef inst, int32_t& result);
+    int32_t valueOf(LLVMValueRef value);
+    bool fail(const std::string& message);
+
+    const std::vector<int>& input;
+    size_t nextInput;
+    std::ostream& output;
+    uint64_t stepLimit;
+    std::string error;
+
+    std::unordered_map<LLVMValueRef, int32_t> values;  // SSA values; allocas hold their slot in memory
+    std::vector<int32_t> memory;
+    int32_t argument;
+};
+
+bool profileOptimizer(LLVMModuleRef module, int arg, const std::vector<int>& input, std::ostream& report);
+
+#endif  // INTERPRETER_H
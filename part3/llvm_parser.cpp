@@ -1,5 +1,7 @@
 #include "llvm_parser.h"
 
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/IRReader.h>
 #include <llvm-c/Types.h>
@@ -8,49 +10,142 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_map>
 #include <vector>
 
+#include "../llvm_print.h"
+#include "../logging.h"
+#include "../time_report.h"
+
 using namespace std;
 
-typedef unordered_map<LLVMBasicBlockRef, set<LLVMValueRef>> BBValueSetMap;
-typedef unordered_map<LLVMBasicBlockRef, vector<LLVMBasicBlockRef>> BBPredMap;
+/* Bitcode starts with "BC" 0xC0DE, or with 0x0B17C0DE when it is wrapped. */
+static bool isBitcode(const char* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    return length >= 4 && ((bytes[0] == 'B' && bytes[1] == 'C' && bytes[2] == 0xC0 && bytes[3] == 0xDE) ||
+                           (bytes[0] == 0xDE && bytes[1] == 0xC0 && bytes[2] == 0x17 && bytes[3] == 0x0B));
+}
+
+/* Parses textual IR or bitcode, whichever the buffer holds, and disposes of the buffer. */
+static LLVMModuleRef parseModuleBuffer(LLVMMemoryBufferRef buffer, const char* name, LLVMContextRef context) {
+    LLVMModuleRef m = NULL;
 
-#define prt(x)             \
-    if (x) {               \
-        printf("%s\n", x); \
+    if (isBitcode(LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer))) {
+        if (LLVMParseBitcodeInContext2(context, buffer, &m)) {
+            LOG(LogError, LogOptimizer, name << ": invalid bitcode");
+            m = NULL;
+        }
+        LLVMDisposeMemoryBuffer(buffer);
+        return m;
     }
 
-/* This function reads the given llvm file and loads the LLVM IR into
-         data-structures that we can works on for optimization phase.
+    // The text parser takes the buffer over
+    char* err = NULL;
+    if (LLVMParseIRInContext(context, buffer, &m, &err)) {
+        LOG(LogError, LogOptimizer, name << ": " << err);
+        LLVMDisposeMessage(err);
+        m = NULL;
+    }
+    return m;
+}
+
+/* This function reads the given llvm file, textual IR or bitcode, and loads
+         the LLVM IR into data-structures that we can works on for optimization phase.
 */
 
-LLVMModuleRef createLLVMModel(const char* filename) {
+LLVMModuleRef createLLVMModel(const char* filename, LLVMContextRef context) {
     char* err = 0;
 
     LLVMMemoryBufferRef ll_f = 0;
-    LLVMModuleRef m = 0;
 
     LLVMCreateMemoryBufferWithContentsOfFile(filename, &ll_f, &err);
 
     if (err != NULL) {
-        prt(err);
+        LOG(LogError, LogOptimizer, filename << ": " << err);
+        LLVMDisposeMessage(err);
         return NULL;
     }
 
-    LLVMParseIRInContext(LLVMGetGlobalContext(), ll_f, &m, &err);
+    return parseModuleBuffer(ll_f, filename, context);
+}
 
-    if (err != NULL) {
-        prt(err);
+/* Same as createLLVMModel for IR that is already in memory. */
+LLVMModuleRef parseModule(const char* data, size_t length, const char* name, LLVMContextRef context) {
+    // The copy is NUL-terminated, which the text parser needs
+    LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy(data, length, name);
+    return parseModuleBuffer(buffer, name, context);
+}
+
+/* Bitcode for .bc files, text for anything else, unless a format is forced. */
+IRFormat irFormatFor(const char* filename, IRFormat format) {
+    if (format != IRAuto) return format;
+    size_t length = strlen(filename);
+    return length >= 3 && strcmp(filename + length - 3, ".bc") == 0 ? IRBitcode : IRText;
+}
+
+bool writeModule(LLVMModuleRef module, const char* filename, IRFormat format) {
+    if (irFormatFor(filename, format) == IRBitcode) {
+        if (LLVMWriteBitcodeToFile(module, filename) != 0) {
+            LOG(LogError, LogOptimizer, "Cannot write " << filename);
+            return false;
+        }
+        return true;
     }
 
-    return m;
+    char* err = NULL;
+    if (LLVMPrintModuleToFile(module, filename, &err)) {
+        LOG(LogError, LogOptimizer, filename << ": " << err);
+        LLVMDisposeMessage(err);
+        return false;
+    }
+    return true;
+}
+
+string serializeModule(LLVMModuleRef module, IRFormat format) {
+    if (format == IRBitcode) {
+        LLVMMemoryBufferRef buffer = LLVMWriteBitcodeToMemoryBuffer(module);
+        string bitcode(LLVMGetBufferStart(buffer), LLVMGetBufferSize(buffer));
+        LLVMDisposeMemoryBuffer(buffer);
+        return bitcode;
+    }
+
+    char* ir = LLVMPrintModuleToString(module);
+    string text(ir);
+    LLVMDisposeMessage(ir);
+    return text;
+}
+
+/* Checks if instA and instB compute the same value from the same operands.
+   Calls, stores, allocas and terminators never do: each one does something
+   of its own besides producing a value. */
+static bool computesSameValue(LLVMValueRef instA, LLVMValueRef instB) {
+    if (LLVMGetInstructionOpcode(instA) != LLVMGetInstructionOpcode(instB) ||
+        LLVMIsACallInst(instA) || LLVMIsAStoreInst(instA) ||
+        LLVMIsAAllocaInst(instA) || LLVMIsATerminatorInst(instA)) {
+        return false;
+    }
+    if (LLVMIsAICmpInst(instA) && LLVMGetICmpPredicate(instA) != LLVMGetICmpPredicate(instB)) {
+        return false;
+    }
+
+    int count = LLVMGetNumOperands(instA);
+    if (count != LLVMGetNumOperands(instB)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (LLVMGetOperand(instA, i) != LLVMGetOperand(instB, i)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /* Checks if the instruction instB can be safely replaced by instA. */
-bool isSafeToReplace(LLVMValueRef instA, LLVMValueRef instB) {
+static bool isSafeToReplace(LLVMValueRef instA, LLVMValueRef instB) {
     if (!LLVMIsALoadInst(instA) && !LLVMIsALoadInst(instB)) {
         return true;
     }
@@ -67,8 +162,9 @@ bool isSafeToReplace(LLVMValueRef instA, LLVMValueRef instB) {
 }
 
 /* Removes the dead code from the basic block. */
-void deadCodeElimination(LLVMBasicBlockRef bb) {
-    printf("Dead code elimination:\n");
+void Optimizer::deadCodeElimination(LLVMBasicBlockRef bb) {
+    TimeScope scope("deadCodeElimination");
+    LOG(LogDebug, LogDCE, "Dead code elimination:");
     LLVMValueRef instIter = LLVMGetFirstInstruction(bb);
     while (instIter) {
         LLVMValueRef nextInst = LLVMGetNextInstruction(instIter);
@@ -77,8 +173,7 @@ void deadCodeElimination(LLVMBasicBlockRef bb) {
             !LLVMIsACallInst(instIter) &&
             !LLVMIsAAllocaInst(instIter) &&
             !LLVMGetFirstUse(instIter)) {
-            LLVMDumpValue(instIter);
-            printf("\n");
+            LOG(LogDebug, LogDCE, printed(instIter));
             LLVMInstructionEraseFromParent(instIter);
         }
         instIter = nextInst;
@@ -86,16 +181,16 @@ void deadCodeElimination(LLVMBasicBlockRef bb) {
 }
 
 /* Performs constant folding on the basic block. */
-void constantFolding(LLVMBasicBlockRef bb) {
-    printf("Constant folding:\n");
+void Optimizer::constantFolding(LLVMBasicBlockRef bb) {
+    TimeScope scope("constantFolding");
+    LOG(LogDebug, LogConstFold, "Constant folding:");
     for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst;
          inst = LLVMGetNextInstruction(inst)) {
         LLVMOpcode op = LLVMGetInstructionOpcode(inst);
         if ((op == LLVMAdd || op == LLVMSub || op == LLVMMul) &&
             LLVMIsConstant(LLVMGetOperand(inst, 0)) &&
             LLVMIsConstant(LLVMGetOperand(inst, 1))) {
-            LLVMDumpValue(inst);
-            printf("\n");
+            LOG(LogDebug, LogConstFold, printed(inst));
 
             LLVMValueRef constOp1 = LLVMGetOperand(inst, 0);
             LLVMValueRef constOp2 = LLVMGetOperand(inst, 1);
@@ -117,41 +212,34 @@ void constantFolding(LLVMBasicBlockRef bb) {
 }
 
 /* Performs common subexpression elimination on the basic block. */
-void commonSubexpressionElimination(LLVMBasicBlockRef bb) {
+void Optimizer::commonSubexpressionElimination(LLVMBasicBlockRef bb) {
+    TimeScope scope("commonSubexpressionElimination");
     for (LLVMValueRef instA = LLVMGetFirstInstruction(bb); instA;
          instA = LLVMGetNextInstruction(instA)) {
         for (LLVMValueRef instB = LLVMGetNextInstruction(instA); instB;
              instB = LLVMGetNextInstruction(instB)) {
-            if (LLVMGetInstructionOpcode(instA) == LLVMGetInstructionOpcode(instB) &&
-                LLVMGetOperand(instA, 0) == LLVMGetOperand(instB, 0) &&
-                LLVMGetOperand(instA, 1) == LLVMGetOperand(instB, 1) &&
-                LLVMGetInstructionOpcode(instA) != LLVMAlloca &&
-                isSafeToReplace(instA, instB)) {
-                printf("Detected common subexpression\n");
-                LLVMDumpValue(instA);
-                printf("\n");
-                LLVMDumpValue(instB);
-                printf("\n");
+            if (computesSameValue(instA, instB) && isSafeToReplace(instA, instB)) {
+                LOG(LogDebug, LogCSE, "Detected common subexpression\n" << printed(instA) << "\n" << printed(instB));
                 LLVMReplaceAllUsesWith(instB, instA);
             }
         }
     }
 }
 
-void localOptimizations(LLVMValueRef function) {
-    printf("Local Optimizations\n");
+void Optimizer::localOptimizations(LLVMValueRef function) {
+    LOG(LogTrace, LogOptimizer, "Local Optimizations");
     for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(function);
          basicBlock;
          basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
-        printf("In basic block\n");
-        commonSubexpressionElimination(basicBlock);
-        constantFolding(basicBlock);
-        deadCodeElimination(basicBlock);
+        LOG(LogTrace, LogOptimizer, "In basic block");
+        if (passes & PassCSE) commonSubexpressionElimination(basicBlock);
+        if (passes & PassConstFold) constantFolding(basicBlock);
+        if (passes & PassDCE) deadCodeElimination(basicBlock);
     }
 }
 
 /* Computes the GEN and KILL sets for each basic block. */
-void computeGenKillSets(LLVMValueRef function, BBValueSetMap& genSets, BBValueSetMap& killSets) {
+static void computeGenKillSets(LLVMValueRef function, BBValueSetMap& genSets, BBValueSetMap& killSets) {
     // Compute the set "S" of all store instructions in the given function
     set<LLVMValueRef> storeSet;
     for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
@@ -194,16 +282,15 @@ void computeGenKillSets(LLVMValueRef function, BBValueSetMap& genSets, BBValueSe
 }
 
 /* Helper function to print a set of LLVM values */
-void printValueSet(const set<LLVMValueRef>& valueSet) {
+void Optimizer::printValueSet(const set<LLVMValueRef>& valueSet) {
+    if (!logEnabled(LogTrace, LogConstProp)) return;
     for (const auto& value : valueSet) {
-        LLVMDumpValue(value);
-        printf(" ");
+        LOG(LogTrace, LogConstProp, printed(value));
     }
-    printf("\n");
 }
 
 /* Computes the IN and OUT sets for each basic block using the GEN and KILL sets. */
-void computeInOutSets(LLVMValueRef function, const BBValueSetMap& genSets, const BBValueSetMap& killSets,
+static void computeInOutSets(LLVMValueRef function, const BBValueSetMap& genSets, const BBValueSetMap& killSets,
                       BBValueSetMap& inSets, BBValueSetMap& outSets, const BBPredMap& predMap) {
     // For each basic block B, set OUT[B] = GEN[B]
     for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
@@ -248,7 +335,7 @@ void computeInOutSets(LLVMValueRef function, const BBValueSetMap& genSets, const
 }
 
 /* Calculates the predecessor map for the given function. */
-BBPredMap calculatePredecessorMap(LLVMValueRef function) {
+static BBPredMap calculatePredecessorMap(LLVMValueRef function) {
     BBPredMap predMap;
 
     for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
@@ -266,8 +353,9 @@ BBPredMap calculatePredecessorMap(LLVMValueRef function) {
 }
 
 /* Performs constant propagation on the given function. */
-bool constantPropagation(LLVMValueRef function, const BBPredMap& predMap) {
-    printf("\nGlobal Optimizations\n");
+bool Optimizer::constantPropagation(LLVMValueRef function, const BBPredMap& predMap) {
+    TimeScope scope("constantPropagation");
+    LOG(LogDebug, LogConstProp, "Global Optimizations");
 
     bool changed = false;
 
@@ -331,10 +419,9 @@ bool constantPropagation(LLVMValueRef function, const BBPredMap& predMap) {
         }
 
         // Delete all the marked load instructions
-        printf("Deleting marked loads:\n");
+        LOG(LogDebug, LogConstProp, "Deleting marked loads:");
         for (LLVMValueRef loadInst : markedLoads) {
-            LLVMDumpValue(loadInst);
-            printf("\n");
+            LOG(LogDebug, LogConstProp, printed(loadInst));
             LLVMInstructionEraseFromParent(loadInst);
         }
     }
@@ -342,44 +429,66 @@ bool constantPropagation(LLVMValueRef function, const BBPredMap& predMap) {
     return changed;
 }
 
-void walkFunctions(LLVMModuleRef module) {
+void Optimizer::walkFunctions(LLVMModuleRef module) {
     for (LLVMValueRef function = LLVMGetFirstFunction(module);
          function;
          function = LLVMGetNextFunction(function)) {
         const char* funcName = LLVMGetValueName(function);
 
-        printf("Function Name: %s\n", funcName);
+        LOG(LogDebug, LogOptimizer, "Function Name: " << funcName);
 
         BBPredMap predMap = calculatePredecessorMap(function);
         bool changed;
         do {
             localOptimizations(function);
-            changed = constantPropagation(function, predMap);
+            changed = (passes & PassConstProp) && constantPropagation(function, predMap);
         } while (changed);
     }
 }
 
-void walkGlobalValues(LLVMModuleRef module) {
+void Optimizer::walkGlobalValues(LLVMModuleRef module) {
     for (LLVMValueRef gVal = LLVMGetFirstGlobal(module);
          gVal;
          gVal = LLVMGetNextGlobal(gVal)) {
         const char* gName = LLVMGetValueName(gVal);
-        printf("Global variable name: %s\n", gName);
+        LOG(LogDebug, LogOptimizer, "Global variable name: " << gName);
     }
 }
 
-void llvm_parse(const char* llFile, const char* outFile) {
-    LLVMModuleRef m = createLLVMModel(llFile);
-
-    if (m != NULL) {
-        // LLVMDumpModule(m);
-        walkGlobalValues(m);
-        walkFunctions(m);
-        LLVMPrintModuleToFile(m, outFile, NULL);
-        LLVMDisposeModule(m);
-    } else {
-        fprintf(stderr, "m is NULL\n");
+Optimizer::Optimizer() : context(LLVMContextCreate()), passes(PassAll) {
+}
+
+Optimizer::~Optimizer() {
+    LLVMContextDispose(context);
+}
+
+/* Loads a .ll or .bc file into this optimizer's context. */
+LLVMModuleRef Optimizer::loadModule(const char* filename) {
+    return createLLVMModel(filename, context);
+}
+
+/* Runs the optimization passes on a module that is already in memory. The
+   module may live in any context, as long as no other thread touches it. */
+void Optimizer::optimize(LLVMModuleRef module) {
+    walkGlobalValues(module);
+    walkFunctions(module);
+}
+
+/* Loads, optimizes and writes out a module; each side may be text or bitcode. */
+bool Optimizer::run(const char* inFile, const char* outFile, IRFormat format) {
+    LLVMModuleRef m = loadModule(inFile);
+    if (m == NULL) {
+        LOG(LogError, LogOptimizer, "Cannot load " << inFile);
+        return false;
     }
 
-    LLVMShutdown();
+    optimize(m);
+    bool written = writeModule(m, outFile, format);
+    LLVMDisposeModule(m);
+    return written;
+}
+
+bool llvm_parse(const char* inFile, const char* outFile, IRFormat format) {
+    Optimizer optimizer;
+    return optimizer.run(inFile, outFile, format);
 }
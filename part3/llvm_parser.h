@@ -1,6 +1,66 @@
 #ifndef LLVM_PARSER_H
 #define LLVM_PARSER_H
 
-void llvm_parse(const char* llFile, const char* outFile);
+#include <llvm-c/Core.h>
 
-#endif // LLVM_PARSER_H
\ No newline at end of file
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::unordered_map<LLVMBasicBlockRef, std::set<LLVMValueRef>> BBValueSetMap;
+typedef std::unordered_map<LLVMBasicBlockRef, std::vector<LLVMBasicBlockRef>> BBPredMap;
+
+/* How a module is stored. IRAuto picks bitcode for .bc files and text for
+   anything else; text is mostly useful for reading the IR. */
+enum IRFormat { IRAuto, IRText, IRBitcode };
+
+/* The optimizer's passes, for running a subset of them. */
+enum OptimizerPass : unsigned {
+    PassCSE = 1u << 0,        // commonSubexpressionElimination
+    PassConstFold = 1u << 1,  // constantFolding
+    PassDCE = 1u << 2,        // deadCodeElimination
+    PassConstProp = 1u << 3,  // constantPropagation
+    PassAll = PassCSE | PassConstFold | PassDCE | PassConstProp
+};
+
+/* An optimizer instance owns the LLVM context it loads modules into, so
+   several instances can run in parallel threads of one process. Pass
+   diagnostics go through the logging subsystem. */
+class Optimizer {
+   public:
+    Optimizer();
+    ~Optimizer();
+    Optimizer(const Optimizer&) = delete;
+    Optimizer& operator=(const Optimizer&) = delete;
+
+    LLVMContextRef getContext() const { return context; }
+    void setPasses(unsigned mask) { passes = mask; }
+
+    LLVMModuleRef loadModule(const char* filename);
+    void optimize(LLVMModuleRef module);
+    bool run(const char* inFile, const char* outFile, IRFormat format = IRAuto);
+
+   private:
+    void deadCodeElimination(LLVMBasicBlockRef bb);
+    void constantFolding(LLVMBasicBlockRef bb);
+    void commonSubexpressionElimination(LLVMBasicBlockRef bb);
+    void localOptimizations(LLVMValueRef function);
+    void printValueSet(const std::set<LLVMValueRef>& valueSet);
+    bool constantPropagation(LLVMValueRef function, const BBPredMap& predMap);
+    void walkFunctions(LLVMModuleRef module);
+    void walkGlobalValues(LLVMModuleRef module);
+
+    LLVMContextRef context;
+    unsigned passes;  // OptimizerPass bits of the passes that run
+};
+
+LLVMModuleRef createLLVMModel(const char* filename, LLVMContextRef context);
+LLVMModuleRef parseModule(const char* data, size_t length, const char* name, LLVMContextRef context);
+IRFormat irFormatFor(const char* filename, IRFormat format = IRAuto);
+bool writeModule(LLVMModuleRef module, const char* filename, IRFormat format = IRAuto);
+std::string serializeModule(LLVMModuleRef module, IRFormat format);
+bool llvm_parse(const char* inFile, const char* outFile, IRFormat format = IRAuto);
+
+#endif // LLVM_PARSER_H
@@ -1,10 +1,74 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <vector>
+#include "interpreter.h"
 #include "llvm_parser.h"
 
+/* The numbers read() returns, from a file or "-" for stdin. */
+static bool readInput(const char* filename, std::vector<int>& input) {
+    std::ifstream file;
+    if (strcmp(filename, "-") != 0) {
+        file.open(filename);
+        if (!file) {
+            std::cerr << "Cannot open " << filename << std::endl;
+            return false;
+        }
+    }
+    std::istream& in = strcmp(filename, "-") == 0 ? std::cin : file;
+    int value;
+    while (in >> value) input.push_back(value);
+    return true;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <testfile>.ll" << std::endl;
+    const char* input = nullptr;
+    const char* output = "test_new.ll";
+    IRFormat format = IRAuto;
+    bool profile = false;
+    int arg = 5;
+    std::vector<int> readValues;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--emit-bc") == 0) {
+            format = IRBitcode;
+        } else if (strcmp(argv[i], "--emit-ll") == 0) {
+            format = IRText;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile = true;
+            arg = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            if (!readInput(argv[++i], readValues)) return 1;
+        } else if (!input && argv[i][0] != '-') {
+            input = argv[i];
+        } else {
+            input = nullptr;
+            break;
+        }
+    }
+
+    if (!input) {
+        std::cerr << "Usage: " << argv[0] << " <testfile>.ll|.bc [-o <output>.ll|.bc] [--emit-ll|--emit-bc]" << std::endl;
+        std::cerr << "       " << argv[0] << " <testfile>.ll|.bc --profile <arg> [--input <file>|-]" << std::endl;
+        std::cerr << "--profile interprets func(<arg>) before and after each pass and prints the dynamic counts;"
+                  << " read() takes its numbers from --input." << std::endl;
+        return 1;
+    }
+
+    if (profile) {
+        LLVMContextRef context = LLVMContextCreate();
+        LLVMModuleRef module = createLLVMModel(input, context);
+        bool profiled = module && profileOptimizer(module, arg, readValues, std::cout);
+        if (module) LLVMDisposeModule(module);
+        LLVMContextDispose(context);
+        LLVMShutdown();
+        return profiled ? 0 : 1;
     }
-    
-    llvm_parse(argv[1], "test_new.ll", true);
-}
\ No newline at end of file
+
+    bool ok = llvm_parse(input, output, format);
+    LLVMShutdown();
+    return ok ? 0 : 1;
+}
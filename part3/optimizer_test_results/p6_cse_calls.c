@@ -0,0 +1,12 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	int b;
+	a = read();
+	b = read();
+	print(a);
+	print(b);
+	return (a - b);
+}
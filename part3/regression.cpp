@@ -0,0 +1,311 @@
+/*
+Runs the optimizer in process over every test module and checks it against
+the golden outputs and a recorded baseline:
+
+    ./regression [-n <iterations>] [--baseline <file>] [--record] [--max-growth <percent>] [--max-slowdown <percent>] [--check-time] [<dir> ...]
+
+Every .ll in the directories, opt_tests and optimizer_test_results by
+default, is parsed once and optimized <iterations> times, 5 by default, each
+time on a fresh copy; each pass keeps its fastest time. The optimized module
+must match <stem>_opt.ll in the same directory, when there is one, except
+for the module ID. The instructions, loads and stores left after optimizing
+must not grow by more than --max-growth percent, 0 by default. A pass more
+than --max-slowdown percent slower, 50 by default, than in the baseline is
+reported but only fails the run with --check-time, since the baseline's
+times come from whatever machine recorded it. --record writes the current
+numbers as the new baseline.
+*/
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../time_report.h"
+#include "llvm_parser.h"
+
+using namespace std;
+
+static const struct {
+    const char* name;
+    const char* path;
+} PASSES[] = {
+    {"CSE", "optimizer/commonSubexpressionElimination"},
+    {"fold", "optimizer/constantFolding"},
+    {"DCE", "optimizer/deadCodeElimination"},
+    {"prop", "optimizer/constantPropagation"},
+};
+static const int NUM_PASSES = sizeof(PASSES) / sizeof(PASSES[0]);
+
+// Differences in pass time below this many microseconds are noise
+static const double MIN_SLOWDOWN_US = 20;
+
+struct Measurement {
+    int instructions = 0;  // before optimizing
+    int optimized = 0;     // after
+    int loads = 0;
+    int stores = 0;
+    double passUs[NUM_PASSES] = {};
+};
+
+static bool hasSuffix(const string& name, const char* suffix) {
+    size_t length = strlen(suffix);
+    return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+/* The test modules in a directory, sorted; _opt.ll files are golden outputs
+   and _note.ll files annotated copies, neither of them tests. */
+static bool listTests(const string& dir, vector<string>& tests) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        cerr << "Cannot open " << dir << endl;
+        return false;
+    }
+    vector<string> names;
+    while (struct dirent* entry = readdir(d)) {
+        string name = entry->d_name;
+        if (hasSuffix(name, ".ll") && !hasSuffix(name, "_opt.ll") && !hasSuffix(name, "_note.ll")) names.push_back(name);
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    for (const string& name : names) tests.push_back(dir + "/" + name);
+    return true;
+}
+
+/* The cfold and p2 goldens were made with the local passes alone, see
+   optimizer_test_results/README. */
+static unsigned passesFor(const string& test) {
+    string name = test.substr(test.find_last_of('/') + 1);
+    if (name.compare(0, 5, "cfold") == 0 || name.compare(0, 3, "p2_") == 0) return PassCSE | PassConstFold | PassDCE;
+    return PassAll;
+}
+
+static void countInstructions(LLVMModuleRef module, int& instructions, int& loads, int& stores) {
+    instructions = loads = stores = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+            for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+                instructions++;
+                if (LLVMGetInstructionOpcode(inst) == LLVMLoad) loads++;
+                if (LLVMGetInstructionOpcode(inst) == LLVMStore) stores++;
+            }
+        }
+    }
+}
+
+/* Everything after the first line, which names the module. */
+static string withoutModuleID(const string& text) {
+    size_t newline = text.find('\n');
+    return newline == string::npos ? "" : text.substr(newline + 1);
+}
+
+static bool readFile(const string& filename, string& contents) {
+    ifstream in(filename);
+    if (!in) return false;
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+/* A baseline is text, one "<test> <instructions> <optimized> <loads>
+   <stores> <pass us> ..." line per test after a comment line. */
+static map<string, Measurement> loadBaseline(const string& filename) {
+    map<string, Measurement> baseline;
+    ifstream in(filename);
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        string test;
+        Measurement m;
+        fields >> test >> m.instructions >> m.optimized >> m.loads >> m.stores;
+        for (double& us : m.passUs) fields >> us;
+        if (fields) baseline[test] = m;
+    }
+    return baseline;
+}
+
+static bool saveBaseline(const string& filename, const vector<pair<string, Measurement>>& results) {
+    ofstream out(filename);
+    out << "# optimizer regression baseline: <test> <instructions> <optimized> <loads> <stores>";
+    for (const auto& pass : PASSES) out << " <" << pass.name << " us>";
+    out << "\n";
+    for (const auto& result : results) {
+        const Measurement& m = result.second;
+        out << result.first << " " << m.instructions << " " << m.optimized << " " << m.loads << " " << m.stores;
+        for (double us : m.passUs) out << " " << fixed << setprecision(1) << us;
+        out << "\n";
+    }
+    return bool(out);
+}
+
+/* Optimizes copies of the module and checks the last one against the
+   golden output, if any. */
+static bool measure(Optimizer& optimizer, LLVMModuleRef module, const string& test, int iterations, Measurement& m,
+                    string& golden) {
+    int loads, stores;
+    countInstructions(module, m.instructions, loads, stores);
+    for (double& us : m.passUs) us = -1;
+
+    optimizer.setPasses(passesFor(test));
+    LLVMModuleRef copy = nullptr;
+    for (int i = 0; i < iterations; i++) {
+        if (copy) LLVMDisposeModule(copy);
+        copy = LLVMCloneModule(module);
+        TimeReport report(false);
+        report.start();
+        {
+            TimeScope scope("optimizer");
+            optimizer.optimize(copy);
+        }
+        report.stop();
+        for (int p = 0; p < NUM_PASSES; p++) {
+            double us = report.costOf(PASSES[p].path).wallNs / 1e3;
+            if (m.passUs[p] < 0 || us < m.passUs[p]) m.passUs[p] = us;
+        }
+    }
+    countInstructions(copy, m.optimized, m.loads, m.stores);
+
+    string expected;
+    string goldenFile = test.substr(0, test.size() - 3) + "_opt.ll";
+    bool ok = true;
+    if (!readFile(goldenFile, expected)) {
+        golden = "-";
+    } else if (withoutModuleID(serializeModule(copy, IRText)) == withoutModuleID(expected)) {
+        golden = "ok";
+    } else {
+        golden = "FAILED";
+        ok = false;
+    }
+    LLVMDisposeModule(copy);
+    return ok;
+}
+
+/* Reports every way the measurement is worse than the baseline; slower
+   passes only count against it when checkTime is set. */
+static bool compare(const string& test, const Measurement& now, const Measurement& then, double maxGrowth,
+                    double maxSlowdown, bool checkTime) {
+    bool ok = true;
+    const struct {
+        const char* what;
+        int now, then;
+    } counts[] = {
+        {"instructions after optimizing", now.optimized, then.optimized},
+        {"loads", now.loads, then.loads},
+        {"stores", now.stores, then.stores},
+    };
+    for (const auto& count : counts) {
+        if (count.now > count.then * (1 + maxGrowth / 100)) {
+            cerr << test << ": REGRESSION, " << count.what << " went from " << count.then << " to " << count.now << endl;
+            ok = false;
+        }
+    }
+    for (int p = 0; p < NUM_PASSES; p++) {
+        double us = now.passUs[p], before = then.passUs[p];
+        if (us > before * (1 + maxSlowdown / 100) && us - before > MIN_SLOWDOWN_US) {
+            cerr << test << (checkTime ? ": REGRESSION, " : ": slower, ") << PASSES[p].name << " took " << fixed
+                 << setprecision(1) << us << " us, " << before << " us in the baseline" << endl;
+            if (checkTime) ok = false;
+        }
+    }
+    return ok;
+}
+
+static void usage(const char* prog) {
+    cerr << "Usage: " << prog << " [-n <iterations>] [--baseline <file>] [--record] [--max-growth <percent>]"
+         << " [--max-slowdown <percent>] [--check-time] [<dir> ...]" << endl;
+}
+
+int main(int argc, char** argv) {
+    vector<string> dirs;
+    string baselineFile = "regression_baseline.txt";
+    bool record = false;
+    bool checkTime = false;
+    int iterations = 5;
+    double maxGrowth = 0, maxSlowdown = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0) {
+            record = true;
+        } else if (strcmp(argv[i], "--max-growth") == 0 && i + 1 < argc) {
+            maxGrowth = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-slowdown") == 0 && i + 1 < argc) {
+            maxSlowdown = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--check-time") == 0) {
+            checkTime = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            dirs.push_back(argv[i]);
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (dirs.empty()) dirs = {"opt_tests", "optimizer_test_results"};
+
+    vector<string> tests;
+    for (const string& dir : dirs) {
+        if (!listTests(dir, tests)) return 1;
+    }
+    map<string, Measurement> baseline = loadBaseline(baselineFile);
+
+    Optimizer optimizer;
+    vector<pair<string, Measurement>> results;
+    int failures = 0;
+    cout << left << setw(44) << "test" << right << setw(7) << "golden" << setw(8) << "instrs" << setw(8) << "after"
+         << setw(7) << "loads" << setw(7) << "stores";
+    for (const auto& pass : PASSES) cout << setw(8) << pass.name;
+    cout << "  (us)" << endl;
+
+    for (const string& test : tests) {
+        LLVMModuleRef module = optimizer.loadModule(test.c_str());
+        if (!module) {
+            cerr << test << ": cannot parse" << endl;
+            failures++;
+            continue;
+        }
+        Measurement m;
+        string golden;
+        bool ok = measure(optimizer, module, test, iterations, m, golden);
+        LLVMDisposeModule(module);
+
+        cout << left << setw(44) << test << right << setw(7) << golden << setw(8) << m.instructions << setw(8)
+             << m.optimized << setw(7) << m.loads << setw(7) << m.stores << fixed << setprecision(1);
+        for (double us : m.passUs) cout << setw(8) << us;
+        cout << endl;
+
+        if (!ok) cerr << test << ": differs from its golden output" << endl;
+        auto then = baseline.find(test);
+        if (then != baseline.end() && !compare(test, m, then->second, maxGrowth, maxSlowdown, checkTime)) ok = false;
+        if (!ok) failures++;
+        results.push_back({test, m});
+    }
+
+    if (record) {
+        if (!saveBaseline(baselineFile, results)) {
+            cerr << "Cannot write " << baselineFile << endl;
+            return 1;
+        }
+        cout << "Recorded " << results.size() << " tests in " << baselineFile << endl;
+    }
+    cout << (failures ? to_string(failures) + " of " + to_string(tests.size()) + " tests failed." : "All tests passed!")
+         << endl;
+    LLVMShutdown();
+    return failures == 0 ? 0 : 1;
+}
@@ -2,17 +2,86 @@
 
 #include <algorithm>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <unordered_set>
 
-using namespace std;
+#include "../llvm_print.h"
+#include "../logging.h"
+#include "../part3/llvm_parser.h"
+#include "../time_report.h"
 
-extern LLVMModuleRef createLLVMModel(const char* inputFilename);
+using namespace std;
 
 const char* AssemblyGenerator::REGS[NUM_REGS] = {"ebx", "ecx", "edx"};
 
+/* An unbound generator; call reset() with a module before generateAssembly(). */
+AssemblyGenerator::AssemblyGenerator()
+    : context(nullptr), module(nullptr), ownsModule(false), sink(nullptr), out(nullptr), profile(nullptr),
+      nextBlock(nullptr) {
+}
+
 AssemblyGenerator::AssemblyGenerator(const char* _inputFilename, const char* _outputFilename)
-    : outputFilename(_outputFilename) {
-    module = createLLVMModel(_inputFilename);
+    : context(LLVMContextCreate()), ownsModule(true), outputFilename(_outputFilename),
+      sink(nullptr), out(nullptr), profile(nullptr), nextBlock(nullptr) {
+    module = createLLVMModel(_inputFilename, context);
+}
+
+/* Generates code for a module already in memory. The caller keeps ownership of it. */
+AssemblyGenerator::AssemblyGenerator(LLVMModuleRef _module, const char* _outputFilename)
+    : context(nullptr), module(_module), ownsModule(false), outputFilename(_outputFilename),
+      sink(nullptr), out(nullptr), profile(nullptr), nextBlock(nullptr) {
+}
+
+AssemblyGenerator::AssemblyGenerator(LLVMModuleRef _module, ostream& _out)
+    : context(nullptr), module(_module), ownsModule(false), sink(&_out), out(nullptr), profile(nullptr),
+      nextBlock(nullptr) {
+}
+
+AssemblyGenerator::~AssemblyGenerator() {
+    releaseModule();
+    if (context) LLVMContextDispose(context);
+}
+
+void AssemblyGenerator::releaseModule() {
+    if (ownsModule && module) {
+        LLVMDisposeModule(module);
+    }
+    module = nullptr;
+    ownsModule = false;
+}
+
+/* Rebinds the generator to another in-memory module so one instance can be
+   reused across a batch of files. */
+void AssemblyGenerator::reset(LLVMModuleRef _module, const char* _outputFilename) {
+    releaseModule();
+    module = _module;
+    outputFilename = _outputFilename ? _outputFilename : "";
+    sink = nullptr;
+    clearMaps();
+}
+
+void AssemblyGenerator::reset(LLVMModuleRef _module, ostream& _out) {
+    releaseModule();
+    module = _module;
+    outputFilename.clear();
+    sink = &_out;
+    clearMaps();
+}
+
+/* Weights the modules generated from now on with profile, or with static
+   use counts again when it is NULL. The caller keeps the profile alive. */
+void AssemblyGenerator::setProfile(const BlockProfile* _profile) {
+    profile = _profile;
+}
+
+void AssemblyGenerator::clearMaps() {
+    instIndex.clear();
+    liveRange.clear();
+    regMap.clear();
+    bbLabels.clear();
+    offsetMap.clear();
+    blockCounts.clear();
 }
 
 void AssemblyGenerator::generateInstIndexMap(LLVMBasicBlockRef bb) {
@@ -25,11 +94,12 @@ void AssemblyGenerator::generateInstIndexMap(LLVMBasicBlockRef bb) {
 }
 
 void AssemblyGenerator::computeLiveness(LLVMBasicBlockRef bb) {
+    TimeScope scope("computeLiveness");
     int count = 0;
     for (auto inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
         if (LLVMIsAAllocaInst(inst)) continue;
 
-        if (LLVMTypeOf(inst) != LLVMVoidType()) {
+        if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind) {
             liveRange[inst].first = count;
         }
 
@@ -42,10 +112,19 @@ void AssemblyGenerator::computeLiveness(LLVMBasicBlockRef bb) {
     }
 }
 
-int AssemblyGenerator::countNumUses(LLVMValueRef value) {
-    int count = 0;
+/* How often a block ran, plus one so code the profile never saw still
+   counts its uses; 1 for every block without a profile. */
+uint64_t AssemblyGenerator::blockWeight(LLVMBasicBlockRef bb) {
+    if (!profile) return 1;
+    auto found = blockCounts.find(bb);
+    return found == blockCounts.end() ? 1 : found->second + 1;
+}
+
+/* Each use counts with the weight of the block it is in. */
+uint64_t AssemblyGenerator::countNumUses(LLVMValueRef value) {
+    uint64_t count = 0;
     for (auto use = LLVMGetFirstUse(value); use; use = LLVMGetNextUse(use)) {
-        count++;
+        count += blockWeight(LLVMGetInstructionParent(LLVMGetUser(use)));
     }
     return count;
 }
@@ -55,11 +134,13 @@ bool AssemblyGenerator::compareUses(LLVMValueRef a, LLVMValueRef b) {
 }
 
 void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
-    bool available[NUM_REGS] = {true};
+    TimeScope scope("regAllocation");
+    bool available[NUM_REGS];
+    fill(available, available + NUM_REGS, true);
     vector<LLVMValueRef> allInst;
 
     for (auto inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
-        if (LLVMIsAAllocaInst(inst) || LLVMTypeOf(inst) == LLVMVoidType()) continue;
+        if (LLVMIsAAllocaInst(inst) || LLVMGetTypeKind(LLVMTypeOf(inst)) == LLVMVoidTypeKind) continue;
         allInst.push_back(inst);
     }
 
@@ -70,9 +151,9 @@ void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
         for (int i = 0; i < LLVMGetNumOperands(inst); i++) {
             auto operand = LLVMGetOperand(inst, i);
             if (LLVMIsAInstruction(operand) && liveRange.count(operand) && regMap.count(operand)) {
-                cout << "Instruction: " << LLVMPrintValueToString(inst) << endl;
-                cout << "Used Instruction:" << LLVMPrintValueToString(operand) << endl;
-                cout << "current index:" << index << " " << "end index:" << liveRange[operand].second << endl;
+                LOG(LogTrace, LogRegAlloc, "Instruction: " << printed(inst) << "\n"
+                                           << "Used Instruction:" << printed(operand) << "\n"
+                                           << "current index:" << index << " " << "end index:" << liveRange[operand].second);
                 if (liveRange[operand].second == index) {
                     int j = -1;
 
@@ -84,7 +165,7 @@ void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
 
                     if (j >= 0) {
                         available[j] = true;
-                        cout << "Freeing " << regMap[operand] << endl;
+                        LOG(LogTrace, LogRegAlloc, "Freeing " << regMap[operand]);
                     }
                 }
             }
@@ -94,7 +175,7 @@ void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
 
         index++;
 
-        if (LLVMTypeOf(inst) == LLVMVoidType()) continue;
+        if (LLVMGetTypeKind(LLVMTypeOf(inst)) == LLVMVoidTypeKind) continue;
 
         int regIndex = -1;
         for (int i = 0; i < NUM_REGS; i++) {
@@ -108,12 +189,17 @@ void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
             available[regIndex] = false;
             regMap[inst] = REGS[regIndex];
         } else {
+            // Spill the cheapest value still holding a register past this
+            // instruction, if it is cheaper than inst; allInst is sorted by cost
             LLVMValueRef spill = nullptr;
+            int current = index - 1;
 
             for (auto i : allInst) {
-                if (compareUses(i, inst)) continue;
-                if (regMap.count(i) && strcmp(regMap[i], "-1")) {
+                if (!compareUses(i, inst)) break;
+                if (liveRange[i].first < current && liveRange[i].second > current && regMap.count(i) &&
+                    strcmp(regMap[i], "-1")) {
                     spill = i;
+                    break;
                 }
             }
 
@@ -124,6 +210,13 @@ void AssemblyGenerator::regAllocation(LLVMBasicBlockRef bb) {
                 regMap[inst] = "-1";
             }
         }
+
+        // A value nobody uses gives its register back right away
+        if (!LLVMGetFirstUse(inst) && strcmp(regMap[inst], "-1")) {
+            for (int i = 0; i < NUM_REGS; i++) {
+                if (strcmp(REGS[i], regMap[inst]) == 0) available[i] = true;
+            }
+        }
     }
 }
 
@@ -135,16 +228,20 @@ void AssemblyGenerator::createBBLabels(LLVMValueRef function) {
 }
 
 void AssemblyGenerator::printDirectives(LLVMValueRef function, int offset) {
-    cout << LLVMGetValueName(function) << ":\n";
-    cout << bbLabels[LLVMGetFirstBasicBlock(function)] << ":" << endl;
-    cout << "\tpushl\t%ebp\n";
-    cout << "\tmovl\t%esp, %ebp\n";
-    cout << "\tsubl\t$" << offset << ", %esp\n";
+    *out << LLVMGetValueName(function) << ":\n";
+    *out << bbLabels[LLVMGetFirstBasicBlock(function)] << ":" << endl;
+    *out << "\tpushl\t%ebp\n";
+    *out << "\tmovl\t%esp, %ebp\n";
+    *out << "\tpushl\t%ebx\n";
+    *out << "\tsubl\t$" << offset << ", %esp\n";
 }
 
+/* -4(%ebp) holds the caller's ebx, which cdecl has the callee preserve;
+   allocas and spill slots go below it. Returns the bytes to allocate on
+   top of that push. */
 int AssemblyGenerator::getOffsetMap(LLVMValueRef function) {
-    int localMem = 0;
     const int SIZE = 4;
+    int localMem = SIZE;
     for (auto bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
         for (auto inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
             if (LLVMIsAAllocaInst(inst)) {
@@ -152,33 +249,78 @@ int AssemblyGenerator::getOffsetMap(LLVMValueRef function) {
             }
         }
     }
-    for (const auto& [key, value] : regMap) {
-        if (!strcmp(value, "-1")) {
-            offsetMap[key] = -(localMem += SIZE);
+    // Spill slots follow program order; walking regMap would order them by
+    // pointer value and make the output depend on heap layout.
+    for (auto bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (auto inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+            auto reg = regMap.find(inst);
+            if (reg != regMap.end() && !strcmp(reg->second, "-1")) {
+                offsetMap[inst] = -(localMem += SIZE);
+            }
         }
     }
     return localMem - SIZE;
 }
 
 void AssemblyGenerator::codeGeneration() {
-    cout << "\t.text\n";
-    cout << "\t.globl\tfunc\n";
-    cout << "\t.type\tfunc, @function\n";
+    TimeScope scope("codeGeneration");
+    *out << "\t.text\n";
+    *out << "\t.globl\tfunc\n";
+    *out << "\t.type\tfunc, @function\n";
 
     for (auto function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
         int offset = getOffsetMap(function);
         printDirectives(function, offset);
         generateFunctionCode(function);
     }
 }
 
-void AssemblyGenerator::generateFunctionCode(LLVMValueRef function) {
+/* Without a profile blocks keep their IR order. With one, every block is
+   followed by its hottest successor not placed yet, or when there is none
+   by the hottest block left, so the path the program took most falls
+   through. The entry block stays first. */
+vector<LLVMBasicBlockRef> AssemblyGenerator::blockLayout(LLVMValueRef function) {
+    vector<LLVMBasicBlockRef> blocks;
     for (auto bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
-        if (bb != LLVMGetFirstBasicBlock(function)) {
-            cout << bbLabels[bb] << ":" << endl;
+        blocks.push_back(bb);
+    }
+    if (!profile || blocks.empty()) return blocks;
+
+    vector<LLVMBasicBlockRef> layout;
+    unordered_set<LLVMBasicBlockRef> placed;
+    for (LLVMBasicBlockRef bb = blocks[0]; bb;) {
+        layout.push_back(bb);
+        placed.insert(bb);
+
+        // Ties go to the earlier successor, the true target of a branch
+        LLVMBasicBlockRef next = nullptr;
+        LLVMValueRef terminator = LLVMGetBasicBlockTerminator(bb);
+        unsigned numSuccessors = terminator ? LLVMGetNumSuccessors(terminator) : 0;
+        for (unsigned i = 0; i < numSuccessors; i++) {
+            LLVMBasicBlockRef successor = LLVMGetSuccessor(terminator, i);
+            if (!placed.count(successor) && (!next || blockWeight(successor) > blockWeight(next))) next = successor;
         }
-        generateBasicBlockCode(bb);
+        if (!next) {
+            for (LLVMBasicBlockRef candidate : blocks) {
+                if (!placed.count(candidate) && (!next || blockWeight(candidate) > blockWeight(next))) next = candidate;
+            }
+        }
+        bb = next;
     }
+    return layout;
+}
+
+void AssemblyGenerator::generateFunctionCode(LLVMValueRef function) {
+    vector<LLVMBasicBlockRef> layout = blockLayout(function);
+    for (size_t i = 0; i < layout.size(); i++) {
+        if (i > 0) {
+            *out << bbLabels[layout[i]] << ":" << endl;
+        }
+        nextBlock = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+        generateBasicBlockCode(layout[i]);
+    }
+    nextBlock = nullptr;
 }
 
 void AssemblyGenerator::generateBasicBlockCode(LLVMBasicBlockRef bb) {
@@ -206,124 +348,153 @@ void AssemblyGenerator::generateInstructionCode(LLVMValueRef inst) {
 }
 
 void AssemblyGenerator::generateReturnCode(LLVMValueRef inst) {
-    auto operand = LLVMGetOperand(inst, 0);
-    if (LLVMIsAConstant(operand)) {
-        cout << "\tmovl\t$" << LLVMConstIntGetSExtValue(operand) << ", %eax\n";
-    } else if (offsetMap.count(operand)) {
-        cout << "\tmovl\t" << offsetMap[operand] << "(%ebp), %eax\n";
-    } else {
-        cout << "\tmovl\t%" << regMap[operand] << ", %eax\n";
+    if (LLVMGetNumOperands(inst) > 0) {
+        *out << "\tmovl\t" << location(LLVMGetOperand(inst, 0)) << ", %eax\n";
     }
-    cout << "\tleave\n";
-    cout << "\tret\n";
+    *out << "\tmovl\t-4(%ebp), %ebx\n";
+    *out << "\tleave\n";
+    *out << "\tret\n";
 }
 
 void AssemblyGenerator::generateLoadCode(LLVMValueRef inst) {
     auto dst = inst;
     auto src = LLVMGetOperand(inst, 0);
     if (strcmp(regMap[dst], "-1")) {
-        cout << "\tmovl\t" << offsetMap[src] << "(%ebp), %" << regMap[dst] << endl;
+        *out << "\tmovl\t" << offsetMap[src] << "(%ebp), %" << regMap[dst] << endl;
+    } else {
+        *out << "\tmovl\t" << offsetMap[src] << "(%ebp), %eax\n";
+        *out << "\tmovl\t%eax, " << offsetMap[dst] << "(%ebp)\n";
     }
 }
 
 void AssemblyGenerator::generateStoreCode(LLVMValueRef inst) {
     auto src = LLVMGetOperand(inst, 0);
     auto dst = LLVMGetOperand(inst, 1);
-    if (!LLVMIsAArgument(src)) {
-        if (LLVMIsAConstant(src)) {
-            cout << "\tmovl\t$" << LLVMConstIntGetZExtValue(src) << ", " << offsetMap[dst] << "(%ebp)\n";
-        } else {
-            if (strcmp(regMap[src], "-1")) {
-                cout << "\tmovl\t%" << regMap[src] << ", " << offsetMap[dst] << "(%ebp)\n";
-            } else {
-                cout << "\tmovl\t" << offsetMap[src] << "(%ebp), %eax\n";
-                cout << "\tmovl\t%eax, " << offsetMap[dst] << "(%ebp)\n";
-            }
-        }
+    string from = location(src);
+    if (from[0] == '$' || from[0] == '%') {
+        *out << "\tmovl\t" << from << ", " << offsetMap[dst] << "(%ebp)\n";
+    } else {
+        // Memory to memory, the parameter included, goes through eax
+        *out << "\tmovl\t" << from << ", %eax\n";
+        *out << "\tmovl\t%eax, " << offsetMap[dst] << "(%ebp)\n";
     }
 }
 
 void AssemblyGenerator::generateCallCode(LLVMValueRef inst) {
-    cout << "\tpushl\t%ebx\n\tpushl\t%ecx\n\tpushl\t%edx\n";
+    *out << "\tpushl\t%ebx\n\tpushl\t%ecx\n\tpushl\t%edx\n";
 
     auto func = LLVMGetCalledValue(inst);
-    int numArgs = LLVMCountParams(func);
+    int numArgs = LLVMGetNumArgOperands(inst);
     for (int i = numArgs - 1; i >= 0; i--) {
-        auto P = LLVMGetParam(func, i);
-        if (LLVMIsAConstant(P)) {
-            cout << "\tpushl\t$" << LLVMConstIntGetZExtValue(P) << endl;
-        } else if (strcmp(regMap[P], "-1")) {
-            cout << "\tpushl\t%" << regMap[P] << endl;
+        auto arg = LLVMGetOperand(inst, i);
+        if (LLVMIsAConstant(arg)) {
+            *out << "\tpushl\t$" << LLVMConstIntGetSExtValue(arg) << endl;
+        } else if (regMap.count(arg) && strcmp(regMap[arg], "-1")) {
+            *out << "\tpushl\t%" << regMap[arg] << endl;
         } else {
-            cout << "\tpushl\t" << offsetMap[P] << "(%ebp)\n";
+            *out << "\tpushl\t" << offsetMap[arg] << "(%ebp)\n";
         }
     }
 
-    cout << "\tcall\t" << LLVMGetValueName(func) << endl;
+    *out << "\tcall\t" << LLVMGetValueName(func) << endl;
 
     if (numArgs > 0) {
-        cout << "\taddl\t$" << numArgs * 4 << ", %esp\n";
+        *out << "\taddl\t$" << numArgs * 4 << ", %esp\n";
     }
 
-    cout << "\tpopl\t%edx\n\tpopl\t%ecx\n\tpopl\t%ebx\n";
+    *out << "\tpopl\t%edx\n\tpopl\t%ecx\n\tpopl\t%ebx\n";
 
-    if (LLVMGetInstructionCallConv(inst) == LLVMCCallConv) {
+    if (LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind) {
         if (strcmp(regMap[inst], "-1")) {
-            cout << "\tmovl\t%eax, %" << regMap[inst] << endl;
+            *out << "\tmovl\t%eax, %" << regMap[inst] << endl;
         } else {
-            cout << "\tmovl\t%eax, " << offsetMap[inst] << "(%ebp)\n";
+            *out << "\tmovl\t%eax, " << offsetMap[inst] << "(%ebp)\n";
         }
     }
 }
 
+static const char* jumpIf(LLVMIntPredicate predicate) {
+    switch (predicate) {
+        case LLVMIntEQ:
+            return "je";
+        case LLVMIntNE:
+            return "jne";
+        case LLVMIntSGT:
+            return "jg";
+        case LLVMIntSGE:
+            return "jge";
+        case LLVMIntSLT:
+            return "jl";
+        default:
+            return "jle";
+    }
+}
+
+static LLVMIntPredicate negated(LLVMIntPredicate predicate) {
+    switch (predicate) {
+        case LLVMIntEQ:
+            return LLVMIntNE;
+        case LLVMIntNE:
+            return LLVMIntEQ;
+        case LLVMIntSGT:
+            return LLVMIntSLE;
+        case LLVMIntSGE:
+            return LLVMIntSLT;
+        case LLVMIntSLT:
+            return LLVMIntSGE;
+        default:
+            return LLVMIntSGT;
+    }
+}
+
+/* Jumps to the block laid out next are left out; when the true target is
+   next, the condition is negated so the branch falls through into it. */
 void AssemblyGenerator::generateBranchCode(LLVMValueRef inst) {
-    unsigned numOperands = LLVMGetNumOperands(inst);
-    if (numOperands == 1) {
-        auto bb = LLVMValueAsBasicBlock(LLVMGetOperand(inst, 0));
-        cout << "\tjmp " << bbLabels[bb] << endl;
-    } else if (numOperands == 3) {
-        auto bb1 = LLVMValueAsBasicBlock(LLVMGetOperand(inst, 1));
-        auto bb2 = LLVMValueAsBasicBlock(LLVMGetOperand(inst, 2));
-        auto cond = LLVMGetOperand(inst, 0);
-        auto T = LLVMGetICmpPredicate(cond);
-        switch (T) {
-            case LLVMIntEQ:
-                cout << "\tje " << bbLabels[bb1] << endl;
-                break;
-            case LLVMIntNE:
-                cout << "\tjne " << bbLabels[bb1] << endl;
-                break;
-            case LLVMIntSGT:
-                cout << "\tjg " << bbLabels[bb1] << endl;
-                break;
-            case LLVMIntSGE:
-                cout << "\tjge " << bbLabels[bb1] << endl;
-                break;
-            case LLVMIntSLT:
-                cout << "\tjl " << bbLabels[bb1] << endl;
-                break;
-            case LLVMIntSLE:
-                cout << "\tjle " << bbLabels[bb1] << endl;
-                break;
-            default:
-                break;
+    LLVMBasicBlockRef target;
+    if (!LLVMIsConditional(inst)) {
+        target = LLVMGetSuccessor(inst, 0);
+    } else if (LLVMIsAConstantInt(LLVMGetCondition(inst))) {
+        // A condition the optimizer folded picks its target now
+        target = LLVMGetSuccessor(inst, LLVMConstIntGetZExtValue(LLVMGetCondition(inst)) ? 0 : 1);
+    } else {
+        // Successor 0 is taken when the condition holds
+        auto taken = LLVMGetSuccessor(inst, 0);
+        target = LLVMGetSuccessor(inst, 1);
+        auto predicate = LLVMGetICmpPredicate(LLVMGetCondition(inst));
+        if (taken == nextBlock) {
+            swap(taken, target);
+            predicate = negated(predicate);
         }
-        cout << "\tjmp " << bbLabels[bb2] << endl;
+        *out << "\t" << jumpIf(predicate) << " " << bbLabels[taken] << endl;
+    }
+    if (target != nextBlock) {
+        *out << "\tjmp " << bbLabels[target] << endl;
     }
 }
 
+/* Where an operand lives: an immediate, a register, a stack slot, or for
+   the parameter the caller's stack above the return address. */
+string AssemblyGenerator::location(LLVMValueRef value) {
+    if (LLVMIsAConstantInt(value)) return "$" + to_string(LLVMConstIntGetSExtValue(value));
+    if (LLVMIsAArgument(value)) return "8(%ebp)";
+    auto reg = regMap.find(value);
+    if (reg != regMap.end() && strcmp(reg->second, "-1")) return "%" + string(reg->second);
+    return to_string(offsetMap[value]) + "(%ebp)";
+}
+
 void AssemblyGenerator::generateArithmeticCode(LLVMValueRef inst) {
     auto opcode = LLVMGetInstructionOpcode(inst);
-    if (opcode == LLVMAdd || opcode == LLVMICmp || opcode == LLVMSub || opcode == LLVMMul) {
+    if (opcode == LLVMSDiv) {
+        generateDivisionCode(inst);
+    } else if (opcode == LLVMAdd || opcode == LLVMICmp || opcode == LLVMSub || opcode == LLVMMul) {
         string X = (strcmp(regMap[inst], "-1")) ? "%" + string(regMap[inst]) : "%eax";
         auto A = LLVMGetOperand(inst, 0);
         auto B = LLVMGetOperand(inst, 1);
-        if (LLVMIsConstant(A)) {
-            cout << "\tmovl\t$" << LLVMConstIntGetSExtValue(A) << ", " << X << endl;
-        } else if (strcmp(regMap[A], "-1")) {
-            cout << "\tmovl\t%" << regMap[A] << ", " << X << endl;
-        } else if (offsetMap.count(A)) {
-            cout << "\tmovl\t" << offsetMap[A] << "(%ebp), " << X << endl;
+        // inst may have taken over B's register as B died; loading A into it
+        // would overwrite B, so the work happens in eax instead
+        string work = (location(B) == X && location(A) != X) ? "%eax" : X;
+        if (location(A) != work) {
+            *out << "\tmovl\t" << location(A) << ", " << work << endl;
         }
         string op;
         switch (opcode) {
@@ -342,57 +513,92 @@ void AssemblyGenerator::generateArithmeticCode(LLVMValueRef inst) {
             default:
                 break;
         }
-        if (LLVMIsConstant(B)) {
-            cout << op << "$" << LLVMConstIntGetSExtValue(B) << ", " << X << endl;
-        } else if (strcmp(regMap[B], "-1")) {
-            cout << op << "%" << regMap[B] << ", " << X << endl;
-        } else if (offsetMap.count(B)) {
-            cout << op << offsetMap[B] << "(%ebp), " << X << endl;
+        *out << op << location(B) << ", " << work << endl;
+        if (work != X && opcode != LLVMICmp) {
+            *out << "\tmovl\t" << work << ", " << X << endl;
         }
         if (offsetMap.count(inst)) {
-            cout << "\tmovl\t%eax, " << offsetMap[inst] << "(%ebp)\n";
+            *out << "\tmovl\t%eax, " << offsetMap[inst] << "(%ebp)\n";
         }
     }
 }
 
+/* idivl divides edx:eax and overwrites edx, which may hold a live value, so
+   edx is saved around it. The divisor cannot be an immediate; a constant
+   one, like one that was in edx, is read from the stack. */
+void AssemblyGenerator::generateDivisionCode(LLVMValueRef inst) {
+    auto A = LLVMGetOperand(inst, 0);
+    auto B = LLVMGetOperand(inst, 1);
+    string divisor = location(B);
+
+    *out << "\tmovl\t" << location(A) << ", %eax\n";
+    *out << "\tpushl\t%edx\n";
+    if (LLVMIsAConstantInt(B)) {
+        *out << "\tpushl\t" << divisor << endl;
+        divisor = "(%esp)";
+    } else if (divisor == "%edx") {
+        divisor = "(%esp)";
+    }
+    *out << "\tcltd\n";
+    *out << "\tidivl\t" << divisor << endl;
+    if (LLVMIsAConstantInt(B)) {
+        *out << "\taddl\t$4, %esp\n";
+    }
+    *out << "\tpopl\t%edx\n";
+    *out << "\tmovl\t%eax, " << location(inst) << endl;
+}
+
 void AssemblyGenerator::walkBasicBlocks(LLVMValueRef function) {
     for (auto bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
         generateInstIndexMap(bb);
         computeLiveness(bb);
         regAllocation(bb);
-        for (const auto& [inst, range] : liveRange) {
-            cout << "Instruction: " << LLVMPrintValueToString(inst)
-                 << ", Start: " << range.first << ", End: " << range.second << endl;
+        if (logEnabled(LogDebug, LogLiveness)) {
+            for (const auto& [inst, range] : liveRange) {
+                LOG(LogDebug, LogLiveness, "Instruction: " << printed(inst)
+                                           << ", Start: " << range.first << ", End: " << range.second);
+            }
         }
-        cout << endl;
         instIndex.clear();
         liveRange.clear();
     }
 }
 
 void AssemblyGenerator::walkFunctionsAssembly() {
+    if (profile) blockCounts = profile->blockCounts(module);
     for (auto function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
-        printf("\nFunction Name: %s\n", LLVMGetValueName(function));
+        if (LLVMIsDeclaration(function)) continue;
+        LOG(LogDebug, LogRegAlloc, "Function Name: " << LLVMGetValueName(function));
         walkBasicBlocks(function);
         getOffsetMap(function);
         createBBLabels(function);
     }
 
-    for (const auto& [inst, reg] : regMap) {
-        printf("Instruction: %s -> Register: %s\n", LLVMPrintValueToString(inst), reg);
+    if (logEnabled(LogDebug, LogRegAlloc)) {
+        for (const auto& [inst, reg] : regMap) {
+            LOG(LogDebug, LogRegAlloc, "Instruction: " << printed(inst) << " -> Register: " << reg);
+        }
     }
-    cout << endl;
-    for (const auto& [value, offset] : offsetMap) {
-        cout << LLVMPrintValueToString(value) << " -> " << offset << endl;
+    if (logEnabled(LogDebug, LogFrame)) {
+        for (const auto& [value, offset] : offsetMap) {
+            LOG(LogDebug, LogFrame, printed(value) << " -> " << offset);
+        }
     }
 }
 
 void AssemblyGenerator::generateAssembly() {
     if (module) {
+        clearMaps();
         walkFunctionsAssembly();
-        freopen(outputFilename, "w", stdout);
-        codeGeneration();
-        LLVMDisposeModule(module);
+        if (sink) {
+            out = sink;
+            codeGeneration();
+        } else {
+            ofstream asmFile(outputFilename);
+            out = &asmFile;
+            codeGeneration();
+        }
+        out = nullptr;
+        releaseModule();
     }
-    LLVMShutdown();
 }
@@ -6,23 +6,49 @@
 #include <llvm-c/Types.h>
 
 #include <map>
+#include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "block_profile.h"
+
+/* Generates x86 assembly for a module. A generator that loads its module
+   from a file owns the LLVM context it parses into; otherwise it works on a
+   module the caller owns. Assembly goes to a file or to a caller-provided
+   stream and diagnostics through the logging subsystem, so instances are
+   independent of each other and of the process's stdout. With a block
+   profile, spill costs weigh each use by how often its block ran and the
+   hottest successor of every block is laid out right after it, so hot
+   paths fall through instead of jumping. */
 class AssemblyGenerator {
    public:
+    AssemblyGenerator();
     AssemblyGenerator(const char* inputFilename, const char* outputFilename);
+    AssemblyGenerator(LLVMModuleRef module, const char* outputFilename);
+    AssemblyGenerator(LLVMModuleRef module, std::ostream& out);
+    ~AssemblyGenerator();
+    AssemblyGenerator(const AssemblyGenerator&) = delete;
+    AssemblyGenerator& operator=(const AssemblyGenerator&) = delete;
+
     void generateAssembly();
+    void reset(LLVMModuleRef module, const char* outputFilename);
+    void reset(LLVMModuleRef module, std::ostream& out);
+    void setProfile(const BlockProfile* profile);
 
    private:
+    void releaseModule();
+    void clearMaps();
     void generateInstIndexMap(LLVMBasicBlockRef bb);
     void computeLiveness(LLVMBasicBlockRef bb);
-    int countNumUses(LLVMValueRef value);
+    uint64_t blockWeight(LLVMBasicBlockRef bb);
+    uint64_t countNumUses(LLVMValueRef value);
     bool compareUses(LLVMValueRef a, LLVMValueRef b);
     void regAllocation(LLVMBasicBlockRef bb);
     void createBBLabels(LLVMValueRef function);
     void printDirectives(LLVMValueRef function, int offset);
     int getOffsetMap(LLVMValueRef function);
+    std::vector<LLVMBasicBlockRef> blockLayout(LLVMValueRef function);
     void generateFunctionCode(LLVMValueRef function);
     void generateBasicBlockCode(LLVMBasicBlockRef bb);
     void generateInstructionCode(LLVMValueRef inst);
@@ -32,6 +58,8 @@ class AssemblyGenerator {
     void generateCallCode(LLVMValueRef inst);
     void generateBranchCode(LLVMValueRef inst);
     void generateArithmeticCode(LLVMValueRef inst);
+    void generateDivisionCode(LLVMValueRef inst);
+    std::string location(LLVMValueRef value);
     void codeGeneration();
     void walkBasicBlocks(LLVMValueRef function);
     void walkFunctionsAssembly();
@@ -45,8 +73,16 @@ class AssemblyGenerator {
     std::map<LLVMBasicBlockRef, std::string> bbLabels;
     std::map<LLVMValueRef, int> offsetMap;
 
+    LLVMContextRef context;  // only set when the module was loaded from a file
     LLVMModuleRef module;
-    const char* outputFilename;
+    bool ownsModule;
+    std::string outputFilename;
+    std::ostream* sink;  // caller-provided output; outputFilename is used when NULL
+    std::ostream* out;   // where codeGeneration writes
+
+    const BlockProfile* profile;  // weights blocks when set
+    std::unordered_map<LLVMBasicBlockRef, uint64_t> blockCounts;
+    LLVMBasicBlockRef nextBlock;  // laid out after the block being generated
 };
 
 #endif  // ASSEMBLY_GENERATOR_H
\ No newline at end of file
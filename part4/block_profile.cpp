@@ -0,0 +1,107 @@
+#include "block_profile.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+bool BlockProfile::load(const string& filename, string& diagnostics) {
+    ifstream file(filename);
+    if (!file) {
+        diagnostics += "Cannot open profile " + filename + "\n";
+        return false;
+    }
+    return read(file, filename, diagnostics);
+}
+
+/* Lines that do not start with a digit are comments. Block numbers past
+   MAX_PROFILE_BLOCKS are refused rather than sized for. */
+bool BlockProfile::read(istream& in, const string& name, string& diagnostics) {
+    counts.clear();
+    string line;
+    for (int lineNumber = 1; getline(in, line); lineNumber++) {
+        if (line.empty() || line[0] < '0' || line[0] > '9') continue;
+
+        istringstream fields(line);
+        unsigned block;
+        uint64_t count;
+        if (!(fields >> block >> count)) {
+            diagnostics += name + ":" + to_string(lineNumber) + ": expected <block> <count>\n";
+            return false;
+        }
+        if (block >= MAX_PROFILE_BLOCKS) {
+            diagnostics += name + ":" + to_string(lineNumber) + ": block number out of range\n";
+            return false;
+        }
+        if (block >= counts.size()) counts.resize(block + 1);
+        counts[block] += count;
+    }
+    return true;
+}
+
+bool BlockProfile::save(const string& filename) const {
+    ofstream file(filename);
+    file << toString();
+    return bool(file);
+}
+
+string BlockProfile::toString() const {
+    ostringstream text;
+    text << "# miniC block profile: <block> <count>\n";
+    for (size_t block = 0; block < counts.size(); block++) {
+        if (counts[block]) text << block << " " << counts[block] << "\n";
+    }
+    return text.str();
+}
+
+/* The counts of the module's blocks; blocks past the end of the profile ran
+   zero times as far as it knows. */
+unordered_map<LLVMBasicBlockRef, uint64_t> BlockProfile::blockCounts(LLVMModuleRef module) const {
+    unordered_map<LLVMBasicBlockRef, uint64_t> result;
+    vector<LLVMBasicBlockRef> blocks = numberBlocks(module);
+    for (unsigned block = 0; block < blocks.size(); block++) {
+        result[blocks[block]] = count(block);
+    }
+    return result;
+}
+
+/* The blocks of every defined function, indexed by their profile number. */
+vector<LLVMBasicBlockRef> numberBlocks(LLVMModuleRef module) {
+    vector<LLVMBasicBlockRef> blocks;
+    for (auto function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
+        for (auto bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+            blocks.push_back(bb);
+        }
+    }
+    return blocks;
+}
+
+/* Starts every block with a call to PROFILE_COUNTER, passing the block's
+   number; in the entry block the call goes after the allocas so they stay
+   together. Returns the number of blocks instrumented. */
+unsigned instrumentBlocks(LLVMModuleRef module) {
+    LLVMContextRef context = LLVMGetModuleContext(module);
+    LLVMTypeRef int32 = LLVMInt32TypeInContext(context);
+    LLVMTypeRef counterType = LLVMFunctionType(LLVMVoidTypeInContext(context), &int32, 1, 0);
+
+    // Numbered before the counter is declared, though declarations are skipped anyway
+    vector<LLVMBasicBlockRef> blocks = numberBlocks(module);
+    LLVMValueRef counter = LLVMGetNamedFunction(module, PROFILE_COUNTER);
+    if (!counter) counter = LLVMAddFunction(module, PROFILE_COUNTER, counterType);
+
+    LLVMBuilderRef builder = LLVMCreateBuilderInContext(context);
+    for (unsigned block = 0; block < blocks.size(); block++) {
+        LLVMValueRef first = LLVMGetFirstInstruction(blocks[block]);
+        while (first && LLVMIsAAllocaInst(first)) first = LLVMGetNextInstruction(first);
+        if (first) {
+            LLVMPositionBuilderBefore(builder, first);
+        } else {
+            LLVMPositionBuilderAtEnd(builder, blocks[block]);
+        }
+        LLVMValueRef id = LLVMConstInt(int32, block, 0);
+        LLVMBuildCall2(builder, counterType, counter, &id, 1, "");
+    }
+    LLVMDisposeBuilder(builder);
+    return blocks.size();
+}
@@ -0,0 +1,46 @@
+#ifndef BLOCK_PROFILE_H
+#define BLOCK_PROFILE_H
+
+#include <llvm-c/Core.h>
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The function instrumented programs call on entry to every block
+#define PROFILE_COUNTER "__minic_prof_count"
+
+// More blocks than any module gets, so a bad profile cannot size counts
+#define MAX_PROFILE_BLOCKS (1u << 24)
+
+/* How often each basic block ran. Blocks are identified by their position in
+   the module, counting through the defined functions in layout order, so a
+   profile taken from one build applies to later builds of the same source:
+   the optimizer is deterministic and instrumenting adds no blocks. A stale
+   profile only makes for poor weights, never for wrong code.
+
+   On disk a profile is text, one "<block> <count>" line per block that ran,
+   after a comment line; part4/profile_runtime.c writes the same format. */
+class BlockProfile {
+   public:
+    BlockProfile() = default;
+    explicit BlockProfile(const std::vector<uint64_t>& _counts) : counts(_counts) {}
+
+    bool load(const std::string& filename, std::string& diagnostics);
+    bool read(std::istream& in, const std::string& name, std::string& diagnostics);
+    bool save(const std::string& filename) const;
+    std::string toString() const;
+
+    uint64_t count(unsigned block) const { return block < counts.size() ? counts[block] : 0; }
+    std::unordered_map<LLVMBasicBlockRef, uint64_t> blockCounts(LLVMModuleRef module) const;
+
+   private:
+    std::vector<uint64_t> counts;
+};
+
+std::vector<LLVMBasicBlockRef> numberBlocks(LLVMModuleRef module);
+unsigned instrumentBlocks(LLVMModuleRef module);
+
+#endif  // BLOCK_PROFILE_H
@@ -0,0 +1,100 @@
+#!/bin/bash
+# The backend's output against expected results:
+#
+#     part4/codegen_test.sh [--update] [<program> ...]
+#
+# Every program in part4/codegen_tests, or the ones named, is compiled at
+# -O1 (LLVM IR through AssemblyGenerator) and at -O0 (straight from the
+# AST), linked for 32-bit x86 against part2/builder_tests/main.c and run
+# with <stem>.in on stdin, for 10 seconds at most; both must print
+# <stem>.expected. A program with a golden <stem>.s must also compile at -O1
+# to exactly that assembly, and with --profile-use <stem>.profile to
+# <stem>.pgo.s when those exist. --update rewrites the goldens that exist
+# from the current build instead of comparing against them. CC and MAIN
+# override the compilers used.
+
+set -u
+cd "$(dirname "$0")/.."
+
+CC=${CC:-clang-15}
+MAIN=${MAIN:-./main}
+TESTS=part4/codegen_tests
+UPDATE=0
+PROGRAMS=()
+
+while [ $# -gt 0 ]; do
+    case $1 in
+        --update)
+            UPDATE=1
+            shift
+            ;;
+        -*)
+            echo "Usage: $0 [--update] [<program> ...]" >&2
+            exit 1
+            ;;
+        *)
+            PROGRAMS+=("$1")
+            shift
+            ;;
+    esac
+done
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    for source in $TESTS/*.c; do
+        PROGRAMS+=("$(basename "$source" .c)")
+    done
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# golden <file> <options...> compiles the program at -O1 and compares the
+# assembly with <file>, or rewrites it under --update
+golden() {
+    local file=$1
+    shift
+    $MAIN -O1 "$@" --stdout "$src" >"$WORK/golden.s" || return 1
+    if [ $UPDATE == 1 ]; then
+        cp "$WORK/golden.s" "$file"
+    elif ! diff -u "$file" "$WORK/golden.s" >&2; then
+        return 1
+    fi
+}
+
+failed=0
+for program in "${PROGRAMS[@]}"; do
+    src=$TESTS/$program.c
+    input=$TESTS/$program.in
+    [ -f "$input" ] || input=/dev/null
+
+    ok=1
+    for level in O1 O0; do
+        exe=$WORK/$program-$level
+        if ! $MAIN -$level --stdout "$src" >"$exe.s" ||
+            ! $CC -m32 -no-pie -w "$exe.s" part2/builder_tests/main.c -o "$exe"; then
+            echo "$program: -$level does not build" >&2
+            ok=0
+        elif ! timeout 10 "$exe" <"$input" >"$exe.out"; then
+            echo "$program: -$level failed to run" >&2
+            ok=0
+        elif ! diff -u "$TESTS/$program.expected" "$exe.out" >&2; then
+            echo "$program: -$level prints something else than $program.expected" >&2
+            ok=0
+        fi
+    done
+
+    if [ -f "$TESTS/$program.s" ] && ! golden "$TESTS/$program.s"; then
+        echo "$program: the assembly differs from $program.s" >&2
+        ok=0
+    fi
+    if [ -f "$TESTS/$program.pgo.s" ] && ! golden "$TESTS/$program.pgo.s" --profile-use "$TESTS/$program.profile"; then
+        echo "$program: the assembly with $program.profile differs from $program.pgo.s" >&2
+        ok=0
+    fi
+
+    if [ $ok == 1 ]; then
+        echo "$program: ok"
+    else
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,18 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	int b;
+	int n;
+	a = read();
+	b = read();
+	if (a < b) print(1); else print(2);
+	if (a > b) print(3); else print(4);
+	if (a == b) print(5); else print(6);
+	if (a <= p) print(9); else print(10);
+	if (a >= p) print(11); else print(12);
+	n = 0;
+	while (n < b) n = n + a;
+	return n;
+}
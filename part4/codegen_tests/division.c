@@ -0,0 +1,17 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	int b;
+	int q;
+	a = read();
+	b = read();
+	q = a / b;
+	print(q);
+	print(-a / b);
+	print(a / -b);
+	print(a / 4);
+	print((a + b) / (a - b));
+	return q * b + p / 2;
+}
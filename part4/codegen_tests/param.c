@@ -0,0 +1,15 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	a = p * 2 + p;
+	print(p);
+	print(a);
+	while (p > 0) {
+		a = a + p;
+		p = p - 1;
+	}
+	print(p);
+	return a;
+}
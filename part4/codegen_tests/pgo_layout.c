@@ -0,0 +1,22 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int i;
+	int s;
+	int t;
+	int a;
+	int b;
+	a = read();
+	b = read();
+	i = 0;
+	s = 0;
+	t = 0;
+	while (i < 100) {
+		if (i < p) t = t + 1;
+		else s = s + (i + a) * (i - b) + (a + b) * (i + t);
+		i = i + 1;
+	}
+	print(t);
+	return s;
+}
@@ -0,0 +1,98 @@
+	.text
+	.globl	func
+	.type	func, @function
+func:
+.LFB0:
+	pushl	%ebp
+	movl	%esp, %ebp
+	pushl	%ebx
+	subl	$48, %esp
+	movl	8(%ebp), %eax
+	movl	%eax, -8(%ebp)
+	pushl	%ebx
+	pushl	%ecx
+	pushl	%edx
+	call	read
+	popl	%edx
+	popl	%ecx
+	popl	%ebx
+	movl	%eax, %ebx
+	movl	%ebx, -24(%ebp)
+	pushl	%ebx
+	pushl	%ecx
+	pushl	%edx
+	call	read
+	popl	%edx
+	popl	%ecx
+	popl	%ebx
+	movl	%eax, %ebx
+	movl	%ebx, -28(%ebp)
+	movl	$0, -12(%ebp)
+	movl	$0, -16(%ebp)
+	movl	$0, -20(%ebp)
+.L1:
+	movl	-12(%ebp), %ebx
+	cmpl	$100, %ebx
+	jge .L3
+.L2:
+	movl	-12(%ebp), %ebx
+	movl	-8(%ebp), %ecx
+	cmpl	%ecx, %ebx
+	jl .L4
+.L5:
+	movl	-16(%ebp), %eax
+	movl	%eax, -36(%ebp)
+	movl	-12(%ebp), %ecx
+	movl	-24(%ebp), %edx
+	movl	%ecx, %eax
+	addl	%edx, %eax
+	movl	%eax, -40(%ebp)
+	movl	-28(%ebp), %ebx
+	movl	%ecx, %eax
+	subl	%ebx, %eax
+	movl	%eax, -44(%ebp)
+	movl	-40(%ebp), %eax
+	imull	-44(%ebp), %eax
+	movl	%eax, -48(%ebp)
+	movl	-36(%ebp), %eax
+	addl	-48(%ebp), %eax
+	movl	%eax, -52(%ebp)
+	movl	%edx, %eax
+	addl	%ebx, %eax
+	movl	%eax, %ebx
+	movl	-20(%ebp), %edx
+	addl	%edx, %ecx
+	imull	%ecx, %ebx
+	movl	-52(%ebp), %eax
+	addl	%ebx, %eax
+	movl	%eax, %ebx
+	movl	%ebx, -16(%ebp)
+.L6:
+	movl	-12(%ebp), %ebx
+	addl	$1, %ebx
+	movl	%ebx, -12(%ebp)
+	jmp .L1
+.L4:
+	movl	-20(%ebp), %ebx
+	addl	$1, %ebx
+	movl	%ebx, -20(%ebp)
+	jmp .L6
+.L3:
+	movl	-20(%ebp), %ebx
+	pushl	%ebx
+	pushl	%ecx
+	pushl	%edx
+	pushl	%ebx
+	call	print
+	addl	$4, %esp
+	popl	%edx
+	popl	%ecx
+	popl	%ebx
+	movl	-16(%ebp), %ebx
+	movl	%ebx, -32(%ebp)
+.L7:
+	movl	-32(%ebp), %ebx
+	movl	%ebx, %eax
+	movl	-4(%ebp), %ebx
+	leave
+	ret
@@ -0,0 +1,9 @@
+# miniC block profile: <block> <count>
+0 1
+1 101
+2 100
+3 1
+4 5
+5 95
+6 100
+7 1
@@ -0,0 +1,21 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	int b;
+	int c;
+	int d;
+	int e;
+	a = read();
+	b = read();
+	c = read();
+	d = read();
+	e = a * b + c * d + (a - b) * (c - d) + (a + c) * (b + d) - (a + d) * (b - c);
+	print(e);
+	c = a - b * c;
+	print(c);
+	d = (a + b) - (c + d) * (a - (b + (c - (d + p))));
+	print(d);
+	return e - c + d;
+}
@@ -0,0 +1,487 @@
+#include "cycle_estimator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+using namespace std;
+
+// Issue width of the core, in micro-ops per cycle
+static const double ISSUE_WIDTH = 4;
+// From an L1 hit, or from a store forwarded to a load of the same slot
+static const double LOAD_LATENCY = 4;
+// Two load ports and one store port
+static const double LOAD_OCCUPANCY = 0.5;
+static const double STORE_OCCUPANCY = 1;
+// The fetch bubble after a taken branch
+static const double TAKEN_BRANCH_PENALTY = 1;
+
+enum Resource { ALU, MULTIPLIER, DIVIDER, BRANCH_UNIT, LOAD_PORT, STORE_PORT, NUM_RESOURCES };
+
+/* What an instruction reads and writes besides its memory operands. */
+enum Kind { MOVE, BINARY, COMPARE, UNARY, CONVERT, DIVIDE, PUSH, POP, CALL, RETURN, LEAVE, JUMP, BRANCH, OTHER };
+
+struct Cost {
+    const char* mnemonic;
+    Kind kind;
+    int operands;
+    double latency;
+    int uops;
+    Resource resource;
+    double occupancy;  // cycles the resource is busy, the reciprocal throughput
+};
+
+/* Register forms only; a memory operand adds a load or a store on top. */
+static const Cost COSTS[] = {
+    {"movl", MOVE, 2, 1, 1, ALU, 0.25},
+    {"addl", BINARY, 2, 1, 1, ALU, 0.25},
+    {"subl", BINARY, 2, 1, 1, ALU, 0.25},
+    {"imull", BINARY, 2, 3, 1, MULTIPLIER, 1},
+    {"cmpl", COMPARE, 2, 1, 1, ALU, 0.25},
+    {"negl", UNARY, 1, 1, 1, ALU, 0.25},
+    {"cltd", CONVERT, 0, 1, 1, ALU, 0.5},
+    {"idivl", DIVIDE, 1, 26, 10, DIVIDER, 6},
+    // The stack engine updates %esp, so push and pop are a store and a load
+    {"pushl", PUSH, 1, 1, 0, ALU, 0},
+    {"popl", POP, 1, 0, 0, ALU, 0},
+    {"call", CALL, 1, 1, 1, BRANCH_UNIT, 1},
+    {"ret", RETURN, 0, 1, 1, BRANCH_UNIT, 1},
+    {"leave", LEAVE, 0, 1, 1, ALU, 0.25},
+    {"jmp", JUMP, 1, 1, 1, BRANCH_UNIT, 1},
+    {"je", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+    {"jne", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+    {"jg", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+    {"jge", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+    {"jl", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+    {"jle", BRANCH, 1, 1, 1, BRANCH_UNIT, 0.5},
+};
+
+// Anything else counts as a simple ALU operation on its operands
+static const Cost OTHER_COST = {"", OTHER, 0, 1, 1, ALU, 0.25};
+
+static const Cost* costOf(const string& mnemonic) {
+    for (const Cost& cost : COSTS) {
+        if (mnemonic == cost.mnemonic) return &cost;
+    }
+    return nullptr;
+}
+
+static bool isMemory(const string& operand) {
+    return operand.find('(') != string::npos;
+}
+
+static string trim(const string& text) {
+    size_t start = text.find_first_not_of(" \t");
+    if (start == string::npos) return "";
+    return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+/* Splits "movl\t-8(%ebp), %eax" into the mnemonic and its operands. */
+static string decode(const string& text, vector<string>& operands) {
+    size_t end = text.find_first_of(" \t");
+    string rest = end == string::npos ? "" : text.substr(end);
+    int parens = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= rest.size(); i++) {
+        if (i < rest.size() && rest[i] == '(') parens++;
+        if (i < rest.size() && rest[i] == ')') parens--;
+        if (i == rest.size() || (rest[i] == ',' && parens == 0)) {
+            string operand = trim(rest.substr(start, i - start));
+            if (!operand.empty()) operands.push_back(operand);
+            start = i + 1;
+        }
+    }
+    return text.substr(0, end);
+}
+
+/* When the registers an address is computed from are ready. */
+static double addressReady(const string& operand, unordered_map<string, double>& ready) {
+    double time = 0;
+    for (size_t i = operand.find('%'); i != string::npos; i = operand.find('%', i + 1)) {
+        size_t end = operand.find_first_of(",)", i);
+        time = max(time, ready[operand.substr(i, end - i)]);
+    }
+    return time;
+}
+
+/* When the value of a source operand is available; immediates and labels
+   are there from the start. */
+static double available(const string& operand, unordered_map<string, double>& ready) {
+    if (operand[0] == '%' || operand == "flags") return ready[operand];
+    if (!isMemory(operand)) return 0;
+    return max(addressReady(operand, ready), ready[operand]) + LOAD_LATENCY;
+}
+
+/* Returns false for code that is not inside a function. */
+bool CycleEstimator::analyze(const string& assembly) {
+    functions.clear();
+    code.clear();
+    istringstream in(assembly);
+    string line;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        if (line[0] != '\t') {
+            // Function labels have no leading dot; every other label starts a block
+            if (line.back() != ':') continue;
+            string label = line.substr(0, line.size() - 1);
+            if (label[0] != '.') {
+                if (!functions.empty()) {
+                    estimateBlocks(functions.back());
+                    findLoops(functions.back());
+                }
+                functions.emplace_back();
+                functions.back().name = label;
+                code.clear();
+            } else if (!functions.empty()) {
+                functions.back().blocks.emplace_back();
+                functions.back().blocks.back().label = label;
+                code.emplace_back();
+            }
+            continue;
+        }
+
+        string text = trim(line);
+        if (text.empty() || text[0] == '.') continue;  // directives
+        if (functions.empty()) return false;
+        FunctionEstimate& function = functions.back();
+        if (function.blocks.empty()) {
+            function.blocks.emplace_back();
+            function.blocks.back().label = function.name;
+            code.emplace_back();
+        }
+        code.back().push_back(text);
+    }
+    if (!functions.empty()) {
+        estimateBlocks(functions.back());
+        findLoops(functions.back());
+    }
+    return true;
+}
+
+/* Runs every block on its own: registers and stack slots are ready at cycle
+   0, and an instruction starts once its sources are. Also builds the
+   control flow graph. */
+void CycleEstimator::estimateBlocks(FunctionEstimate& function) {
+    unordered_map<string, int> blockOf;
+    for (size_t b = 0; b < function.blocks.size(); b++) blockOf[function.blocks[b].label] = b;
+
+    for (size_t b = 0; b < function.blocks.size(); b++) {
+        BlockEstimate& block = function.blocks[b];
+        unordered_map<string, double> ready;  // registers, flags and stack slots
+        vector<double> pushed;                // slots pushl wrote, for popl to read back
+        double usage[NUM_RESOURCES] = {};
+        bool fallsThrough = true;
+
+        for (const string& text : code[b]) {
+            vector<string> operands;
+            string mnemonic = decode(text, operands);
+            const Cost* cost = costOf(mnemonic);
+            if (!cost || (int)operands.size() != cost->operands) {
+                cost = &OTHER_COST;
+                function.unknown++;
+            }
+
+            vector<string> reads, writes;
+            switch (cost->kind) {
+                case MOVE:
+                    reads = {operands[0]};
+                    writes = {operands[1]};
+                    break;
+                case BINARY:
+                    reads = {operands[0], operands[1]};
+                    writes = {operands[1], "flags"};
+                    break;
+                case COMPARE:
+                    reads = {operands[0], operands[1]};
+                    writes = {"flags"};
+                    break;
+                case UNARY:
+                    reads = {operands[0]};
+                    writes = {operands[0], "flags"};
+                    break;
+                case CONVERT:
+                    reads = {"%eax"};
+                    writes = {"%edx"};
+                    break;
+                case DIVIDE:
+                    reads = {operands[0], "%eax", "%edx"};
+                    writes = {"%eax", "%edx", "flags"};
+                    break;
+                case PUSH:
+                    reads = {operands[0]};
+                    break;
+                case POP:
+                    writes = {operands[0]};
+                    break;
+                case CALL:
+                    // The callee may change every caller-saved register
+                    writes = {"%eax", "%ecx", "%edx", "flags"};
+                    break;
+                case RETURN:
+                    reads = {"%eax"};
+                    break;
+                case LEAVE:
+                    reads = {"%ebp"};
+                    writes = {"%esp", "%ebp"};
+                    break;
+                case BRANCH:
+                    reads = {"flags"};
+                    break;
+                case JUMP:
+                    break;
+                case OTHER:
+                    reads = operands;
+                    if (!operands.empty()) writes = {operands.back()};
+                    break;
+            }
+
+            double start = 0;
+            bool load = cost->kind == POP || cost->kind == RETURN || cost->kind == LEAVE;
+            bool store = cost->kind == PUSH || cost->kind == CALL;
+            for (const string& operand : reads) {
+                start = max(start, available(operand, ready));
+                load = load || isMemory(operand);
+            }
+            for (const string& operand : writes) {
+                if (isMemory(operand)) start = max(start, addressReady(operand, ready));
+                store = store || isMemory(operand);
+            }
+            if (cost->kind == POP) {
+                start = max(start, (pushed.empty() ? 0 : pushed.back()) + LOAD_LATENCY);
+                if (!pushed.empty()) pushed.pop_back();
+            }
+
+            // A move from memory is nothing but its load
+            double latency = cost->kind == MOVE && load ? 0 : cost->latency;
+            double finish = start + latency;
+            for (const string& operand : writes) ready[operand] = finish;
+            if (cost->kind == PUSH) pushed.push_back(finish);
+            if (cost->kind == LEAVE) ready["%ebp"] = start + LOAD_LATENCY;
+            block.latency = max(block.latency, finish);
+
+            if (cost->kind == MOVE && (load || store)) {
+                usage[load ? LOAD_PORT : STORE_PORT] += load ? LOAD_OCCUPANCY : STORE_OCCUPANCY;
+                block.uops++;
+            } else {
+                usage[cost->resource] += cost->occupancy;
+                block.uops += cost->uops;
+                if (load) {
+                    usage[LOAD_PORT] += LOAD_OCCUPANCY;
+                    block.uops++;
+                }
+                if (store) {
+                    usage[STORE_PORT] += STORE_OCCUPANCY;
+                    block.uops++;
+                }
+            }
+            block.instructions++;
+
+            if (cost->kind == JUMP || cost->kind == BRANCH) {
+                auto target = blockOf.find(operands[0]);
+                if (target != blockOf.end()) {
+                    block.successors.push_back(target->second);
+                    block.jumps.push_back(true);
+                }
+            }
+            if (cost->kind == JUMP || cost->kind == RETURN) fallsThrough = false;
+        }
+
+        if (fallsThrough && b + 1 < function.blocks.size()) {
+            block.successors.push_back(b + 1);
+            block.jumps.push_back(false);
+        }
+        block.throughput = block.uops / ISSUE_WIDTH;
+        for (double busy : usage) block.throughput = max(block.throughput, busy);
+        block.cycles = max(block.throughput, block.latency);
+        function.cycles += block.cycles;
+    }
+}
+
+/* Natural loops from the back edges of the dominator tree, which comes from
+   the iterative algorithm of Cooper, Harvey and Kennedy. */
+void CycleEstimator::findLoops(FunctionEstimate& function) {
+    vector<BlockEstimate>& blocks = function.blocks;
+    int n = blocks.size();
+    if (n == 0) return;
+
+    // Reverse postorder of the blocks reachable from the entry
+    vector<int> order;
+    vector<char> visited(n, 0);
+    vector<pair<int, size_t>> stack = {{0, 0}};
+    visited[0] = 1;
+    while (!stack.empty()) {
+        int b = stack.back().first;
+        size_t next = stack.back().second++;
+        if (next < blocks[b].successors.size()) {
+            int s = blocks[b].successors[next];
+            if (!visited[s]) {
+                visited[s] = 1;
+                stack.push_back({s, 0});
+            }
+        } else {
+            order.push_back(b);
+            stack.pop_back();
+        }
+    }
+    reverse(order.begin(), order.end());
+    vector<int> rpo(n, -1);
+    for (size_t i = 0; i < order.size(); i++) rpo[order[i]] = i;
+
+    vector<vector<int>> predecessors(n);
+    for (int b : order) {
+        for (int s : blocks[b].successors) predecessors[s].push_back(b);
+    }
+
+    vector<int> idom(n, -1);
+    idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int b : order) {
+            if (b == 0) continue;
+            int dominator = -1;
+            for (int p : predecessors[b]) {
+                if (idom[p] < 0) continue;
+                if (dominator < 0) {
+                    dominator = p;
+                    continue;
+                }
+                int other = p;
+                while (dominator != other) {
+                    while (rpo[dominator] > rpo[other]) dominator = idom[dominator];
+                    while (rpo[other] > rpo[dominator]) other = idom[other];
+                }
+            }
+            if (idom[b] != dominator) {
+                idom[b] = dominator;
+                changed = true;
+            }
+        }
+    }
+    auto dominates = [&idom](int a, int b) {
+        for (;; b = idom[b]) {
+            if (b == a) return true;
+            if (b == 0) return false;
+        }
+    };
+
+    // The body of each loop, by header; loops sharing a header are one loop
+    vector<int> headers;
+    vector<vector<char>> bodies;
+    vector<vector<int>> members;  // the same blocks as a list
+    vector<int> loopOf(n, -1);
+    for (int b : order) {
+        for (int s : blocks[b].successors) {
+            if (!dominates(s, b)) continue;
+            if (loopOf[s] < 0) {
+                loopOf[s] = headers.size();
+                headers.push_back(s);
+                bodies.push_back(vector<char>(n, 0));
+                bodies.back()[s] = 1;
+                members.push_back({s});
+            }
+            vector<char>& body = bodies[loopOf[s]];
+            vector<int>& list = members[loopOf[s]];
+            vector<int> worklist;
+            if (!body[b]) {
+                body[b] = 1;
+                list.push_back(b);
+                worklist.push_back(b);
+            }
+            while (!worklist.empty()) {
+                int x = worklist.back();
+                worklist.pop_back();
+                for (int p : predecessors[x]) {
+                    if (!body[p]) {
+                        body[p] = 1;
+                        list.push_back(p);
+                        worklist.push_back(p);
+                    }
+                }
+            }
+        }
+    }
+
+    vector<double> best(n, -1);
+    for (size_t l = 0; l < headers.size(); l++) {
+        int header = headers[l];
+        const vector<char>& body = bodies[l];
+        vector<int>& list = members[l];
+        LoopEstimate loop;
+        loop.header = blocks[header].label;
+        loop.blocks = list.size();
+        for (size_t m = 0; m < headers.size(); m++) {
+            if (m != l && bodies[m][header]) loop.depth++;
+        }
+
+        // Longest path back to the header over forward edges, which leaves
+        // the back edges of inner loops out; -1 where the header cannot be reached
+        sort(list.begin(), list.end(), [&rpo](int a, int b) { return rpo[a] > rpo[b]; });
+        for (int b : list) best[b] = -1;
+        for (int b : list) {
+            const BlockEstimate& block = blocks[b];
+            for (size_t i = 0; i < block.successors.size(); i++) {
+                int s = block.successors[i];
+                double rest;
+                if (s == header) {
+                    rest = 0;
+                } else if (body[s] && rpo[s] > rpo[b] && best[s] >= 0) {
+                    rest = best[s];
+                } else {
+                    continue;
+                }
+                double penalty = block.jumps[i] ? TAKEN_BRANCH_PENALTY : 0;
+                best[b] = max(best[b], block.cycles + penalty + rest);
+            }
+        }
+        loop.cycles = best[header];
+        function.loops.push_back(loop);
+    }
+
+    // Headers in layout order
+    unordered_map<string, int> position;
+    for (int b = 0; b < n; b++) position[blocks[b].label] = b;
+    sort(function.loops.begin(), function.loops.end(),
+         [&position](const LoopEstimate& a, const LoopEstimate& b) { return position[a.header] < position[b.header]; });
+}
+
+void CycleEstimator::print(ostream& out) const {
+    ios::fmtflags flags = out.flags();
+    out << fixed << setprecision(2);
+    for (const FunctionEstimate& function : functions) {
+        int instructions = 0;
+        for (const BlockEstimate& block : function.blocks) instructions += block.instructions;
+        out << function.name << ": " << function.blocks.size() << " blocks, " << instructions << " instructions, "
+            << function.cycles << " cycles with every block once\n";
+        out << "  " << left << setw(12) << "block" << right << setw(8) << "instrs" << setw(8) << "uops"
+            << setw(12) << "throughput" << setw(10) << "latency" << setw(10) << "cycles" << "\n";
+        for (const BlockEstimate& block : function.blocks) {
+            out << "  " << left << setw(12) << block.label << right << setw(8) << block.instructions << setw(8)
+                << block.uops << setw(12) << block.throughput << setw(10) << block.latency << setw(10)
+                << block.cycles << "\n";
+        }
+        for (const LoopEstimate& loop : function.loops) {
+            out << "  loop at " << loop.header << ", depth " << loop.depth << ", " << loop.blocks << " blocks: ";
+            if (loop.cycles < 0) {
+                out << "never comes back to its header\n";
+            } else {
+                out << loop.cycles << " cycles per iteration\n";
+            }
+        }
+        if (function.unknown > 0) {
+            out << "  " << function.unknown << " instructions are not in the cost table and count as simple ALU"
+                << " operations\n";
+        }
+    }
+    out.flags(flags);
+}
+
+bool runCycleEstimator(const string& assembly, ostream& report) {
+    CycleEstimator estimator;
+    if (!estimator.analyze(assembly)) {
+        report << "Cannot estimate cycles: code outside a function\n";
+        return false;
+    }
+    estimator.print(report);
+    return true;
+}
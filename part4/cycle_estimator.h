@@ -0,0 +1,62 @@
+#ifndef CYCLE_ESTIMATOR_H
+#define CYCLE_ESTIMATOR_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* The estimate for one basic block, run once from a cold start. */
+struct BlockEstimate {
+    std::string label;
+    int instructions = 0;
+    int uops = 0;
+    double throughput = 0;  // cycles the busiest execution resource needs
+    double latency = 0;     // longest dependency chain through registers and memory
+    double cycles = 0;      // the larger of the two
+    std::vector<int> successors;   // indices of the blocks control goes to next
+    std::vector<bool> jumps;       // whether going to each successor takes a branch
+};
+
+struct LoopEstimate {
+    std::string header;
+    int depth = 1;      // 1 for a loop no other loop contains
+    int blocks = 0;
+    double cycles = 0;  // one iteration along its costliest path, without inner loop bodies
+};
+
+struct FunctionEstimate {
+    std::string name;
+    std::vector<BlockEstimate> blocks;  // in layout order
+    std::vector<LoopEstimate> loops;    // in the order of their headers
+    double cycles = 0;                  // every block once
+    int unknown = 0;                    // instructions missing from the cost table
+};
+
+/* A static cost model for the assembly AssemblyGenerator and the -O0
+   backend write, in the spirit of a much simplified llvm-mca. Each
+   instruction has a latency, a number of micro-ops and the execution
+   resource it keeps busy, taken from a recent out-of-order x86 core; memory
+   operands add a load or a store. A block costs the larger of its
+   throughput bound and its critical path, as if it ran alone. The control
+   flow graph comes from the jumps and fall-throughs in the text, loops from
+   its back edges. An iteration of a loop costs its most expensive path
+   from the header back to it, plus a cycle for every branch taken on the
+   way, so that layout shows up too; inner loops only contribute the blocks
+   on that path and get their own estimate. Callees are not followed. */
+class CycleEstimator {
+   public:
+    bool analyze(const std::string& assembly);
+    void print(std::ostream& out) const;
+    const std::vector<FunctionEstimate>& getFunctions() const { return functions; }
+
+   private:
+    void estimateBlocks(FunctionEstimate& function);
+    void findLoops(FunctionEstimate& function);
+
+    std::vector<FunctionEstimate> functions;
+    std::vector<std::vector<std::string>> code;  // instructions of each block of the last function
+};
+
+bool runCycleEstimator(const std::string& assembly, std::ostream& report);
+
+#endif  // CYCLE_ESTIMATOR_H
@@ -0,0 +1,332 @@
+#include "fast_codegen.h"
+
+#include <algorithm>
+
+#include "../logging.h"
+
+using namespace std;
+
+FastCodeGenerator::FastCodeGenerator(ostream& _out)
+    : out(_out), ast(nullptr), frameSize(0), maxFrameSize(0), labels(0), failed(false) {
+}
+
+bool FastCodeGenerator::generate(const FlatAst& _ast) {
+    ast = &_ast;
+    if (ast->empty() || ast->kind(ast->root()) != flat_prog) return false;
+
+    out << "\t.text\n";
+    out << "\t.globl\tfunc\n";
+    out << "\t.type\tfunc, @function\n";
+    generateFunction(ast->func());
+    return !failed;
+}
+
+/* The body is generated first since the prologue needs the frame size.
+   Slots of a block are reused once the block ends. */
+void FastCodeGenerator::generateFunction(int32_t func) {
+    body.str("");
+    slots.clear();
+    frameSize = maxFrameSize = 0;
+    labels = 0;
+
+    if (ast->param(func) != FlatAst::NO_NODE) slots[ast->name(ast->param(func))] = 8;
+    generateStatement(ast->body(func));
+    slots.clear();
+
+    out << symbolName(ast->name(func)) << ":\n";
+    out << ".LFB0:\n";
+    out << "\tpushl\t%ebp\n";
+    out << "\tmovl\t%esp, %ebp\n";
+    out << "\tsubl\t$" << maxFrameSize << ", %esp\n";
+    out << body.str();
+
+    // Falling off the end returns whatever is in %eax
+    FlatRange stmts = ast->statements(ast->body(func));
+    if (stmts.count == 0 || ast->kind(stmts.items[stmts.count - 1]) != flat_ret) {
+        out << "\tleave\n";
+        out << "\tret\n";
+    }
+}
+
+/* Generates the statement and everything under it on an explicit stack, so
+   a deeply nested body cannot overflow the call stack. */
+void FastCodeGenerator::generateStatement(int32_t stmt) {
+    vector<StatementTask> pending;
+    auto later = [&pending](int32_t child) {
+        if (child != FlatAst::NO_NODE) pending.push_back({child, 0, "", "", 0});
+    };
+    later(stmt);
+
+    while (!pending.empty()) {
+        StatementTask task = move(pending.back());
+        pending.pop_back();
+        stmt = task.stmt;
+        task.step++;
+
+        switch (ast->kind(stmt)) {
+            case flat_decl: {
+                frameSize += 4;
+                maxFrameSize = max(maxFrameSize, frameSize);
+                int& offset = slots[ast->name(stmt)];
+                shadowed.push_back({ast->name(stmt), offset});
+                offset = -frameSize;
+                break;
+            }
+            case flat_asgn: {
+                string value = operand(ast->rhs(stmt));
+                if (value.empty() || value[0] != '$') {
+                    generateExpression(ast->rhs(stmt));
+                    value = "%eax";
+                }
+                body << "\tmovl\t" << value << ", " << slot(ast->name(ast->lhs(stmt))) << "\n";
+                break;
+            }
+            case flat_ret:
+                generateExpression(ast->expr(stmt));
+                body << "\tleave\n";
+                body << "\tret\n";
+                break;
+            case flat_block: {
+                if (task.step == 2) {
+                    for (size_t i = shadowed.size(); i > blockStarts.back(); i--) {
+                        const pair<Symbol, int>& entry = shadowed[i - 1];
+                        if (entry.second != 0) {
+                            slots[entry.first] = entry.second;
+                        } else {
+                            slots.erase(entry.first);
+                        }
+                    }
+                    shadowed.resize(blockStarts.back());
+                    blockStarts.pop_back();
+                    frameSize = task.outerFrameSize;
+                    break;
+                }
+                task.outerFrameSize = frameSize;
+                blockStarts.push_back(shadowed.size());
+                pending.push_back(task);
+                FlatRange stmts = ast->statements(stmt);
+                for (int32_t i = stmts.count; i > 0; i--) {
+                    later(stmts.items[i - 1]);
+                }
+                break;
+            }
+            case flat_while: {
+                if (task.step == 2) {
+                    body << "\tjmp " << task.firstLabel << "\n";
+                    body << task.secondLabel << ":\n";
+                    break;
+                }
+                task.firstLabel = newLabel();
+                task.secondLabel = newLabel();
+                body << task.firstLabel << ":\n";
+                generateCondition(ast->cond(stmt), task.secondLabel);
+                pending.push_back(task);
+                later(ast->body(stmt));
+                break;
+            }
+            case flat_if: {
+                // firstLabel is the else label, secondLabel the end when there is an else
+                if (task.step == 1) {
+                    task.firstLabel = newLabel();
+                    generateCondition(ast->cond(stmt), task.firstLabel);
+                    pending.push_back(task);
+                    later(ast->body(stmt));
+                } else if (task.step == 2 && ast->elseBody(stmt) != FlatAst::NO_NODE) {
+                    task.secondLabel = newLabel();
+                    body << "\tjmp " << task.secondLabel << "\n";
+                    body << task.firstLabel << ":\n";
+                    pending.push_back(task);
+                    later(ast->elseBody(stmt));
+                } else if (task.step == 2) {
+                    body << task.firstLabel << ":\n";
+                } else {
+                    body << task.secondLabel << ":\n";
+                }
+                break;
+            }
+            default:
+                generateExpression(stmt);
+                break;
+        }
+    }
+}
+
+/* Leaves the value in %eax. Partial results are kept on the stack rather
+   than in registers, so a call anywhere in an expression has nothing to
+   save; only the caller-saved %eax, %ecx and %edx are used. Operands are
+   visited on an explicit stack, so long chains cannot overflow the call
+   stack. */
+void FastCodeGenerator::generateExpression(int32_t expr) {
+    vector<ExpressionTask> pending(1, {expr, 0});
+    auto later = [&pending](int32_t child) { pending.push_back({child, 0}); };
+
+    while (!pending.empty()) {
+        ExpressionTask task = pending.back();
+        pending.pop_back();
+        expr = task.expr;
+
+        switch (ast->kind(expr)) {
+            case flat_cnst:
+            case flat_var:
+                body << "\tmovl\t" << operand(expr) << ", %eax\n";
+                break;
+            case flat_uexpr:
+                if (task.step == 0) {
+                    pending.push_back({expr, 1});
+                    later(ast->expr(expr));
+                } else {
+                    body << "\tnegl\t%eax\n";
+                }
+                break;
+            case flat_bexpr: {
+                // Left to right, as the IR builder evaluates them
+                if (task.step == 0) {
+                    pending.push_back({expr, 1});
+                    later(ast->lhs(expr));
+                    break;
+                }
+                if (task.step == 2) {
+                    body << "\tmovl\t%eax, %ecx\n";
+                    body << "\tpopl\t%eax\n";
+                    generateOperation(expr, "%ecx");
+                    break;
+                }
+                string rhs = operand(ast->rhs(expr));
+                if (rhs.empty()) {
+                    body << "\tpushl\t%eax\n";
+                    pending.push_back({expr, 2});
+                    later(ast->rhs(expr));
+                    break;
+                }
+                if (ast->op(expr) == divide) {
+                    body << "\tmovl\t" << rhs << ", %ecx\n";
+                    rhs = "%ecx";
+                }
+                generateOperation(expr, rhs);
+                break;
+            }
+            case flat_call:
+                if (ast->param(expr) == FlatAst::NO_NODE) {
+                    body << "\tcall\t" << symbolName(ast->name(expr)) << "\n";
+                } else if (task.step == 1) {
+                    generateCall(expr, "%eax");
+                } else if (operand(ast->param(expr)).empty()) {
+                    pending.push_back({expr, 1});
+                    later(ast->param(expr));
+                } else {
+                    generateCall(expr, operand(ast->param(expr)));
+                }
+                break;
+            case flat_ret:
+            case flat_block:
+            case flat_while:
+            case flat_if:
+            case flat_asgn:
+            case flat_decl:
+                // The other statements are nothing in an expression
+                break;
+            default:
+                LOG(LogError, LogCodeGen, "Unexpected node in an expression");
+                failed = true;
+                break;
+        }
+    }
+}
+
+/* Applies the binary operator to %eax and rhs, which is %ecx for a division. */
+void FastCodeGenerator::generateOperation(int32_t expr, const string& rhs) {
+    switch (ast->op(expr)) {
+        case add:
+            body << "\taddl\t" << rhs << ", %eax\n";
+            break;
+        case sub:
+            body << "\tsubl\t" << rhs << ", %eax\n";
+            break;
+        case mul:
+            body << "\timull\t" << rhs << ", %eax\n";
+            break;
+        case divide:
+            body << "\tcltd\n";
+            body << "\tidivl\t%ecx\n";
+            break;
+        default:
+            break;
+    }
+}
+
+void FastCodeGenerator::generateCall(int32_t expr, const string& arg) {
+    body << "\tpushl\t" << arg << "\n";
+    body << "\tcall\t" << symbolName(ast->name(expr)) << "\n";
+    body << "\taddl\t$4, %esp\n";
+}
+
+/* Compares and jumps to falseLabel when the condition does not hold, falling
+   through into the code for the true case. */
+void FastCodeGenerator::generateCondition(int32_t cond, const string& falseLabel) {
+    if (ast->kind(cond) != flat_rexpr) {
+        LOG(LogError, LogCodeGen, "Condition is not a comparison");
+        failed = true;
+        return;
+    }
+
+    generateExpression(ast->lhs(cond));
+    string rhs = operand(ast->rhs(cond));
+    if (rhs.empty()) {
+        body << "\tpushl\t%eax\n";
+        generateExpression(ast->rhs(cond));
+        body << "\tmovl\t%eax, %ecx\n";
+        body << "\tpopl\t%eax\n";
+        rhs = "%ecx";
+    }
+    body << "\tcmpl\t" << rhs << ", %eax\n";
+
+    switch (ast->op(cond)) {
+        case lt:
+            body << "\tjge " << falseLabel << "\n";
+            break;
+        case gt:
+            body << "\tjle " << falseLabel << "\n";
+            break;
+        case le:
+            body << "\tjg " << falseLabel << "\n";
+            break;
+        case ge:
+            body << "\tjl " << falseLabel << "\n";
+            break;
+        case eq:
+            body << "\tjne " << falseLabel << "\n";
+            break;
+        case neq:
+            body << "\tje " << falseLabel << "\n";
+            break;
+    }
+}
+
+/* The operand for a constant or a variable; empty for anything that has to
+   be computed first. */
+string FastCodeGenerator::operand(int32_t expr) {
+    if (ast->kind(expr) == flat_cnst) return "$" + to_string(ast->value(expr));
+    if (ast->kind(expr) == flat_var) return slot(ast->name(expr));
+    return "";
+}
+
+string FastCodeGenerator::slot(Symbol name) {
+    auto offset = slots.find(name);
+    if (offset != slots.end()) return to_string(offset->second) + "(%ebp)";
+    LOG(LogError, LogCodeGen, "Variable " << symbolName(name) << " has no stack slot");
+    failed = true;
+    return "0(%ebp)";
+}
+
+string FastCodeGenerator::newLabel() {
+    return ".L" + to_string(++labels);
+}
+
+/* Generates assembly for an analyzed AST; the AST is left for the caller to free. */
+bool runFastCodegen(const FlatAst& ast, ostream& out) {
+    if (ast.empty()) {
+        LOG(LogError, LogCodeGen, "AST is empty. Skipping code generation.");
+        return false;
+    }
+    return FastCodeGenerator(out).generate(ast);
+}
@@ -0,0 +1,67 @@
+#ifndef FAST_CODEGEN_H
+#define FAST_CODEGEN_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../part1/flat_ast.h"
+
+/* The -O0 backend: walks the AST once and writes x86 assembly straight to a
+   stream, skipping LLVM altogether. Every declared variable gets its own
+   stack slot and the parameter stays where the caller pushed it, so values
+   only live in registers within one expression. The output uses the same
+   directives, labels and calling convention as AssemblyGenerator. */
+class FastCodeGenerator {
+   public:
+    explicit FastCodeGenerator(std::ostream& out);
+    bool generate(const FlatAst& ast);
+
+   private:
+    // A statement generateStatement is part way through: loops, ifs and
+    // blocks come off its stack again after each part, step telling which,
+    // with the labels and frame size they need then
+    struct StatementTask {
+        int32_t stmt;
+        int step;
+        std::string firstLabel;
+        std::string secondLabel;
+        int outerFrameSize;
+    };
+
+    // An expression generateExpression is part way through: step 1 once its
+    // left operand is in %eax, step 2 once a computed right operand is
+    struct ExpressionTask {
+        int32_t expr;
+        int step;
+    };
+
+    void generateFunction(int32_t func);
+    void generateStatement(int32_t stmt);
+    void generateExpression(int32_t expr);
+    void generateOperation(int32_t expr, const std::string& rhs);
+    void generateCall(int32_t expr, const std::string& arg);
+    void generateCondition(int32_t cond, const std::string& falseLabel);
+    std::string operand(int32_t expr);
+    std::string slot(Symbol name);
+    std::string newLabel();
+
+    std::ostream& out;
+    const FlatAst* ast;
+    std::ostringstream body;  // the function body, written once the frame size is known
+    // The innermost slot of each name; the slots declarations replaced, 0
+    // for none, and where each open block's entries begin
+    std::unordered_map<Symbol, int> slots;
+    std::vector<std::pair<Symbol, int>> shadowed;
+    std::vector<size_t> blockStarts;
+    int frameSize;
+    int maxFrameSize;
+    int labels;
+    bool failed;
+};
+
+bool runFastCodegen(const FlatAst& ast, std::ostream& out);
+
+#endif  // FAST_CODEGEN_H
@@ -0,0 +1,44 @@
+/*
+Runtime for programs compiled with --profile-generate. Link it in next to
+the program's assembly and main:
+
+    ./main --profile-generate prog.c
+    gcc -m32 prog.s part2/builder_tests/main.c part4/profile_runtime.c -o prog
+    ./prog
+    ./main --profile-use minic.profile prog.c
+
+Every block of the program calls __minic_prof_count with its number; the
+counts are written to $MINIC_PROFILE, or minic.profile, when the program
+exits.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned long long* counts;
+static int numCounts;
+
+static void writeProfile(void) {
+    const char* filename = getenv("MINIC_PROFILE");
+    FILE* file = fopen(filename ? filename : "minic.profile", "w");
+    if (!file) return;
+    fprintf(file, "# miniC block profile: <block> <count>\n");
+    for (int i = 0; i < numCounts; i++) {
+        if (counts[i]) fprintf(file, "%d %llu\n", i, counts[i]);
+    }
+    fclose(file);
+}
+
+void __minic_prof_count(int block) {
+    if (block < 0) return;
+    if (block >= numCounts) {
+        int size = block + 64;
+        unsigned long long* grown = realloc(counts, size * sizeof(*counts));
+        if (!grown) return;
+        if (!counts) atexit(writeProfile);
+        for (int i = numCounts; i < size; i++) grown[i] = 0;
+        counts = grown;
+        numCounts = size;
+    }
+    counts[block]++;
+}
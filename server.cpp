@@ -0,0 +1,483 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#include "part4/cycle_estimator.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+/* Buffered reads and complete writes on a connected socket. */
+class SocketStream {
+   public:
+    explicit SocketStream(int _fd) : fd(_fd), pos(0), len(0) {}
+
+    bool readLine(string& line) {
+        line.clear();
+        for (;;) {
+            if (pos == len && !fill()) return false;
+            char* newline = (char*)memchr(buffer + pos, '\n', len - pos);
+            size_t end = newline ? newline - buffer : len;
+            line.append(buffer + pos, end - pos);
+            pos = end;
+            if (newline) {
+                pos++;
+                return true;
+            }
+        }
+    }
+
+    bool readBytes(size_t n, string& bytes) {
+        bytes.resize(n);
+        return readBytes(n, &bytes[0]);
+    }
+
+    bool readBytes(size_t n, char* bytes) {
+        size_t done = 0;
+        while (done < n) {
+            if (pos == len && !fill()) return false;
+            size_t chunk = min(n - done, len - pos);
+            memcpy(bytes + done, buffer + pos, chunk);
+            done += chunk;
+            pos += chunk;
+        }
+        return true;
+    }
+
+    bool write(const string& data) {
+        return write(data.data(), data.size());
+    }
+
+    bool write(const char* data, size_t length) {
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool writeSection(const char* tag, const string& body) {
+        return write(string(tag) + " " + to_string(body.size()) + "\n") && write(body);
+    }
+
+   private:
+    bool fill() {
+        for (;;) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            pos = 0;
+            len = n;
+            return true;
+        }
+    }
+
+    int fd;
+    char buffer[65536];
+    size_t pos, len;
+};
+
+static bool fillAddress(const string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Socket path too long: " << path << endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+static volatile sig_atomic_t stopRequested = 0;
+static int wakeFd = -1;  // write end of the pipe that wakes the accept loop
+
+static void requestStop(int) {
+    int saved = errno;
+    stopRequested = 1;
+    if (wakeFd >= 0 && write(wakeFd, "", 1) < 0) {
+        // The pipe is full, so the loop is woken already
+    }
+    errno = saved;
+}
+
+// The longest request header, and the most bytes any part of a request may have
+static const size_t MAX_HEADER = 256;
+static const size_t MAX_REQUEST_PART = 64 << 20;
+
+/* A request received in full, as a worker serves it. */
+struct CompileRequest {
+    string flags;
+    string options;
+    string name;
+    SourceBuffer source;
+};
+
+enum RequestState { RequestIncomplete, RequestReady, RequestMalformed };
+
+/* Takes the first request off the front of input once all of it has
+   arrived. The header is checked as soon as its line is in, so nothing
+   waits for, or allocates, more than the limits allow. */
+static RequestState takeRequest(string& input, CompileRequest& request, string& error) {
+    size_t newline = input.find('\n');
+    if (newline == string::npos && input.size() <= MAX_HEADER) return RequestIncomplete;
+
+    string header = input.substr(0, min(newline, MAX_HEADER));
+    char flags[16];
+    size_t lengths[3];
+    int end = 0;
+    if (newline > MAX_HEADER ||
+        sscanf(header.c_str(), "compile %15s %zu %zu %zu%n", flags, &lengths[0], &lengths[1], &lengths[2], &end) != 4 ||
+        (size_t)end != header.size() || (strcmp(flags, "-") != 0 && strcmp(flags, "ir") != 0 && strcmp(flags, "bc") != 0)) {
+        error = "Malformed request: " + header + "\n";
+        return RequestMalformed;
+    }
+    if (*max_element(lengths, lengths + 3) > MAX_REQUEST_PART) {
+        error = "Malformed request: " + header + ": parts are limited to " + to_string(MAX_REQUEST_PART >> 20) + " MB\n";
+        return RequestMalformed;
+    }
+
+    size_t pos = newline + 1;
+    if (input.size() - pos < lengths[0] + lengths[1] + lengths[2]) return RequestIncomplete;
+
+    request.flags = flags;
+    request.options.assign(input, pos, lengths[0]);
+    pos += lengths[0];
+    request.name.assign(input, pos, lengths[1]);
+    pos += lengths[1];
+    char* text = request.source.allocate(lengths[2]);
+    if (!text) {
+        error = "Out of memory for a source of " + to_string(lengths[2]) + " bytes\n";
+        return RequestMalformed;
+    }
+    memcpy(text, input.data() + pos, lengths[2]);
+    input.erase(0, pos + lengths[2]);
+    return RequestReady;
+}
+
+/* The options part of a request: one option per line, the text of a
+   --profile-use profile running from the line after it to the end. */
+static string requestOptions(const CompileOptions& options) {
+    string text = options.optLevel == 0 ? "-O0\n" : "-O1\n";
+    if (options.profileGenerate) text += "--profile-generate\n";
+    if (options.profile) text += "--profile-use\n" + options.profile->toString();
+    return text;
+}
+
+static bool parseRequestOptions(const string& text, CompileOptions& options, string& diagnostics) {
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)) {
+        if (line == "-O0" || line == "-O1") {
+            options.optLevel = line[2] - '0';
+        } else if (line == "--profile-generate") {
+            options.profileGenerate = true;
+        } else if (line == "--profile-use") {
+            auto profile = make_shared<BlockProfile>();
+            if (!profile->read(lines, "request profile", diagnostics)) return false;
+            options.profile = profile;
+        } else {
+            diagnostics += "Unknown option in request: " + line + "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A client connection. Its bytes collect in input until a request is
+   complete; while busy a worker is serving that request, and otherwise the
+   accept loop reads on. */
+struct CompileServer::Connection {
+    explicit Connection(int _fd) : fd(_fd), stream(_fd), busy(false), open(true) {}
+
+    int fd;
+    SocketStream stream;  // for the responses
+    string input;         // received and not yet taken as a request
+    CompileRequest request;
+    bool busy;
+    bool open;  // false once the client hung up or a request ended the connection
+};
+
+CompileServer::CompileServer(const string& _socketPath, const CompileOptions& options)
+    : socketPath(_socketPath) {
+    if (!options.cacheDir.empty()) cache.reset(new CompileCache(options.cacheDir, options.cacheBytes));
+
+    for (int i = 0; i < max(1, options.jobs); i++) {
+        workers.push_back(unique_ptr<Compiler>(new Compiler(cache.get())));
+    }
+}
+
+/* Accepts connections and serves their requests until SIGINT or SIGTERM.
+   Only requests hold a worker: the loop polls the idle connections, reads
+   what arrives without blocking and hands each request to the pool once
+   it is complete, so neither a client that stays connected between
+   requests nor one that sends half a request keeps anyone else waiting. */
+bool CompileServer::run() {
+    sockaddr_un addr;
+    if (!fillAddress(socketPath, addr)) return false;
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return false;
+    }
+    unlink(socketPath.c_str());
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        perror(socketPath.c_str());
+        close(listenFd);
+        return false;
+    }
+
+    // Signals and finished requests both wake the loop through the pipe, so
+    // it does not matter which thread a signal lands on
+    int wake[2];
+    if (pipe2(wake, O_NONBLOCK | O_CLOEXEC) < 0) {
+        perror("pipe");
+        close(listenFd);
+        return false;
+    }
+    wakeFd = wake[1];
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    cerr << "Listening on " << socketPath << " with " << workers.size()
+         << (workers.size() == 1 ? " worker" : " workers") << endl;
+
+    vector<unique_ptr<Connection>> connections;
+    mutex finishedLock;
+    vector<Connection*> finished;  // requests served since the loop last looked
+    {
+        ThreadPool pool(workers.size());
+        auto dispatch = [&](Connection* connection) {
+            connection->busy = true;
+            pool.submit([this, connection, &finishedLock, &finished, &wake](int worker) {
+                connection->open = serveRequest(connection->stream, connection->request, *workers[worker]);
+                {
+                    lock_guard<mutex> guard(finishedLock);
+                    finished.push_back(connection);
+                }
+                if (write(wake[1], "", 1) < 0) {
+                    // The pipe is full, so the loop is woken already
+                }
+            });
+        };
+        auto takeNext = [&](Connection* connection) {
+            string error;
+            switch (takeRequest(connection->input, connection->request, error)) {
+                case RequestReady:
+                    dispatch(connection);
+                    break;
+                case RequestMalformed: {
+                    // Sent only as far as the socket takes it at once, the loop must not block
+                    string reply = "diagnostics " + to_string(error.size()) + "\n" + error + "done failed\n";
+                    if (send(connection->fd, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+                        // The client is gone or not reading; it is hung up on either way
+                    }
+                    connection->open = false;
+                    break;
+                }
+                case RequestIncomplete:
+                    break;
+            }
+        };
+        char chunk[65536];
+        auto receive = [&](Connection* connection) {
+            ssize_t n = recv(connection->fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (n <= 0) {
+                connection->open = false;
+                return;
+            }
+            connection->input.append(chunk, n);
+            takeNext(connection);
+        };
+
+        vector<pollfd> fds;
+        vector<Connection*> polled;  // the connection behind each of fds past the first two
+        while (!stopRequested) {
+            fds.assign({{wake[0], POLLIN, 0}, {listenFd, POLLIN, 0}});
+            polled.clear();
+            for (auto& connection : connections) {
+                if (connection->busy) continue;
+                fds.push_back({connection->fd, POLLIN, 0});
+                polled.push_back(connection.get());
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                perror("poll");
+                break;
+            }
+
+            if (fds[0].revents) {
+                char drain[64];
+                while (read(wake[0], drain, sizeof(drain)) > 0) {
+                }
+                vector<Connection*> done;
+                {
+                    lock_guard<mutex> guard(finishedLock);
+                    done.swap(finished);
+                }
+                for (Connection* connection : done) {
+                    connection->busy = false;
+                    if (connection->open) takeNext(connection);  // a request sent behind the last one
+                }
+            }
+
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (fds[i].revents && polled[i - 2]->open && !polled[i - 2]->busy) receive(polled[i - 2]);
+            }
+
+            for (size_t i = 0; i < connections.size();) {
+                if (!connections[i]->busy && !connections[i]->open) {
+                    close(connections[i]->fd);
+                    connections.erase(connections.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+
+            if (fds[1].revents & POLLIN) {
+                int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0) {
+                    connections.push_back(unique_ptr<Connection>(new Connection(client)));
+                } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+                    perror("accept");
+                    break;
+                }
+            }
+        }
+
+        // Responses still being written fail at once; the pool then waits
+        // for any compilation in progress
+        for (auto& connection : connections) {
+            shutdown(connection->fd, SHUT_RDWR);
+        }
+    }
+
+    for (auto& connection : connections) {
+        close(connection->fd);
+    }
+    wakeFd = -1;
+    close(wake[0]);
+    close(wake[1]);
+    close(listenFd);
+    unlink(socketPath.c_str());
+    if (cache) cache->printStats(cerr);
+    return true;
+}
+
+/* Answers one request with the options it carries, checked as the command
+   line's are. Returns false when the connection is done: the client stopped
+   reading. */
+bool CompileServer::serveRequest(SocketStream& stream, CompileRequest& request, Compiler& compiler) {
+    CompileOptions options;
+    options.emitIR = request.flags == "ir" || request.flags == "bc";
+    options.irFormat = request.flags == "bc" ? IRBitcode : IRText;
+    string diagnostics;
+    if (!parseRequestOptions(request.options, options, diagnostics) || !options.validate(diagnostics)) {
+        return stream.writeSection("diagnostics", diagnostics) && stream.write("done failed\n");
+    }
+
+    compiler.configure(options);
+    CompileResult result = compiler.compile(request.name, request.source, options.emitIR, options.irFormat);
+    request.source.clear();
+
+    bool sent = stream.writeSection("diagnostics", result.diagnostics);
+    if (result.ok) {
+        if (options.emitIR) sent = sent && stream.writeSection("ir", result.optIR);
+        sent = sent && stream.writeSection("asm", result.assembly);
+    }
+    return sent && stream.write(result.ok ? "done ok\n" : "done failed\n");
+}
+
+/* Sends each source to a running server and writes the results where a
+   local batch compile would have put them; the cycle report is made here,
+   from the assembly that comes back. Returns the number of failures. */
+int runClient(const string& socketPath, const vector<string>& sources, const CompileOptions& options) {
+    sockaddr_un addr;
+    if (!fillAddress(socketPath, addr)) return (int)sources.size();
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(socketPath.c_str());
+        if (fd >= 0) close(fd);
+        return (int)sources.size();
+    }
+
+    SocketStream stream(fd);
+    string optionsText = requestOptions(options);
+    int failures = 0;
+    for (size_t i = 0; i < sources.size(); i++) {
+        const string& source = sources[i];
+        SourceBuffer contents;
+        if (!readSource(source, contents)) {
+            cerr << "Cannot open " << source << endl;
+            failures++;
+            continue;
+        }
+
+        const char* flags = !options.emitIR ? "-" : options.irFormat == IRBitcode ? "bc" : "ir";
+        string request = string("compile ") + flags + " " + to_string(optionsText.size()) + " " +
+                         to_string(source.size()) + " " + to_string(contents.size()) + "\n";
+        if (!stream.write(request) || !stream.write(optionsText) || !stream.write(source) ||
+            !stream.write(contents.data(), contents.size())) {
+            cerr << "Lost connection to " << socketPath << endl;
+            close(fd);
+            return failures + (int)(sources.size() - i);
+        }
+
+        OutputPaths paths = outputPathsFor(source, options);
+        string line, body;
+        bool ok = false;
+        while (stream.readLine(line)) {
+            if (line == "done ok" || line == "done failed") {
+                ok = line == "done ok";
+                break;
+            }
+
+            char tag[16];
+            size_t length;
+            if (sscanf(line.c_str(), "%15s %zu", tag, &length) != 2 || !stream.readBytes(length, body)) break;
+
+            if (strcmp(tag, "diagnostics") == 0) {
+                cerr << body;
+            } else if (strcmp(tag, "ir") == 0) {
+                writeFile(paths.optIR, body);
+            } else if (strcmp(tag, "asm") == 0) {
+                if (options.cycleReport) {
+                    cerr << source << ":\n";
+                    runCycleEstimator(body, cerr);
+                }
+                if (options.assemblyFd >= 0) {
+                    writeAll(options.assemblyFd, body);
+                } else {
+                    writeFile(paths.assembly, body);
+                }
+            }
+        }
+        if (!ok) failures++;
+    }
+
+    close(fd);
+    return failures;
+}
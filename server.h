@@ -0,0 +1,58 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+
+class SocketStream;
+struct CompileRequest;
+
+/*
+Compile server protocol, over a Unix domain stream socket. A connection
+carries any number of requests, each answered before the next is served.
+
+Request:
+    compile <flags> <options-length> <name-length> <source-length>\n<options><name><source>
+where <flags> is "ir" to also get the optimized IR back as text, "bc" to
+get it as bitcode, or "-". <options> holds the client's code generation
+options, one per line as on its command line: -O0 or -O1 (the default),
+--profile-generate, and --profile-use, after which the profile's text runs
+to the end of <options>. A <name> ending in .ll or .bc marks the source as
+IR rather than miniC. No part may be longer than 64 MB.
+
+Response, a sequence of sections followed by a status line:
+    diagnostics <length>\n<bytes>
+    ir <length>\n<bytes>      only when asked for and compilation succeeded
+    asm <length>\n<bytes>     only when compilation succeeded
+    done ok|failed\n
+A malformed request is answered with its diagnostics and "done failed",
+and the server then hangs up.
+*/
+
+/* Keeps a warm compiler process around. Requests are read in full by the
+   accept loop and then served from a pool of workers, each with its own
+   Compiler set up for the request's options, so they run in parallel and
+   never touch the disk; a connection holds a worker only while one of its
+   requests is being served. */
+class CompileServer {
+   public:
+    CompileServer(const std::string& socketPath, const CompileOptions& options);  // options for jobs and cache only
+    bool run();
+
+   private:
+    struct Connection;
+
+    bool serveRequest(SocketStream& stream, CompileRequest& request, Compiler& compiler);
+
+    std::string socketPath;
+    std::unique_ptr<CompileCache> cache;
+    std::vector<std::unique_ptr<Compiler>> workers;
+};
+
+int runClient(const std::string& socketPath, const std::vector<std::string>& sources,
+              const CompileOptions& options);
+
+#endif  // SERVER_H
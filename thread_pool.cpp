@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+// The pool whose worker runs on this thread, if any, and that worker's index
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int numWorkers)
+    : queued(0), unfinished(0), nextQueue(0), stopping(false) {
+    if (numWorkers < 1) numWorkers = 1;
+    for (int i = 0; i < numWorkers; i++) {
+        queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/* Tasks submitted from one of this pool's workers go to that worker's own
+   deque; tasks from anywhere else, workers of other pools included, are
+   dealt round-robin. The task only counts as queued once it is in its
+   deque, so every task a worker claims is there for it to take. */
+void ThreadPool::submit(Task task) {
+    size_t target;
+    {
+        lock_guard<mutex> guard(stateLock);
+        target = currentPool == this ? currentWorker : nextQueue++ % queues.size();
+        unfinished++;
+    }
+    {
+        lock_guard<mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> guard(stateLock);
+        queued++;
+    }
+    wakeup.notify_one();
+}
+
+/* Blocks until every submitted task has completed. */
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(stateLock);
+    idle.wait(guard, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::popOrSteal(int self, Task& task) {
+    {
+        WorkQueue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkQueue& victim = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/* A worker claims one queued task before looking for it. A claimed task
+   is in some deque, but another worker may have taken it and left a task
+   pushed since in a deque already searched, so the search repeats until
+   one turns up. */
+void ThreadPool::workerLoop(int self) {
+    currentPool = this;
+    currentWorker = self;
+    for (;;) {
+        {
+            unique_lock<mutex> guard(stateLock);
+            wakeup.wait(guard, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+            queued--;
+        }
+
+        Task task;
+        while (!popOrSteal(self, task)) {
+            this_thread::yield();
+        }
+
+        task(self);
+
+        bool done;
+        {
+            lock_guard<mutex> guard(stateLock);
+            done = --unfinished == 0;
+        }
+        if (done) idle.notify_all();
+    }
+}
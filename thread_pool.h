@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of workers, each with its own task deque. A worker runs its own
+   tasks newest-first and, when it runs dry, steals the oldest task from
+   another worker. Tasks receive the index of the worker running them so they
+   can use per-worker state without locking. */
+class ThreadPool {
+   public:
+    typedef std::function<void(int worker)> Task;
+
+    explicit ThreadPool(int numWorkers);
+    ~ThreadPool();
+
+    void submit(Task task);
+    void wait();
+    int size() const { return (int)workers.size(); }
+
+   private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool popOrSteal(int self, Task& task);
+    void workerLoop(int self);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateLock;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    size_t queued;      // in a deque and not yet claimed by a worker
+    size_t unfinished;  // submitted but not yet completed
+    size_t nextQueue;
+    bool stopping;
+};
+
+#endif  // THREAD_POOL_H
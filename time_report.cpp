@@ -0,0 +1,268 @@
+#include "time_report.h"
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+
+using namespace std;
+
+// Bumped by every operator new on this thread
+static thread_local uint64_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    if (void* ptr = malloc(size ? size : 1)) return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+/* One perf event group per thread: cycles, cache misses and branch misses,
+   read together. Opened on first use; fd stays -1 if the kernel refuses. */
+struct HardwareCounters {
+    int fds[3] = {-2, -1, -1};
+
+    ~HardwareCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    bool open() {
+        if (fds[0] != -2) return fds[0] >= 0;
+
+        const uint64_t configs[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES,
+                                     PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < 3; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] < 0) {
+                for (int j = 0; j < i; j++) close(fds[j]);
+                fds[0] = fds[1] = fds[2] = -1;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void read(PhaseCost& cost) {
+        if (!open()) return;
+        uint64_t values[4];  // count, then one value per event
+        if (::read(fds[0], values, sizeof(values)) == sizeof(values)) {
+            cost.cycles = values[1];
+            cost.cacheMisses = values[2];
+            cost.branchMisses = values[3];
+        }
+    }
+};
+
+static thread_local HardwareCounters counters;
+static thread_local string scopePath;
+static thread_local int threadId = -1;
+static atomic<int> nextThreadId(0);
+
+static uint64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long peakRssKB() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+bool hardwareCountersAvailable() {
+    return counters.open();
+}
+
+atomic<TimeReport*> TimeReport::current(nullptr);
+
+TimeReport::TimeReport(bool _keepEvents) : keepEvents(_keepEvents), startNs(0), stopNs(0) {
+}
+
+TimeReport::~TimeReport() {
+    if (active() == this) stop();
+}
+
+/* Makes this the report every TimeScope records into. */
+void TimeReport::start() {
+    startNs = nowNs();
+    current = this;
+}
+
+void TimeReport::stop() {
+    current = nullptr;
+    stopNs = nowNs();
+}
+
+void TimeReport::record(const string& path, const char* name, uint64_t start, const PhaseCost& cost) {
+    if (threadId < 0) threadId = nextThreadId++;
+
+    lock_guard<mutex> guard(lock);
+    Phase& phase = phases[path];
+    if (phase.calls++ == 0) {
+        phase.name = name;
+        phase.firstStartNs = start;
+    }
+    phase.total.wallNs += cost.wallNs;
+    phase.total.cycles += cost.cycles;
+    phase.total.cacheMisses += cost.cacheMisses;
+    phase.total.branchMisses += cost.branchMisses;
+    phase.total.allocations += cost.allocations;
+    phase.total.peakRssKB = max(phase.total.peakRssKB, cost.peakRssKB);
+
+    if (keepEvents) events.push_back(Event{name, threadId, start, cost});
+}
+
+/* The summed cost of one path, e.g. "compile/parse"; zero if it never ran. */
+PhaseCost TimeReport::costOf(const string& path) const {
+    lock_guard<mutex> guard(lock);
+    auto phase = phases.find(path);
+    return phase == phases.end() ? PhaseCost() : phase->second.total;
+}
+
+/* Paths directly under parent, in the order they were first entered. */
+vector<string> TimeReport::childrenOf(const string& parent) const {
+    vector<string> children;
+    for (const auto& entry : phases) {
+        const string& path = entry.first;
+        size_t slash = path.find_last_of('/');
+        string parentPath = slash == string::npos ? "" : path.substr(0, slash);
+        if (parentPath == parent) children.push_back(path);
+    }
+    sort(children.begin(), children.end(), [this](const string& a, const string& b) {
+        return phases.at(a).firstStartNs < phases.at(b).firstStartNs;
+    });
+    return children;
+}
+
+void TimeReport::printTextTree(ostream& out, const string& parent, int depth) const {
+    bool hardware = hardwareCountersAvailable();
+    for (const string& path : childrenOf(parent)) {
+        const Phase& phase = phases.at(path);
+        const PhaseCost& cost = phase.total;
+        char line[256];
+        string label = string(depth * 2, ' ') + phase.name;
+        if (hardware) {
+            snprintf(line, sizeof(line), "%-34s %7d %10.3f %14llu %12llu %12llu %10llu %9.1f", label.c_str(),
+                     phase.calls, cost.wallNs / 1e6, (unsigned long long)cost.cycles,
+                     (unsigned long long)cost.cacheMisses, (unsigned long long)cost.branchMisses,
+                     (unsigned long long)cost.allocations, cost.peakRssKB / 1024.0);
+        } else {
+            snprintf(line, sizeof(line), "%-34s %7d %10.3f %14s %12s %12s %10llu %9.1f", label.c_str(),
+                     phase.calls, cost.wallNs / 1e6, "-", "-", "-", (unsigned long long)cost.allocations,
+                     cost.peakRssKB / 1024.0);
+        }
+        out << line << "\n";
+        printTextTree(out, path, depth + 1);
+    }
+}
+
+void TimeReport::printText(ostream& out) const {
+    lock_guard<mutex> guard(lock);
+    char line[256];
+    snprintf(line, sizeof(line), "%-34s %7s %10s %14s %12s %12s %10s %9s", "phase", "calls", "wall ms",
+             "cycles", "cache miss", "branch miss", "allocs", "peak MB");
+    out << "===== Time report: " << (stopNs - startNs) / 1e6 << " ms elapsed =====\n" << line << "\n";
+    printTextTree(out, "", 0);
+    if (!hardwareCountersAvailable()) out << "(hardware counters unavailable: perf_event_open was refused)\n";
+    out.flush();
+}
+
+void TimeReport::printJSON(ostream& out) const {
+    lock_guard<mutex> guard(lock);
+    bool hardware = hardwareCountersAvailable();
+    out << "{\n  \"elapsed_ms\": " << (stopNs - startNs) / 1e6 << ",\n"
+        << "  \"hardware_counters\": " << (hardware ? "true" : "false") << ",\n"
+        << "  \"phases\": [";
+
+    bool first = true;
+    for (const auto& entry : phases) {
+        const Phase& phase = entry.second;
+        const PhaseCost& cost = phase.total;
+        out << (first ? "\n" : ",\n") << "    {\"path\": \"" << entry.first << "\", \"name\": \"" << phase.name
+            << "\", \"calls\": " << phase.calls << ", \"wall_ms\": " << cost.wallNs / 1e6;
+        if (hardware) {
+            out << ", \"cycles\": " << cost.cycles << ", \"cache_misses\": " << cost.cacheMisses
+                << ", \"branch_misses\": " << cost.branchMisses;
+        } else {
+            out << ", \"cycles\": null, \"cache_misses\": null, \"branch_misses\": null";
+        }
+        out << ", \"allocations\": " << cost.allocations << ", \"peak_rss_kb\": " << cost.peakRssKB << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+    out.flush();
+}
+
+/* Chrome trace-event format, one complete ("X") event per scope; load it in
+   chrome://tracing or Perfetto. */
+bool TimeReport::writeTrace(const string& filename) const {
+    ofstream out(filename);
+    if (!out) return false;
+
+    lock_guard<mutex> guard(lock);
+    bool hardware = hardwareCountersAvailable();
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for (const Event& event : events) {
+        out << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"compile\", \"ph\": \"X\""
+            << ", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << (event.startNs - startNs) / 1e3
+            << ", \"dur\": " << event.cost.wallNs / 1e3 << ", \"args\": {\"allocations\": " << event.cost.allocations
+            << ", \"peak_rss_kb\": " << event.cost.peakRssKB;
+        if (hardware) {
+            out << ", \"cycles\": " << event.cost.cycles << ", \"cache_misses\": " << event.cost.cacheMisses
+                << ", \"branch_misses\": " << event.cost.branchMisses;
+        }
+        out << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+void TimeScope::begin() {
+    parentLength = scopePath.size();
+    if (!scopePath.empty()) scopePath += '/';
+    scopePath += name;
+
+    counters.read(startCost);
+    startCost.allocations = allocationCount;
+    startNs = nowNs();
+}
+
+void TimeScope::end() {
+    PhaseCost cost;
+    cost.wallNs = nowNs() - startNs;
+    counters.read(cost);
+    cost.cycles -= startCost.cycles;
+    cost.cacheMisses -= startCost.cacheMisses;
+    cost.branchMisses -= startCost.branchMisses;
+    cost.allocations = allocationCount - startCost.allocations;
+    cost.peakRssKB = peakRssKB();
+
+    report->record(scopePath, name, startNs, cost);
+    scopePath.resize(parentLength);
+}
@@ -0,0 +1,103 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* What a region of compile time cost. Hardware counters are per thread and
+   only valid when perf_event_open is allowed; allocations count calls to
+   operator new on the thread; peak RSS is the process-wide high-water mark
+   seen when the region ended. */
+struct PhaseCost {
+    uint64_t wallNs = 0;
+    uint64_t cycles = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+    uint64_t allocations = 0;
+    long peakRssKB = 0;
+};
+
+/* Collects the cost of every TimeScope while it is the active report, for
+   --time-report. Scopes nest, and costs are summed per path through the
+   nesting, e.g. "compile/optimizer/constantFolding". Every scope can also be
+   kept as an event for a Chrome trace file. */
+class TimeReport {
+   public:
+    explicit TimeReport(bool keepEvents);
+    ~TimeReport();
+    TimeReport(const TimeReport&) = delete;
+    TimeReport& operator=(const TimeReport&) = delete;
+
+    static TimeReport* active() { return current.load(std::memory_order_relaxed); }
+    void start();
+    void stop();
+
+    void record(const std::string& path, const char* name, uint64_t startNs, const PhaseCost& cost);
+    PhaseCost costOf(const std::string& path) const;
+    void printText(std::ostream& out) const;
+    void printJSON(std::ostream& out) const;
+    bool writeTrace(const std::string& filename) const;
+
+   private:
+    struct Phase {
+        std::string name;
+        int calls = 0;
+        uint64_t firstStartNs = 0;
+        PhaseCost total;
+    };
+    struct Event {
+        const char* name;
+        int thread;
+        uint64_t startNs;
+        PhaseCost cost;
+    };
+
+    std::vector<std::string> childrenOf(const std::string& parent) const;
+    void printTextTree(std::ostream& out, const std::string& parent, int depth) const;
+
+    static std::atomic<TimeReport*> current;
+
+    bool keepEvents;
+    uint64_t startNs, stopNs;
+    mutable std::mutex lock;
+    std::map<std::string, Phase> phases;
+    std::vector<Event> events;
+};
+
+/* Times the enclosing block against the active report:
+       TimeScope scope("constantFolding");
+   A single load and branch when no report is being collected. */
+class TimeScope {
+   public:
+    explicit TimeScope(const char* name);
+    ~TimeScope();
+    TimeScope(const TimeScope&) = delete;
+    TimeScope& operator=(const TimeScope&) = delete;
+
+   private:
+    void begin();
+    void end();
+
+    const char* name;
+    TimeReport* report;
+    size_t parentLength;
+    uint64_t startNs;
+    PhaseCost startCost;
+};
+
+inline TimeScope::TimeScope(const char* _name) : name(_name), report(TimeReport::active()) {
+    if (report) begin();
+}
+
+inline TimeScope::~TimeScope() {
+    if (report) end();
+}
+
+bool hardwareCountersAvailable();
+
+#endif  // TIME_REPORT_H